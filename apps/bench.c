@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "taskstat.h"
+
+// 基准测试：系统调用、文件读写、malloc、memcpy、控制台输出、创建进程
+// 每项结果输出一行 BENCH <名字> <数值> <单位>，同时写进bench.txt，方便脚本收集和比较
+// bench -noop 什么都不干直接退出，测创建进程时用
+
+#define FILE_SIZE (64 * 1024)
+#define CHUNK 4096
+#define RAND_IO 512
+#define BENCH_FILE "bench.tmp"
+#define RESULT_FILE "bench.txt"
+
+static uint32_t mhz = 1; // TSC频率，启动时校准
+
+static uint64_t rdtsc()
+{
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t) hi << 32) | lo;
+}
+
+// 应用程序不链接libgcc，没有64位除法；除数小于65536时拆成16位一段做长除法
+static uint32_t udiv64_16(uint64_t n, uint32_t d)
+{
+    uint32_t hi = (uint32_t) (n >> 32), lo = (uint32_t) n;
+    uint32_t limb[4] = {hi >> 16, hi & 0xffff, lo >> 16, lo & 0xffff};
+    uint32_t rem = 0;
+    for (int i = 0; i < 4; i++) {
+        uint32_t cur = (rem << 16) | limb[i];
+        limb[i] = cur / d;
+        rem = cur % d;
+    }
+    if (limb[0] || limb[1]) return 0xffffffff; // 超过32位了，测量不会这么久
+    return (limb[2] << 16) | limb[3];
+}
+
+static uint32_t elapsed_us(uint64_t start)
+{
+    uint32_t us = udiv64_16(rdtsc() - start, mhz);
+    return us ? us : 1;
+}
+
+// 数一数两次系统tick之间过了多少个TSC周期，得到CPU频率
+static void calibrate()
+{
+    task_stat_t st;
+    int pid = getpid();
+    taskstat(pid, &st);
+    uint32_t tick = st.now;
+    while (taskstat(pid, &st) != -1 && st.now == tick); // 对齐到tick边界
+    uint64_t start = rdtsc();
+    tick = st.now;
+    while (taskstat(pid, &st) != -1 && st.now - tick < 10);
+    uint32_t cycles = (uint32_t) (rdtsc() - start); // 10个tick，4GHz以内不会超过32位
+    mhz = cycles / 10 * st.hz / 1000000;
+    if (!mhz) mhz = 1;
+}
+
+static int result_fd = -1;
+
+static void report(const char *name, uint32_t value, const char *unit)
+{
+    char line[96];
+    int len = snprintf(line, sizeof(line), "BENCH %s %u %s\n", name, value, unit);
+    printf("%s", line);
+    if (result_fd != -1) write(result_fd, line, len);
+}
+
+// 每秒多少KB，bytes要是16的倍数
+static uint32_t kb_per_sec(uint32_t bytes, uint32_t us)
+{
+    return bytes / 16 * 15625 / us; // bytes * 1000000 / 1024 / us，先约分免得溢出
+}
+
+static void bench_syscall()
+{
+    const int n = 10000;
+    uint64_t t = rdtsc();
+    for (int i = 0; i < n; i++) getpid();
+    report("syscall_getpid", udiv64_16(rdtsc() - t, 1) / n, "cycles");
+}
+
+static char *io_buf;
+
+static void bench_file()
+{
+    unlink(BENCH_FILE);
+    int fd = open(BENCH_FILE, O_CREAT | O_RDWR);
+    if (fd == -1) {
+        printf("bench: cannot create %s\n", BENCH_FILE);
+        return;
+    }
+    for (int i = 0; i < CHUNK; i++) io_buf[i] = i;
+    uint64_t t = rdtsc();
+    for (int off = 0; off < FILE_SIZE; off += CHUNK) write(fd, io_buf, CHUNK);
+    report("file_seq_write", kb_per_sec(FILE_SIZE, elapsed_us(t)), "KB/s");
+    close(fd);
+
+    fd = open(BENCH_FILE, O_RDONLY);
+    t = rdtsc();
+    int total = 0, ret;
+    while ((ret = read(fd, io_buf, CHUNK)) > 0) total += ret;
+    report("file_seq_read", kb_per_sec(total & ~15, elapsed_us(t)), "KB/s");
+    close(fd);
+
+    fd = open(BENCH_FILE, O_RDWR);
+    uint32_t seed = 1;
+    const int nread = 256, nwrite = 16;
+    t = rdtsc();
+    for (int i = 0; i < nread; i++) {
+        seed = seed * 1103515245 + 12345;
+        pread(fd, io_buf, RAND_IO, (seed >> 8) % (FILE_SIZE / RAND_IO) * RAND_IO);
+    }
+    report("file_rand_read", elapsed_us(t) / nread, "us/op");
+    t = rdtsc();
+    for (int i = 0; i < nwrite; i++) {
+        seed = seed * 1103515245 + 12345;
+        pwrite(fd, io_buf, RAND_IO, (seed >> 8) % (FILE_SIZE / RAND_IO) * RAND_IO);
+    }
+    report("file_rand_write", elapsed_us(t) / nwrite, "us/op");
+    close(fd);
+    unlink(BENCH_FILE);
+}
+
+static void bench_malloc()
+{
+    enum { SLOTS = 256, OPS = 20000 };
+    static void *slot[SLOTS];
+    uint32_t seed = 1;
+    uint64_t t = rdtsc();
+    for (int i = 0; i < OPS; i++) {
+        seed = seed * 1103515245 + 12345;
+        int k = (seed >> 8) % SLOTS;
+        if (slot[k]) {
+            free(slot[k]);
+            slot[k] = NULL;
+        } else {
+            slot[k] = malloc((seed >> 16) % 512 + 1);
+        }
+    }
+    uint32_t cycles = udiv64_16(rdtsc() - t, 1);
+    for (int k = 0; k < SLOTS; k++) free(slot[k]);
+    report("malloc_free", cycles / OPS, "cycles/op");
+}
+
+static void bench_memcpy()
+{
+    char *dst = (char *) malloc(FILE_SIZE);
+    if (!dst) return;
+    const int rounds = 32;
+    uint64_t t = rdtsc();
+    for (int i = 0; i < rounds; i++) memcpy(dst, io_buf, FILE_SIZE);
+    report("memcpy_64k", FILE_SIZE * rounds / elapsed_us(t), "MB/s"); // 字节/微秒就是MB/s
+    free(dst);
+}
+
+static void bench_console()
+{
+    const int lines = 100;
+    char line[81];
+    memset(line, '#', 79);
+    line[79] = '\n';
+    line[80] = 0;
+    fflush(stdout); // 前面printf的东西先出去，别算进来
+    uint64_t t = rdtsc();
+    for (int i = 0; i < lines; i++) write(1, line, 80);
+    report("console_write", kb_per_sec(lines * 80, elapsed_us(t)), "KB/s");
+}
+
+static void bench_spawn()
+{
+    const int n = 10;
+    uint64_t t = rdtsc();
+    for (int i = 0; i < n; i++) {
+        int pid = create_process("bench.bin", "bench.bin -noop", "/");
+        if (pid == -1) {
+            printf("bench: cannot spawn bench.bin\n");
+            return;
+        }
+        waitpid(pid);
+    }
+    report("spawn_wait", elapsed_us(t) / n, "us/op");
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1 && !strcmp(argv[1], "-noop")) return 0;
+    io_buf = (char *) malloc(FILE_SIZE);
+    if (!io_buf) {
+        printf("bench: out of memory\n");
+        return 1;
+    }
+    calibrate();
+    unlink(RESULT_FILE);
+    result_fd = open(RESULT_FILE, O_CREAT | O_RDWR);
+    report("tsc_mhz", mhz, "MHz");
+    bench_syscall();
+    bench_memcpy();
+    bench_malloc();
+    bench_file();
+    bench_console();
+    bench_spawn();
+    if (result_fd != -1) close(result_fd);
+    return 0;
+}
@@ -377,10 +377,14 @@ void display_frame(const char **frame)
         }
         printf("%s\n", RESET);
     }
+    fflush(stdout); // 一帧攒完再一起写
 }
 
+static char frame_buf[FRAME_HEIGHT * (FRAME_WIDTH * 6 + 8) + 16]; // 一整帧的转义序列都放得下
+
 int main()
 {
+    setvbuf(stdout, frame_buf, _IOFBF, sizeof(frame_buf)); // 全缓冲，不然每个色块一次系统调用
     printf("\033[3J");
     for (int t = 0; t < 100; t++) {
         for (int i = 0; i < 12; i++) {
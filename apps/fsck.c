@@ -0,0 +1,23 @@
+#include <stdio.h>
+#include <string.h>
+#include "fsck.h"
+
+int main(int argc, char **argv)
+{
+    int repair = argc > 1 && !strcmp(argv[1], "-r"); // -r：修复
+    fsck_report_t report;
+    int problems = fsck(&report, repair);
+    if (problems < 0) {
+        printf("fsck: cannot check the volume\n");
+        return 1;
+    }
+    printf("%d files, %d/%d clusters used\n", report.files, report.used, report.clusters);
+    if (report.lost_clusters) printf("lost clusters: %d in %d chain(s)\n", report.lost_clusters, report.lost_chains);
+    if (report.cross_links) printf("cross-linked clusters: %d\n", report.cross_links);
+    if (report.bad_chains) printf("broken chains: %d\n", report.bad_chains);
+    if (report.size_mismatches) printf("size mismatches: %d\n", report.size_mismatches);
+    if (report.fat_mismatches) printf("FAT1/FAT2 mismatched sectors: %d\n", report.fat_mismatches);
+    if (repair && report.repaired) printf("repaired: %d\n", report.repaired);
+    printf(problems ? "fsck: %d problem(s) found\n" : "fsck: clean\n", problems);
+    return problems ? 1 : 0;
+}
@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+
+// 测malloc/free/realloc的吞吐：随机大小、随机顺序地分配释放，最后统计每次操作平均多少周期
+
+#define SLOTS 512
+#define OPS 20000
+
+static uint32_t rdtsc_lo()
+{
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return lo; // 单次测量不会超过2^32个周期，低32位够用
+}
+
+static uint32_t seed = 1;
+
+static uint32_t rand32()
+{
+    seed = seed * 1103515245 + 12345; // 线性同余，够用了
+    return seed >> 8;
+}
+
+// 大多数是小块，偶尔来一个大的
+static uint32_t rand_size(int max_small)
+{
+    uint32_t r = rand32();
+    if ((r & 15) == 0) return (r >> 4) % 16384 + 1;
+    return (r >> 4) % max_small + 1;
+}
+
+static void *slot[SLOTS];
+
+static void run(const char *name, int max_small, int use_realloc)
+{
+    uint32_t ops = 0, fails = 0;
+    seed = 1;
+    uint32_t t = rdtsc_lo();
+    for (int i = 0; i < OPS; i++) {
+        int k = rand32() % SLOTS;
+        if (!slot[k]) {
+            slot[k] = malloc(rand_size(max_small));
+            if (!slot[k]) fails++;
+            else *(char *) slot[k] = 1; // 碰一下，保证真的能用
+        } else if (use_realloc && (rand32() & 1)) {
+            void *p = realloc(slot[k], rand_size(max_small));
+            if (!p) fails++;
+            else slot[k] = p;
+        } else {
+            free(slot[k]);
+            slot[k] = NULL;
+        }
+        ops++;
+    }
+    for (int k = 0; k < SLOTS; k++) { // 收尾也算进去
+        if (slot[k]) {
+            free(slot[k]);
+            slot[k] = NULL;
+            ops++;
+        }
+    }
+    uint32_t cycles = rdtsc_lo() - t;
+    printf("%-14s %6d ops  %10d cycles  %6d cycles/op", name, ops, cycles, cycles / ops);
+    if (fails) printf("  (%d failed)", fails);
+    printf("\n");
+}
+
+int main()
+{
+    run("small", 64, 0);
+    run("medium", 1024, 0);
+    run("small+realloc", 64, 1);
+    run("mixed+realloc", 1024, 1);
+    // 全部释放以后，重新要一块大的应该能直接用上合并出来的空闲块
+    uint32_t t = rdtsc_lo();
+    void *big = calloc(256, 1024);
+    printf("calloc 256KB   %10d cycles%s\n", rdtsc_lo() - t, big ? "" : "  (failed)");
+    free(big);
+    return 0;
+}
@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// 测一下string.c里几个函数每个周期能处理多少字节，顺便和最朴素的逐字节循环比一比
+
+#define MAX_SIZE 65536
+#define ROUNDS 16
+
+static uint32_t rdtsc_lo()
+{
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return lo; // 单次测量不会超过2^32个周期，低32位够用
+}
+
+static void byte_copy(void *dst_, const void *src_, uint32_t size)
+{
+    uint8_t *dst = dst_;
+    const uint8_t *src = src_;
+    while (size-- > 0) *dst++ = *src++;
+}
+
+static char *src, *dst;
+
+// 输出 每周期字节数，保留两位小数
+static void report(const char *name, uint32_t size, uint32_t cycles)
+{
+    if (!cycles) cycles = 1;
+    uint32_t bpc100 = size * ROUNDS * 100 / cycles; // 最大65536*16*100，32位放得下，不用64位除法
+    printf("%-10s %6d bytes  %8d cycles  %3d.%02d bytes/cycle\n", name, size, cycles / ROUNDS, bpc100 / 100, bpc100 % 100);
+}
+
+int main()
+{
+    src = (char *) malloc(MAX_SIZE + 4);
+    dst = (char *) malloc(MAX_SIZE + 4);
+    if (!src || !dst) {
+        printf("membench: out of memory\n");
+        return 1;
+    }
+    for (int i = 0; i < MAX_SIZE; i++) src[i] = 'a' + i % 26;
+    src[MAX_SIZE] = 0;
+    for (uint32_t size = 64; size <= MAX_SIZE; size *= 8) {
+        uint32_t t;
+        t = rdtsc_lo();
+        for (int r = 0; r < ROUNDS; r++) byte_copy(dst, src, size);
+        report("bytecopy", size, rdtsc_lo() - t);
+        t = rdtsc_lo();
+        for (int r = 0; r < ROUNDS; r++) memcpy(dst, src, size);
+        report("memcpy", size, rdtsc_lo() - t);
+        t = rdtsc_lo();
+        for (int r = 0; r < ROUNDS; r++) memset(dst, r, size);
+        report("memset", size, rdtsc_lo() - t);
+        memcpy(dst, src, size);
+        t = rdtsc_lo();
+        for (int r = 0; r < ROUNDS; r++) memcmp(dst, src, size);
+        report("memcmp", size, rdtsc_lo() - t);
+        char saved = src[size];
+        src[size] = 0;
+        t = rdtsc_lo();
+        for (int r = 0; r < ROUNDS; r++) strlen(src);
+        report("strlen", size, rdtsc_lo() - t);
+        src[size] = saved;
+    }
+    return 0;
+}
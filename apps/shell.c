@@ -20,7 +20,7 @@ static void print_prompt() // 输出提示符
 static void readline(char *buf, int cnt) // 输入一行或cnt个字符
 {
     char *pos = buf; // 不想变buf
-    while (read(0, pos, 1) != -1 && (pos - buf) < cnt) { // 读字符成功且没到cnt个
+    while (fflush(stdout) != EOF && read(0, pos, 1) != -1 && (pos - buf) < cnt) { // 等键盘之前先把提示符和回显刷出去，再读字符
         switch (*pos) {
             case '\n':
             case '\r': // 回车或换行，结束
@@ -1,6 +1,8 @@
 #include "drivers/audio.h"
 #include "drivers/dma.h"
 #include "monios/common.h"
+#include "drivers/fifo.h"
+#include "drivers/isr.h"
 
 #define SB16_RESET      0x226
 #define SB16_READ       0x22A
@@ -8,10 +10,17 @@
 #define SB16_IRQ        5
 #define SB16_DMA8_CHAN  1
 
-static uint8_t* sb16_buffer = 0;
-static uint32_t sb16_size = 0;
-static uint32_t sb16_pos = 0;
-static uint8_t sb16_playing = 0;
+#define SB16_ACK8       0x22E // 读一下就算应答了8位DMA的中断
+
+// 等着播放的块：下半部往里放块的地址，中断里一块播完取下一块
+#define SB16_QUEUE_SIZE 16 // 必须是2的幂
+static uint32_t sb16_queue_buf[SB16_QUEUE_SIZE];
+static fifo_t sb16_queue;
+static uint32_t sb16_size = 0; // 每块多大
+static volatile uint8_t sb16_playing = 0;
+// 还没排进队列的部分，只有下半部在动
+static uint8_t* sb16_stream = 0;
+static uint32_t sb16_left = 0;
 static uint8_t sb16_stereo = 0; // 0=mono, 1=stereo
 
 static void sb16_delay(int count) {
@@ -19,13 +28,20 @@ static void sb16_delay(int count) {
         __asm__ volatile("nop");
 }
 
+static void sb16_irq(registers_t *regs) {
+    sb16_irq_handler();
+}
+
 // 检测 SB16
 int sb16_hw_init() {
+    fifo_init(&sb16_queue, SB16_QUEUE_SIZE, sb16_queue_buf);
     outb(SB16_RESET,1);
     sb16_delay(100);
     outb(SB16_RESET,0);
     sb16_delay(100);
-    return (inb(SB16_READ)==0xAA) ? 0 : -1;
+    if (inb(SB16_READ)!=0xAA) return -1;
+    register_interrupt_handler(IRQ5, sb16_irq);
+    return 0;
 }
 
 // 内部函数：启动 DMA 播放
@@ -43,25 +59,43 @@ static void sb16_start_dma(uint8_t* buffer, uint16_t size) {
     sb16_playing = 1;
 }
 
-// 中断处理
+// 下半部：把剩下的数据切块补进队列；停着的话取第一块开始播（这时中断不会来取，不算第二个消费者）
+static void sb16_refill(uint32_t data) {
+    while(sb16_left >= sb16_size && fifo_space(&sb16_queue) > 0) {
+        fifo_put(&sb16_queue, (uint32_t)sb16_stream);
+        sb16_stream += sb16_size;
+        sb16_left -= sb16_size;
+    }
+    if(!sb16_playing) { // 先放进去再看，中断刚好在放之前停掉也没关系
+        int first = fifo_get(&sb16_queue);
+        if(first != -1) sb16_start_dma((uint8_t*)first, sb16_size);
+    }
+}
+
+static tasklet_t sb16_tasklet = TASKLET_INIT(sb16_refill, 0);
+
+// 中断处理：马上接着播队列里的下一块，补队列交给下半部
 void sb16_irq_handler() {
+    inb(SB16_ACK8);
     if(!sb16_playing) return;
-    sb16_pos += sb16_size;
-    if(sb16_buffer[sb16_pos]!=0) {
-        sb16_start_dma(sb16_buffer + sb16_pos, sb16_size);
+    int next = fifo_get(&sb16_queue);
+    if(next != -1) {
+        sb16_start_dma((uint8_t*)next, sb16_size);
     } else {
         sb16_playing = 0;
     }
-    outb(SB16_WRITE,0xD0); // EOI
+    if(sb16_left) tasklet_schedule(&sb16_tasklet);
 }
 
-// 外部接口：播放音乐缓冲区
+// 外部接口：把buffer按size切块播放，total是总长度，马上返回
+// 上一段还没播完就返回-1
 int sb16_hw_play_music(uint8_t* buffer,uint32_t size,uint32_t total,uint8_t stereo) {
-    if(!buffer || size==0 || total==0) return -1;
-    sb16_buffer = buffer;
+    if(!buffer || size==0 || size>0xFFFF || total<size) return -1;
+    if(sb16_playing || sb16_left || fifo_status(&sb16_queue)) return -1;
     sb16_size = size;
-    sb16_pos = 0;
     sb16_stereo = stereo;
-    sb16_start_dma(sb16_buffer,sb16_size);
+    sb16_stream = buffer;
+    sb16_left = total - total % size; // 不够一块的尾巴不播
+    tasklet_schedule(&sb16_tasklet);
     return 0;
 }
@@ -0,0 +1,42 @@
+#include "drivers/fw_cfg.h"
+#include "string.h"
+
+static void fw_cfg_select(uint16_t key)
+{
+    outw(FW_CFG_PORT_SEL, key);
+}
+
+static void fw_cfg_read(void *buf, int size)
+{
+    uint8_t *p = (uint8_t *) buf;
+    while (size-- > 0) *p++ = inb(FW_CFG_PORT_DATA); // 每读一个字节，偏移自动加1
+}
+
+// fw_cfg里的整数都是大端
+static uint32_t be32(const uint8_t *p)
+{
+    return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+int fw_cfg_read_file(const char *name, void *buf, int size)
+{
+    char sig[4];
+    fw_cfg_select(FW_CFG_SIGNATURE);
+    fw_cfg_read(sig, 4);
+    if (memcmp(sig, "QEMU", 4)) return -1; // 不是QEMU，没有fw_cfg
+    uint8_t raw[4];
+    fw_cfg_select(FW_CFG_FILE_DIR);
+    fw_cfg_read(raw, 4);
+    uint32_t count = be32(raw);
+    for (uint32_t i = 0; i < count; i++) {
+        uint8_t entry[64]; // 大小4字节，选择子2字节，保留2字节，文件名56字节
+        fw_cfg_read(entry, sizeof(entry));
+        if (strcmp((char *) entry + 8, name)) continue;
+        uint32_t file_size = be32(entry);
+        int n = file_size < (uint32_t) size ? (int) file_size : size;
+        fw_cfg_select((entry[4] << 8) | entry[5]);
+        fw_cfg_read(buf, n);
+        return n;
+    }
+    return -1;
+}
@@ -1,4 +1,5 @@
 #include "monios/common.h"
+#include "monios/trace.h"
 
 // 等待磁盘，直到它就绪
 static void wait_disk_ready()
@@ -88,12 +89,16 @@ static void write_disk(int lba, int sec_cnt, uint32_t buffer)
 // 包装
 void hd_read(int lba, int sec_cnt, void *buffer)
 {
+    trace_event(TRACE_HD_READ, lba);
     read_disk(lba, sec_cnt, (uint32_t) buffer);
+    trace_event(TRACE_HD_READ_DONE, sec_cnt);
 }
 
 void hd_write(int lba, int sec_cnt, void *buffer)
 {
+    trace_event(TRACE_HD_WRITE, lba);
     write_disk(lba, sec_cnt, (uint32_t) buffer);
+    trace_event(TRACE_HD_WRITE_DONE, sec_cnt);
 }
 
 static int hd_size_cache = 0;
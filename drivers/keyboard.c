@@ -3,11 +3,14 @@
 #include "drivers/fifo.h"
 #include "stdbool.h"
 #include "log.h"
+#include "monios/monitor.h"
+#include "timer.h"
+
+extern uint32_t load_eflags();
+extern void store_eflags(uint32_t);
 
 fifo_t keyfifo;
-fifo_t decoded_key;
-uint32_t keybuf[32];
-uint32_t dkey_buf[32];
+uint32_t keybuf[KB_FIFO_SIZE];
 extern uint32_t keymap[];
 
 static int code_with_E0 = 0;
@@ -30,51 +33,85 @@ static void kb_wait()
     } while (kb_stat & 0x02);
 }
 
-static void kb_ack()
-{
-    uint8_t kb_data;
-    do {
-        kb_data = inb(KB_DATA); // KB_DATA: 0x60
-    } while (kb_data != KB_ACK); // KB_ACK: 0xFA
-}
+// 改灯要先发0xED，等键盘回ACK再发灯的状态，再等一个ACK
+// ACK和扫描码一样从中断里来，所以不能在这里死等，只记下走到哪一步，收到ACK时在led_ack里接着发
+static int led_state = 0; // 0：空闲，1：发了0xED等ACK，2：发了灯的状态等ACK
+static int led_again = 0; // 等ACK的时候灯又变了，这一轮完了再发一次
+static uint32_t led_since; // 哪个tick开始等的，键盘一直不回就不等了
 
 static void set_leds()
 {
-    uint8_t led_status = (caps_lock << 2) | (num_lock << 1) | scroll_lock;
-
+    if (led_state && timer_get_ticks() - led_since < 50) { // 上一次还没完
+        led_again = 1;
+        return;
+    }
     kb_wait();
     outb(KB_DATA, LED_CODE); // LED_CODE: 0xED
-    kb_ack();
+    led_state = 1;
+    led_since = timer_get_ticks();
+}
 
-    kb_wait();
-    outb(KB_DATA, led_status);
-    kb_ack();
+// 扫描码是改灯的ACK就吃掉，返回1
+static int led_ack(uint8_t scancode)
+{
+    if (scancode != KB_ACK || !led_state) return 0; // KB_ACK: 0xFA
+    if (led_state == 1) {
+        kb_wait();
+        outb(KB_DATA, (caps_lock << 2) | (num_lock << 1) | scroll_lock);
+        led_state = 2;
+    } else {
+        led_state = 0;
+        if (led_again) {
+            led_again = 0;
+            set_leds();
+        }
+    }
+    return 1;
 }
 
 static uint8_t get_scancode()
 {
-    uint8_t scancode;
+    return fifo_get(&keyfifo); // 中断里放、这里取，单生产者单消费者，不用关中断
+}
+
+// 控制台的键盘队列有两个生产者：这里（softirq任务，会被抢占）和ansi.c回答光标位置的report_cursor
+// 单生产者的队列容不下两个人同时放，两边都关着中断放，谁也插不进谁中间
+static void put_key(fifo_t *keys, uint32_t c)
+{
+    uint32_t eflags = load_eflags();
     asm("cli");
-    scancode = fifo_get(&keyfifo);
-    asm("sti");
-    return scancode;
+    fifo_put(keys, c);
+    store_eflags(eflags);
 }
 
 static void in_process(uint32_t key)
 {
+    int raw_key = key & MASK_RAW;
+    if ((key & (FLAG_ALT_L | FLAG_ALT_R)) && raw_key >= F1 && raw_key < F1 + NR_CONSOLES) { // Alt+Fn切换控制台
+        console_switch(raw_key - F1);
+        return;
+    }
+    if ((key & (FLAG_SHIFT_L | FLAG_SHIFT_R)) && (raw_key == PAGEUP || raw_key == PAGEDOWN)) { // Shift+PgUp/PgDn翻历史，每次半屏
+        console_scroll(raw_key == PAGEUP ? console_rows() / 2 : -console_rows() / 2);
+        return;
+    }
+    fifo_t *keys = console_keys(console_foreground()); // 键盘输入只给前台控制台
     if (!(key & FLAG_EXT)) {
-        fifo_put(&decoded_key, key & 0xFF);
+        console_scroll(0); // 打字就回到最新的内容
+        put_key(keys, key & 0xFF);
     } else {
-        int raw_key = key & MASK_RAW;
         switch (raw_key) {
             case ENTER:
-                fifo_put(&decoded_key, '\n');
+                console_scroll(0);
+                put_key(keys, '\n');
                 break;
             case BACKSPACE:
-                fifo_put(&decoded_key, '\b');
+                console_scroll(0);
+                put_key(keys, '\b');
                 break;
             case TAB:
-                fifo_put(&decoded_key, '\t');
+                console_scroll(0);
+                put_key(keys, '\t');
                 break;
         }
     }
@@ -88,7 +125,9 @@ static void keyboard_read()
     uint32_t *keyrow;
     if (fifo_status(&keyfifo) > 0) {
         scancode = get_scancode();
-        if (scancode == 0xE1) {
+        if (led_ack(scancode)) {
+            // 改灯的应答，不是按键
+        } else if (scancode == 0xE1) {
             // 特殊开头，暂不做处理
         } else if (scancode == 0xE0) {
             code_with_E0 = 1;
@@ -187,7 +226,7 @@ static void keyboard_read()
                                         key = PAGEUP;
                                         break;
                                     case PAD_PAGEDOWN:
-                                        key = PAD_PAGEDOWN;
+                                        key = PAGEDOWN;
                                         break;
                                     case PAD_INS:
                                         key = INSERT;
@@ -228,17 +267,24 @@ static void keyboard_read()
     }
 }
 
+// 下半部：在softirq任务里开着中断把攒下的扫描码全部解码
+static void keyboard_bh(uint32_t data)
+{
+    while (fifo_status(&keyfifo) > 0) keyboard_read();
+}
+
+static tasklet_t keyboard_tasklet = TASKLET_INIT(keyboard_bh, 0);
+
 void keyboard_handler(registers_t *regs)
 {
-    fifo_put(&keyfifo, inb(KB_DATA));
-    keyboard_read();
+    fifo_put(&keyfifo, inb(KB_DATA)); // 中断里只读端口，解码留给下半部
+    tasklet_schedule(&keyboard_tasklet);
 }
 
 void init_keyboard()
 {
     //printf_info("START KeyBoard");
-    fifo_init(&keyfifo, 32, keybuf);
-    fifo_init(&decoded_key, 32, dkey_buf);
+    fifo_init(&keyfifo, KB_FIFO_SIZE, keybuf);
 
     shift_l = shift_r = 0;
     alt_l = alt_r = 0;
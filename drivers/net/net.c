@@ -2,6 +2,9 @@
 #include "monios/common.h"     /* inb/outb */
 #include "drivers/gdtidt.h"    /* idt_set_gate */
 #include "log.h"
+#include "monios/trace.h"
+#include "drivers/fifo.h"
+#include "drivers/isr.h"
 
 #include <string.h>
 #include <stdint.h>
@@ -86,7 +89,18 @@ static uint8_t my_ip[IP_ALEN]    = {192,168,10,19};
 
 /* 简易缓冲区（构帧用） */
 static uint8_t tx_buf[1518];
-static uint8_t rx_buf[1600];
+
+/* 接收：中断里把帧从网卡拷到一个空槽，槽号 | 长度 << 16 放进 rx_ready；
+ * softirq 任务里批量取出来处理，处理完把槽号还回 rx_free。两个队列各自只有一个生产者和一个消费者，不用关中断 */
+#define RX_SLOTS     16        /* 必须是 2 的幂 */
+#define RX_FRAME_MAX 1600
+static uint8_t rx_slots[RX_SLOTS][RX_FRAME_MAX];
+static uint32_t rx_free_buf[RX_SLOTS], rx_ready_buf[RX_SLOTS];
+static fifo_t rx_free, rx_ready;
+static volatile uint32_t rx_dropped = 0; /* 没有空槽时丢掉的帧 */
+
+extern uint32_t load_eflags();
+extern void store_eflags(uint32_t);
 
 /* ping 状态（与之前一致，演示用） */
 static volatile uint8_t ping_received = 0;
@@ -207,6 +221,7 @@ static void rdm_read(uint16_t card_addr, void *dst, uint16_t len){
 static void ne2k_transmit(const void *data, uint16_t len){
     if (len < 60) len = 60;                 /* 以太网最小帧 */
     if (len > 1518) len = 1518;
+    trace_event(TRACE_NET_TX, len);
 
     /* 1) 把帧写到显存：card_addr = TX_START * 256 */
     uint16_t card_addr = TX_START * PAGE_SIZE;
@@ -230,7 +245,50 @@ typedef struct {
     uint8_t  len_hi;
 } rx_hdr_t;
 
-/* 处理环缓中的所有数据包 */
+/* 解析以太类型并做最基本处理（ICMP 回显的 echo reply 通知），buf 以 4 字节包头开始 */
+static void net_handle_frame(const uint8_t *buf, uint16_t read_len){
+    if (read_len >= sizeof(rx_hdr_t) + sizeof(eth_header_t)){
+        const uint8_t *frame = buf + sizeof(rx_hdr_t);
+        const eth_header_t *eth = (const eth_header_t*)frame;
+        uint16_t type = ntohs(eth->ethertype);
+
+        if (type == ETH_P_IP){
+            if (read_len >= sizeof(rx_hdr_t) + ETH_HLEN + sizeof(ip_header_t)){
+                const ip_header_t *ip = (const ip_header_t*)(frame + ETH_HLEN);
+                if (ip->protocol == IP_PROTO_ICMP){
+                    if (read_len >= sizeof(rx_hdr_t) + ETH_HLEN + IP_HLEN + sizeof(icmp_header_t)){
+                        const icmp_header_t *icmp = (const icmp_header_t*)(frame + ETH_HLEN + IP_HLEN);
+                        if (icmp->type == 0 /* echo reply */){
+                            ping_received = 1;
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+/* 把中断里收好的帧一批一批取出来处理 */
+static void net_process_rx(void){
+    uint32_t batch[RX_SLOTS];
+    int n;
+    while ((n = fifo_get_bulk(&rx_ready, batch, RX_SLOTS)) > 0){
+        for (int i = 0; i < n; ++i){
+            int slot = batch[i] & 0xFFFF;
+            net_handle_frame(rx_slots[slot], (uint16_t)(batch[i] >> 16));
+            fifo_put(&rx_free, slot);
+        }
+    }
+}
+
+/* 下半部：把中断里收好的帧交给协议处理 */
+static void net_rx_bh(uint32_t data){
+    net_process_rx();
+}
+
+static tasklet_t net_rx_tasklet = TASKLET_INIT(net_rx_bh, 0);
+
+/* 把网卡环缓中的所有数据包搬进 rx_ready，只在中断里（或关着中断）调用，保证只有一个生产者 */
 static void ne2k_rx_drain(void){
     /* 页 1 读取 CURR（硬件当前写入页） */
     set_page(1);
@@ -248,7 +306,7 @@ static void ne2k_rx_drain(void){
         rdm_read(pkt_addr, &hdr, sizeof(hdr));
 
         uint16_t totlen = (uint16_t)hdr.len_lo | ((uint16_t)hdr.len_hi << 8);
-        if (totlen < 60 || totlen > sizeof(rx_buf)){
+        if (totlen < 60 || totlen > RX_FRAME_MAX){
             /* 异常：丢弃并复位接收区 */
             printf("ne2k: bad rx len=%u, reset ring\n", totlen);
             /* 直接把 BNRY 追到 CURR-1，防止卡死 */
@@ -260,41 +318,29 @@ static void ne2k_rx_drain(void){
             break;
         }
 
-        /* 读取整个帧（含 4 字节头）到 rx_buf */
-        uint16_t read_len = (uint16_t)(totlen + sizeof(rx_hdr_t));
-        if (read_len > sizeof(rx_buf)) read_len = sizeof(rx_buf);
-
-        /* 包可能跨越 RX_STOP，需要两段读取 */
-        uint16_t first = (uint16_t)((RX_STOP * PAGE_SIZE) - pkt_addr);
-        if (first > read_len) first = read_len;
-
-        rdm_read(pkt_addr, rx_buf, first);
-        if (first < read_len){
-            /* 剩余从 RX_START 开头接着读 */
-            rdm_read((uint16_t)(RX_START * PAGE_SIZE),
-                     rx_buf + first,
-                     (uint16_t)(read_len - first));
-        }
+        trace_event(TRACE_NET_RX, totlen);
 
-        /* 解析以太类型并做最基本处理（ICMP 回显的 echo reply 通知） */
-        if (read_len >= sizeof(rx_hdr_t) + sizeof(eth_header_t)){
-            const uint8_t *frame = rx_buf + sizeof(rx_hdr_t);
-            const eth_header_t *eth = (const eth_header_t*)frame;
-            uint16_t type = ntohs(eth->ethertype);
-
-            if (type == ETH_P_IP){
-                if (read_len >= sizeof(rx_hdr_t) + ETH_HLEN + sizeof(ip_header_t)){
-                    const ip_header_t *ip = (const ip_header_t*)(frame + ETH_HLEN);
-                    if (ip->protocol == IP_PROTO_ICMP){
-                        if (read_len >= sizeof(rx_hdr_t) + ETH_HLEN + IP_HLEN + sizeof(icmp_header_t)){
-                            const icmp_header_t *icmp = (const icmp_header_t*)(frame + ETH_HLEN + IP_HLEN);
-                            if (icmp->type == 0 /* echo reply */){
-                                ping_received = 1;
-                            }
-                        }
-                    }
-                }
+        /* 读取整个帧（含 4 字节头）到一个空槽，没有空槽就丢掉，只推进 BNRY */
+        int slot = fifo_get(&rx_free);
+        if (slot < 0){
+            rx_dropped++;
+        } else {
+            uint8_t *buf = rx_slots[slot];
+            uint16_t read_len = (uint16_t)(totlen + sizeof(rx_hdr_t));
+            if (read_len > RX_FRAME_MAX) read_len = RX_FRAME_MAX;
+
+            /* 包可能跨越 RX_STOP，需要两段读取 */
+            uint16_t first = (uint16_t)((RX_STOP * PAGE_SIZE) - pkt_addr);
+            if (first > read_len) first = read_len;
+
+            rdm_read(pkt_addr, buf, first);
+            if (first < read_len){
+                /* 剩余从 RX_START 开头接着读 */
+                rdm_read((uint16_t)(RX_START * PAGE_SIZE),
+                         buf + first,
+                         (uint16_t)(read_len - first));
             }
+            fifo_put(&rx_ready, (uint32_t)slot | ((uint32_t)read_len << 16));
         }
 
         /* 推进 BNRY 到本帧的前一页（硬件从 next_page 开始写下一帧） */
@@ -335,6 +381,10 @@ static int ne2k_reset(void){
 }
 
 static int ne2k_init(void){
+    fifo_init(&rx_free, RX_SLOTS, rx_free_buf);
+    fifo_init(&rx_ready, RX_SLOTS, rx_ready_buf);
+    for (int i = 0; i < RX_SLOTS; ++i) fifo_put(&rx_free, i);
+
     /* 停机 + 选择页 0 */
     outb(NIC_IO_BASE + REG_CR, CR_STP);
 
@@ -394,24 +444,20 @@ int init_network(void){
         return 0;
     }
 
-    /* 安装中断门（内核 CS=0x08，属性 0x8E） */
-    idt_set_gate(NIC_IRQ, (uint32_t)net_interrupt_handler, 0x08, 0x8E);
-
-    /* 主 PIC 取消屏蔽对应 IRQ（此处简化：只动主片） */
-    uint8_t imr = inb(0x21);
-    imr &= (uint8_t)~(1 << (NIC_IRQ % 8));
-    outb(0x21, imr);
+    /* 走统一的 IRQ 框架，EOI 也由它发 */
+    register_interrupt_handler(IRQ0 + NIC_IRQ, net_interrupt_handler);
 
     printf("Network ready\n");
     return 1;
 }
 
-void net_interrupt_handler(void){
+void net_interrupt_handler(registers_t *regs){
     uint8_t isr = inb(NIC_IO_BASE + REG_ISR);
 
     if (isr & ISR_PRX){
         ne2k_rx_drain();
         outb(NIC_IO_BASE + REG_ISR, ISR_PRX);
+        tasklet_schedule(&net_rx_tasklet);
     }
     if (isr & ISR_PTX){
         outb(NIC_IO_BASE + REG_ISR, ISR_PTX);
@@ -433,12 +479,20 @@ void net_interrupt_handler(void){
         outb(NIC_IO_BASE + REG_ISR, ISR_RDC);
     }
 
-    /* EOI */
-    outb(0x20, 0x20);
 }
 
-void receive_packet(void){
+/* 中断没来的时候主动去网卡里取；网卡寄存器不能和中断处理同时动，所以关一下中断
+ * 取到的帧和中断里一样交给下半部处理，rx_ready 只有 softirq 任务一个消费者 */
+static void ne2k_poll(void){
+    uint32_t eflags = load_eflags();
+    asm volatile("cli");
     ne2k_rx_drain();
+    store_eflags(eflags);
+    if (fifo_status(&rx_ready)) tasklet_schedule(&net_rx_tasklet);
+}
+
+void receive_packet(void){
+    ne2k_poll();
 }
 
 /* 把 data 作为一个完整以太帧发送 */
@@ -514,9 +568,10 @@ void do_ping_impl(const char *ipstr){
     /* 简单等一下，看是否收到了 Echo Reply（收到则 ping_received=1） */
     ping_received = 0;
     for (int t = 0; t < 1000 && !ping_received; ++t){
-        ne2k_rx_drain();
+        ne2k_poll();
         for (volatile int spin=0; spin<20000; ++spin) { /* small delay */ }
     }
     if (ping_received) printf("echo reply received\n");
     else               printf("timeout (note: -net user drops ICMP)\n");
+    if (rx_dropped) printf("ne2k: %u frames dropped, rx ring full\n", rx_dropped);
 }
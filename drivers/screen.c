@@ -10,6 +10,10 @@
 #define MISC_WRITE 0x3C2
 #define GC_ADDR    0x3CE
 #define GC_DATA    0x3CF
+#define ATTR_ADDR  0x3C0 // 索引和数据都写这个口，靠0x3DA复位的触发器区分
+#define ATTR_READ  0x3C1
+#define INPUT_STATUS 0x3DA
+#define ATTR_PAS   0x20 // 索引里带上这一位，属性控制器才把调色板交还给显示
 
 //切换文本模式为图形vga
 
@@ -99,4 +103,96 @@ void vga_draw_gradient() {
             vga_draw_pixel(x, y, color);
         }
     }
-}
\ No newline at end of file
+}
+
+// 文本模式的字库在显存第2个位面，每个字符占32字节，只用前16字节（8x16）
+// 临时把位面2映射到0xA0000按顺序读出来，再把寄存器改回文本模式的样子
+void vga_read_font(uint8_t *buf) {
+    asm volatile("cli");
+
+    outb(SEQ_ADDR, 0x02); uint8_t seq2 = inb(SEQ_DATA);
+    outb(SEQ_ADDR, 0x04); uint8_t seq4 = inb(SEQ_DATA);
+    outb(GC_ADDR, 0x04);  uint8_t gc4 = inb(GC_DATA);
+    outb(GC_ADDR, 0x05);  uint8_t gc5 = inb(GC_DATA);
+    outb(GC_ADDR, 0x06);  uint8_t gc6 = inb(GC_DATA);
+
+    outb(SEQ_ADDR, 0x02); outb(SEQ_DATA, 0x04);  // 只写位面2
+    outb(SEQ_ADDR, 0x04); outb(SEQ_DATA, 0x07);  // 顺序寻址，关掉奇偶模式
+    outb(GC_ADDR, 0x04);  outb(GC_DATA, 0x02);   // 读位面2
+    outb(GC_ADDR, 0x05);  outb(GC_DATA, 0x00);   // 关掉奇偶模式
+    outb(GC_ADDR, 0x06);  outb(GC_DATA, 0x04);   // 映射到0xA0000~0xAFFFF，图形模式关
+
+    for (int ch = 0; ch < 256; ch++) {
+        for (int row = 0; row < 16; row++) {
+            buf[ch * 16 + row] = VGA_MEMORY[ch * 32 + row];
+        }
+    }
+
+    outb(SEQ_ADDR, 0x02); outb(SEQ_DATA, seq2);
+    outb(SEQ_ADDR, 0x04); outb(SEQ_DATA, seq4);
+    outb(GC_ADDR, 0x04);  outb(GC_DATA, gc4);
+    outb(GC_ADDR, 0x05);  outb(GC_DATA, gc5);
+    outb(GC_ADDR, 0x06);  outb(GC_DATA, gc6);
+
+    asm volatile("sti");
+}
+
+// 属性控制器的索引和数据共用一个口，每次访问前读一下0x3DA让它回到“下一个写的是索引”
+void vga_save_regs(vga_regs_t *regs) {
+    asm volatile("cli");
+    regs->misc = inb(MISC_ADDR);
+    for (uint8_t i = 0; i < sizeof(regs->seq); i++) {
+        outb(SEQ_ADDR, i);
+        regs->seq[i] = inb(SEQ_DATA);
+    }
+    for (uint8_t i = 0; i < sizeof(regs->crtc); i++) {
+        outb(CRT_ADDR, i);
+        regs->crtc[i] = inb(CRT_DATA);
+    }
+    for (uint8_t i = 0; i < sizeof(regs->gc); i++) {
+        outb(GC_ADDR, i);
+        regs->gc[i] = inb(GC_DATA);
+    }
+    for (uint8_t i = 0; i < sizeof(regs->attr); i++) {
+        inb(INPUT_STATUS);
+        outb(ATTR_ADDR, i);
+        regs->attr[i] = inb(ATTR_READ);
+    }
+    inb(INPUT_STATUS);
+    outb(ATTR_ADDR, ATTR_PAS); // 读的时候把显示关了，打开
+    asm volatile("sti");
+}
+
+void vga_restore_regs(const vga_regs_t *regs) {
+    asm volatile("cli");
+    outb(MISC_WRITE, regs->misc);
+    outb(SEQ_ADDR, 0x00); outb(SEQ_DATA, 0x01); // 同步复位，改时钟和存储模式时定序器要停着
+    for (uint8_t i = 1; i < sizeof(regs->seq); i++) {
+        outb(SEQ_ADDR, i);
+        outb(SEQ_DATA, regs->seq[i]);
+    }
+    outb(SEQ_ADDR, 0x00); outb(SEQ_DATA, regs->seq[0]);
+
+    outb(CRT_ADDR, 0x11); // 先解开0~7号的写保护，最后写11号时再按存的值锁上
+    outb(CRT_DATA, regs->crtc[0x11] & 0x7F);
+    for (uint8_t i = 0; i < sizeof(regs->crtc); i++) {
+        if (i == 0x11) continue;
+        outb(CRT_ADDR, i);
+        outb(CRT_DATA, regs->crtc[i]);
+    }
+    outb(CRT_ADDR, 0x11);
+    outb(CRT_DATA, regs->crtc[0x11]);
+
+    for (uint8_t i = 0; i < sizeof(regs->gc); i++) {
+        outb(GC_ADDR, i);
+        outb(GC_DATA, regs->gc[i]);
+    }
+    for (uint8_t i = 0; i < sizeof(regs->attr); i++) {
+        inb(INPUT_STATUS);
+        outb(ATTR_ADDR, i);
+        outb(ATTR_ADDR, regs->attr[i]);
+    }
+    inb(INPUT_STATUS);
+    outb(ATTR_ADDR, ATTR_PAS);
+    asm volatile("sti");
+}
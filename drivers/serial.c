@@ -0,0 +1,42 @@
+#include "drivers/serial.h"
+
+// 16550寄存器，相对于端口基址
+#define UART_DATA 0 // DLAB=0：收发数据；DLAB=1：除数低8位
+#define UART_IER 1 // DLAB=0：中断使能；DLAB=1：除数高8位
+#define UART_FCR 2 // FIFO控制
+#define UART_LCR 3 // 线路控制，最高位是DLAB
+#define UART_MCR 4 // Modem控制
+#define UART_LSR 5 // 线路状态
+#define LSR_THRE 0x20 // 发送保持寄存器空
+
+static int serial_ok = 0;
+
+int serial_init()
+{
+    outb(COM1_PORT + UART_IER, 0x00); // 不用中断，发送时轮询
+    outb(COM1_PORT + UART_LCR, 0x80); // 打开DLAB，设置波特率
+    outb(COM1_PORT + UART_DATA, 0x01); // 115200 / 1 = 115200
+    outb(COM1_PORT + UART_IER, 0x00);
+    outb(COM1_PORT + UART_LCR, 0x03); // 8位数据，无校验，1位停止位
+    outb(COM1_PORT + UART_FCR, 0xC7); // 打开并清空FIFO，14字节触发
+    outb(COM1_PORT + UART_MCR, 0x1E); // 回环模式，先自检
+    outb(COM1_PORT + UART_DATA, 0xAE);
+    if (inb(COM1_PORT + UART_DATA) != 0xAE) return -1; // 读不回来，没有串口
+    outb(COM1_PORT + UART_MCR, 0x0F); // 退出回环，DTR RTS OUT1 OUT2
+    serial_ok = 1;
+    return 0;
+}
+
+void serial_putc(char c)
+{
+    if (!serial_ok) return;
+    if (c == '\n') serial_putc('\r'); // 终端要CRLF
+    int timeout = 100000; // 串口卡住的话不能把整个系统拖死
+    while (!(inb(COM1_PORT + UART_LSR) & LSR_THRE) && --timeout);
+    outb(COM1_PORT + UART_DATA, c);
+}
+
+void serial_write(const char *s)
+{
+    while (*s) serial_putc(*s++);
+}
\ No newline at end of file
@@ -0,0 +1,196 @@
+#include "drivers/vbe.h"
+#include "drivers/screen.h"
+#include "monios/monitor.h"
+
+#define PCI_CONFIG_ADDR 0xCF8
+#define PCI_CONFIG_DATA 0xCFC
+
+#define VGA_SAVE_SIZE (256 * 1024) // 文本模式的字符、属性和字体都在显存最前面的256KB里
+
+static uint32_t *lfb; // 显存
+static uint32_t *back; // 后备缓冲区
+static uint8_t *vga_save; // 切图形模式前的显存，回文本模式时原样放回去，省得重新装字体
+static vga_regs_t vga_regs; // 打开DISPI会改掉定序器、图形控制器、CRTC和属性控制器，回文本模式要写回去
+static int regs_saved = 0;
+static int width, height, pitch; // pitch是显存每行多少个像素
+static int enabled = 0;
+static int dirty_x0, dirty_y0, dirty_x1, dirty_y1; // 脏矩形，左上角含、右下角不含；x1 == 0 表示没有
+
+static void dispi_write(uint16_t index, uint16_t value)
+{
+    outw(VBE_DISPI_IOPORT_INDEX, index);
+    outw(VBE_DISPI_IOPORT_DATA, value);
+}
+
+static uint16_t dispi_read(uint16_t index)
+{
+    outw(VBE_DISPI_IOPORT_INDEX, index);
+    return inw(VBE_DISPI_IOPORT_DATA);
+}
+
+static uint32_t pci_read32(uint8_t bus, uint8_t dev, uint8_t fn, uint8_t off)
+{
+    outl(PCI_CONFIG_ADDR, 0x80000000u | (bus << 16) | (dev << 11) | (fn << 8) | (off & 0xFC));
+    return inl(PCI_CONFIG_DATA);
+}
+
+// QEMU std VGA是1234:1111，VirtualBox是80EE:BEEF，线性显存都在BAR0
+// 扫一遍256条总线不便宜，显卡又不会换地方，找到一次就记下来
+static uint32_t find_lfb()
+{
+    static uint32_t cached = 0;
+    if (cached) return cached;
+    for (int bus = 0; bus < 256; bus++) {
+        for (int dev = 0; dev < 32; dev++) {
+            uint32_t id = pci_read32(bus, dev, 0, 0x00);
+            if ((id & 0xFFFF) == 0xFFFF) continue;
+            if (id == 0x11111234 || id == 0xBEEF80EE) return cached = pci_read32(bus, dev, 0, 0x10) & ~0xF;
+        }
+    }
+    return VBE_DEFAULT_LFB;
+}
+
+static inline void fill32(uint32_t *dst, uint32_t val, int n)
+{
+    asm volatile("rep stosl" : "+D"(dst), "+c"(n) : "a"(val) : "memory");
+}
+
+static inline void copy32(uint32_t *dst, const uint32_t *src, int n)
+{
+    asm volatile("rep movsl" : "+D"(dst), "+S"(src), "+c"(n) : : "memory");
+}
+
+int vbe_init(int w, int h)
+{
+    if (enabled) vbe_disable();
+    uint16_t id = dispi_read(VBE_DISPI_INDEX_ID);
+    if (id < VBE_DISPI_ID0 || id > VBE_DISPI_ID5) return -1; // 不是Bochs VBE
+    if (!back || width * height < w * h) { // 后备缓冲区只增不减
+        if (back) kfree(back);
+        back = (uint32_t *) kmalloc(w * h * sizeof(uint32_t));
+        if (!back) return -1;
+    }
+    if (!vga_save) vga_save = (uint8_t *) kmalloc(VGA_SAVE_SIZE);
+    if (!vga_save) return -1;
+    lfb = (uint32_t *) find_lfb();
+    memcpy(vga_save, lfb, VGA_SAVE_SIZE); // 还没切模式，这里就是文本模式的显存
+    vga_save_regs(&vga_regs);
+    regs_saved = 1;
+    monitor_suspend(1); // 文本控制台别再往0xB8000写了，会写坏画面
+
+    dispi_write(VBE_DISPI_INDEX_ENABLE, 0);
+    dispi_write(VBE_DISPI_INDEX_XRES, w);
+    dispi_write(VBE_DISPI_INDEX_YRES, h);
+    dispi_write(VBE_DISPI_INDEX_BPP, 32);
+    dispi_write(VBE_DISPI_INDEX_ENABLE, VBE_DISPI_ENABLED | VBE_DISPI_LFB_ENABLED | VBE_DISPI_NOCLEARMEM);
+    if (dispi_read(VBE_DISPI_INDEX_XRES) != w || dispi_read(VBE_DISPI_INDEX_YRES) != h) { // 分辨率不支持
+        vbe_disable();
+        return -1;
+    }
+    width = w;
+    height = h;
+    pitch = dispi_read(VBE_DISPI_INDEX_VIRT_WIDTH);
+    if (pitch < w) pitch = w;
+    enabled = 1;
+    vbe_fill_rect(0, 0, w, h, 0); // 清屏，显存里还是文本模式留下的东西
+    vbe_present();
+    return 0;
+}
+
+void vbe_disable()
+{
+    dispi_write(VBE_DISPI_INDEX_ENABLE, 0);
+    if (regs_saved) vga_restore_regs(&vga_regs); // 先回到模式3，0xB8000才重新是文本显存
+    regs_saved = 0;
+    if (enabled && vga_save) memcpy(lfb, vga_save, VGA_SAVE_SIZE); // 字体和文本都放回去
+    enabled = 0;
+    dirty_x1 = 0;
+    monitor_suspend(0); // 文本控制台整屏重画
+}
+
+int vbe_enabled() { return enabled; }
+int vbe_width() { return width; }
+int vbe_height() { return height; }
+uint32_t *vbe_backbuffer() { return back; }
+
+// 把矩形裁到屏幕以内，完全在外面返回0；dx、dy是左上角被裁掉了多少，blit时源数据也要跟着偏
+static int clip(int *x, int *y, int *w, int *h, int *dx, int *dy)
+{
+    *dx = *x < 0 ? -*x : 0;
+    *dy = *y < 0 ? -*y : 0;
+    *x += *dx; *w -= *dx;
+    *y += *dy; *h -= *dy;
+    if (*x + *w > width) *w = width - *x;
+    if (*y + *h > height) *h = height - *y;
+    return *w > 0 && *h > 0;
+}
+
+void vbe_mark_dirty(int x, int y, int w, int h)
+{
+    int dx, dy;
+    if (!clip(&x, &y, &w, &h, &dx, &dy)) return;
+    if (!dirty_x1) { // 之前是干净的
+        dirty_x0 = x; dirty_y0 = y;
+        dirty_x1 = x + w; dirty_y1 = y + h;
+        return;
+    }
+    if (x < dirty_x0) dirty_x0 = x; // 和原来的脏矩形合并成一个包围盒
+    if (y < dirty_y0) dirty_y0 = y;
+    if (x + w > dirty_x1) dirty_x1 = x + w;
+    if (y + h > dirty_y1) dirty_y1 = y + h;
+}
+
+// 只把脏矩形按行拷到显存，显存只写不读
+void vbe_present()
+{
+    if (!enabled || !dirty_x1) return;
+    int n = dirty_x1 - dirty_x0;
+    for (int y = dirty_y0; y < dirty_y1; y++) copy32(lfb + y * pitch + dirty_x0, back + y * width + dirty_x0, n);
+    dirty_x1 = 0;
+}
+
+void vbe_fill_rect(int x, int y, int w, int h, uint32_t color)
+{
+    int dx, dy;
+    if (!enabled || !clip(&x, &y, &w, &h, &dx, &dy)) return;
+    uint32_t *row = back + y * width + x;
+    for (int i = 0; i < h; i++, row += width) fill32(row, color, w);
+    vbe_mark_dirty(x, y, w, h);
+}
+
+void vbe_blit(int x, int y, int w, int h, const uint32_t *src, int src_pitch)
+{
+    int dx, dy;
+    if (!enabled || !clip(&x, &y, &w, &h, &dx, &dy)) return;
+    src += dy * src_pitch + dx;
+    uint32_t *row = back + y * width + x;
+    for (int i = 0; i < h; i++, row += width, src += src_pitch) copy32(row, src, w);
+    vbe_mark_dirty(x, y, w, h);
+}
+
+// 红和蓝隔着8位，可以放在一个32位乘法里一起算，绿单独算，一个像素两次乘法
+// alpha先从0~255映射到0~256，这样除以255就变成了右移8位
+static inline uint32_t blend(uint32_t s, uint32_t d)
+{
+    uint32_t a = s >> 24;
+    a += a >> 7;
+    uint32_t rb = ((s & 0xFF00FF) * a + (d & 0xFF00FF) * (256 - a)) >> 8;
+    uint32_t g = ((s & 0x00FF00) * a + (d & 0x00FF00) * (256 - a)) >> 8;
+    return (rb & 0xFF00FF) | (g & 0x00FF00);
+}
+
+void vbe_blit_alpha(int x, int y, int w, int h, const uint32_t *src, int src_pitch)
+{
+    int dx, dy;
+    if (!enabled || !clip(&x, &y, &w, &h, &dx, &dy)) return;
+    src += dy * src_pitch + dx;
+    uint32_t *row = back + y * width + x;
+    for (int i = 0; i < h; i++, row += width, src += src_pitch) {
+        for (int j = 0; j < w; j++) {
+            uint32_t s = src[j];
+            if (s >> 24 == 0xFF) row[j] = s & 0xFFFFFF; // 不透明和全透明的像素很多，不用算
+            else if (s >> 24) row[j] = blend(s, row[j]);
+        }
+    }
+    vbe_mark_dirty(x, y, w, h);
+}
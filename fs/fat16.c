@@ -1,7 +1,8 @@
 #include "monios/fs/hd.h"
 #include "drivers/memory.h"
-#include "monios/fs/file.h"
+#include "monios/fs/fat16.h"
 #include "drivers/cmos.h"
+#include "monios/fs/journal.h"
 
 // 格式化文件系统
 int fat16_format_hd()
@@ -107,7 +108,7 @@ int lfn2sfn(const char *lfn, char *sfn)
 fileinfo_t *read_dir_entries(int *dir_ents)
 {
     fileinfo_t *root_dir = (fileinfo_t *) kmalloc(ROOT_DIR_SECTORS * SECTOR_SIZE);
-    hd_read(ROOT_DIR_START_LBA, ROOT_DIR_SECTORS, root_dir); // 将根目录的所有扇区全部读入
+    meta_read(ROOT_DIR_START_LBA, ROOT_DIR_SECTORS, root_dir); // 将根目录的所有扇区全部读入
     int i;
     for (i = 0; i < MAX_FILE_NUM; i++) {
         if (root_dir[i].name[0] == 0) break; // 如果名字的第一个字节是0，那就说明这里没有文件
@@ -117,7 +118,7 @@ fileinfo_t *read_dir_entries(int *dir_ents)
 }
 
 // 创建文件
-int fat16_create_file(fileinfo_t *finfo, char *filename)
+static int create_file(fileinfo_t *finfo, char *filename)
 {
     if (filename[0] == 0xe5) filename[0] = 0x05; // 如上，若第一个字节为 0xe5，需要更换为 0x05
     char sfn[20] = {0};
@@ -153,13 +154,21 @@ int fat16_create_file(fileinfo_t *finfo, char *filename)
     root_dir[free_slot].date = ((ctime.year - 1980) << 9) | (ctime.month << 5) | ctime.day;
     root_dir[free_slot].time = (ctime.hour << 11) | (ctime.min << 5) | ctime.sec;
     if (finfo) *finfo = root_dir[free_slot]; // 创建完了不能不管，传给finfo留着
-    hd_write(ROOT_DIR_START_LBA, ROOT_DIR_SECTORS, root_dir); // 将新的根目录区写回硬盘
+    meta_write(ROOT_DIR_START_LBA, ROOT_DIR_SECTORS, root_dir); // 将新的根目录区写回硬盘，只有改过的扇区会真正写下去
     kfree(root_dir); // 成功完成
     return 0;
 }
 
+int fat16_create_file(fileinfo_t *finfo, char *filename)
+{
+    journal_begin(); // 一次操作的所有元数据改动作为一个事务
+    int ret = create_file(finfo, filename);
+    journal_end();
+    return ret;
+}
+
 // 打开文件
-int fat16_open_file(fileinfo_t *finfo, char *filename)
+static int open_file(fileinfo_t *finfo, char *filename)
 {
     char sfn[20] = {0};
     int ret = lfn2sfn(filename, sfn); // 将原文件名转换为8.3
@@ -185,6 +194,14 @@ int fat16_open_file(fileinfo_t *finfo, char *filename)
     }
 }
 
+int fat16_open_file(fileinfo_t *finfo, char *filename)
+{
+    journal_begin(); // 不改东西，只是要和正在进行的事务错开
+    int ret = open_file(finfo, filename);
+    journal_end();
+    return ret;
+}
+
 // 获取第n个FAT项
 static uint16_t get_nth_fat(uint16_t n)
 {
@@ -193,7 +210,7 @@ static uint16_t get_nth_fat(uint16_t n)
     uint32_t fat_offset = n * 2; // FAT项在FAT表内的偏移，FAT16一个FAT是16位，即2个字节，所以乘2
     uint32_t fat_sect = fat_start + (fat_offset / 512); // 该FAT项对应的扇区编号
     uint32_t sect_offset = fat_offset % 512; // 该FAT项在扇区内的偏移
-    hd_read(fat_sect, 1, fat); // 读取对应的一个扇区到FAT内（由于*2，FAT项必然不跨扇区）
+    meta_read(fat_sect, 1, fat); // 读取对应的一个扇区到FAT内（由于*2，FAT项必然不跨扇区），事务里会命中缓存
     uint16_t table_val = *(uint16_t *) &fat[sect_offset]; // 从FAT表中找到对应的FAT项
     kfree(fat); // 临时FAT表就用不上了
     return table_val; // 返回对应的FAT项
@@ -203,16 +220,13 @@ static uint16_t get_nth_fat(uint16_t n)
 static void set_nth_fat(uint16_t n, uint16_t val)
 {
     int fat_start = FAT1_START_LBA; // FAT1起始扇区
-    int second_fat_start = FAT1_START_LBA + FAT1_SECTORS; // FAT2起始扇区
     uint8_t *fat = (uint8_t *) kmalloc(512); // 临时FAT表
     uint32_t fat_offset = n * 2; // FAT项在FAT表内的偏移
     uint32_t fat_sect = fat_start + (fat_offset / 512); // FAT项在FAT1中对应的扇区号
-    uint32_t second_fat_sect = second_fat_start + (fat_offset / 512); // FAT项在FAT2中对应的扇区号
     uint32_t sect_offset = fat_offset % 512; // FAT项在扇区内的偏移
-    hd_read(fat_sect, 1, fat); // 读入到临时FAT表
+    meta_read(fat_sect, 1, fat); // 读入到临时FAT表
     *(uint16_t *) &fat[sect_offset] = val; // 直接设置对应的FAT项即可，FAT16没有那么多弯弯绕
-    hd_write(fat_sect, 1, fat); // 写入FAT1
-    hd_write(second_fat_sect, 1, fat); // 写入FAT2
+    meta_write(fat_sect, 1, fat); // 写入FAT1，FAT2由meta_write一并更新；事务里同一扇区改多少次都只在提交时写一次
     kfree(fat); // 释放临时FAT表
 }
 
@@ -229,7 +243,7 @@ static void write_nth_clust(uint16_t n, const void *clust)
 }
 
 // 读取文件，当然要有素质地一次读整个文件啦
-int fat16_read_file(fileinfo_t *finfo, void *buf)
+static int read_file(fileinfo_t *finfo, void *buf)
 {
     uint16_t clustno = finfo->clustno; // finfo中记录的第一个簇号
     char *clust = (char *) kmalloc(512); // 单独给簇分配一个缓冲区，直接往buf里写也行
@@ -244,8 +258,16 @@ int fat16_read_file(fileinfo_t *finfo, void *buf)
     return 0; // 返回
 }
 
+int fat16_read_file(fileinfo_t *finfo, void *buf)
+{
+    journal_begin(); // 不改东西，只是借事务的缓存让每个FAT扇区只读一次
+    int ret = read_file(finfo, buf);
+    journal_end();
+    return ret;
+}
+
 // 删除文件
-int fat16_delete_file(char *filename) // 什么？为什么不传finfo？删除一个已经打开的文件，听上去很别扭不是吗（虽然在Linux下这很正常）
+static int delete_file(char *filename) // 什么？为什么不传finfo？删除一个已经打开的文件，听上去很别扭不是吗（虽然在Linux下这很正常）
 {
     char sfn[20] = {0};
     int ret = lfn2sfn(filename, sfn); // 将文件名转换为8.3文件名
@@ -264,12 +286,12 @@ int fat16_delete_file(char *filename) // 什么？为什么不传finfo？删除
         return -1;
     }
     root_dir[file_ind].name[0] = 0xe5; // 标记为已删除
-    hd_write(ROOT_DIR_START_LBA, ROOT_DIR_SECTORS, root_dir); // 更新根目录区数据
-    kfree(root_dir); // 释放临时缓冲区
-    if (root_dir[file_ind].clustno == 0) {
+    meta_write(ROOT_DIR_START_LBA, ROOT_DIR_SECTORS, root_dir); // 更新根目录区数据
+    unsigned short clustno = root_dir[file_ind].clustno, next_clustno; // 开始清理文件所占有的簇
+    kfree(root_dir); // 释放临时缓冲区，簇号已经取出来了
+    if (clustno == 0) {
         return 0; // 内容空空，那就到这里就可以了
     }
-    unsigned short clustno = root_dir[file_ind].clustno, next_clustno; // 开始清理文件所占有的簇
     while (1) {
         next_clustno = get_nth_fat(clustno); // 找到这个文件下一个簇的簇号
         set_nth_fat(clustno, 0); // 把下一个簇的簇号设为0，这样就找不到下一个簇了
@@ -279,11 +301,20 @@ int fat16_delete_file(char *filename) // 什么？为什么不传finfo？删除
     return 0; // 删除完成
 }
 
+int fat16_delete_file(char *filename)
+{
+    journal_begin();
+    int ret = delete_file(filename);
+    journal_end();
+    return ret;
+}
+
 // 写入文件，为简单起见相当于覆盖了
-int fat16_write_file(fileinfo_t *finfo, const void *buf, uint32_t size)
+static int write_file(fileinfo_t *finfo, const void *buf, uint32_t size)
 {
     uint16_t clustno = finfo->clustno, next_clustno; // 从已有首簇号开始
-    if (finfo->size == 0 && finfo->clustno == 0) { // 没有首簇号
+    int write_sects = (size + 511) / 512; // 确认要写入的扇区总数，这里向上舍入
+    if (write_sects && finfo->clustno == 0) { // 有内容要写，但还没有首簇号
         clustno = 2; // 从第2个簇开始分配
         while (1) {
             if (get_nth_fat(clustno) == 0) { // 当前簇空闲
@@ -294,12 +325,17 @@ int fat16_write_file(fileinfo_t *finfo, const void *buf, uint32_t size)
         }
     }
     finfo->size = size; // 更新大小
-    int write_sects = (size + 511) / 512; // 确认要写入的扇区总数，这里向上舍入
+    if (!write_sects) finfo->clustno = 0; // 写成了空文件，clustno还是旧链的首簇，写的循环不执行，下面从首簇开始整条释放
+    next_clustno = clustno;
     while (write_sects) { // 只要还要写
         write_nth_clust(clustno, buf); // 将当前buf的512字节写入对应簇中
         write_sects--; // 要写入扇区总数-1
         buf += 512; // buf后移一个扇区
         next_clustno = get_nth_fat(clustno); // 寻找下一个簇
+        if (!write_sects) { // 这是最后一个簇
+            set_nth_fat(clustno, 0xffff); // 在这里结束簇链，否则fsck会认为链断在了空闲簇上
+            break; // next_clustno是旧链剩下的部分，下面释放
+        }
         if (next_clustno == 0 || next_clustno >= 0xfff8) {
             // 当前簇不可用
             next_clustno = clustno + 1; // 从下一个簇开始
@@ -312,6 +348,11 @@ int fat16_write_file(fileinfo_t *finfo, const void *buf, uint32_t size)
         }
         clustno = next_clustno; // 将下一个簇看做当前簇
     }
+    while (next_clustno >= 2 && next_clustno < 0xfff8) { // 文件变短了，旧链多出来的簇还给空闲
+        clustno = next_clustno;
+        next_clustno = get_nth_fat(clustno);
+        set_nth_fat(clustno, 0);
+    }
     // 最后修改一下文件属性
     current_time_t ctime;
     get_current_time(&ctime); // 获取当前日期
@@ -326,11 +367,20 @@ int fat16_write_file(fileinfo_t *finfo, const void *buf, uint32_t size)
             break;
         }
     }
-    hd_write(ROOT_DIR_START_LBA, ROOT_DIR_SECTORS, root_dir); // 同步到硬盘
+    meta_write(ROOT_DIR_START_LBA, ROOT_DIR_SECTORS, root_dir); // 同步到硬盘
     kfree(root_dir);
     return 0;
 }
 
+// 数据簇直接写，FAT和根目录在最后一起提交，所以元数据落盘时数据已经在盘上了
+int fat16_write_file(fileinfo_t *finfo, const void *buf, uint32_t size)
+{
+    journal_begin();
+    int ret = write_file(finfo, buf, size);
+    journal_end();
+    return ret;
+}
+
 // 打开目录
 int fat16_open_dir(fileinfo_t *finfo, const char *path) {
     // 如果是根目录
@@ -0,0 +1,120 @@
+#include "monios/common.h"
+#include "monios/fs/hd.h"
+#include "monios/fs/fat16.h"
+#include "monios/fs/journal.h"
+#include "drivers/memory.h"
+#include "fsck.h"
+
+// FAT16一致性检查
+// 第一遍按大块顺序读完整个FAT（顺带与FAT2比对），记下每个簇有没有前驱；
+// 第二遍顺着根目录里每个文件的簇链走，把簇记到所有者表里，撞上已有主人的就是交叉链接；
+// 最后扫一遍所有者表，FAT说已用却没有主人的就是丢失的簇。每个簇只看常数次，时间与卷大小成正比，
+// 内存只有FAT本身加每簇2字节的所有者表和1位的前驱位图。第一遍各个区间互不相关，可以分开并行做
+
+#define FSCK_RUN_SECTORS 8 // 一次顺序读多少个扇区
+
+#define BITMAP_SET(map, n) ((map)[(n) >> 3] |= 1 << ((n) & 7))
+#define BITMAP_TEST(map, n) ((map)[(n) >> 3] & (1 << ((n) & 7)))
+
+int fat16_fsck(fsck_report_t *report, int repair)
+{
+    memset(report, 0, sizeof(fsck_report_t));
+    uint32_t nclust = FAT1_SECTORS * SECTOR_SIZE / 2; // FAT能描述的簇数
+    int disk_clust = get_hd_sects() - SECTOR_CLUSTER_BALANCE; // 硬盘实际放得下的簇数
+    if (disk_clust < (int) nclust) nclust = disk_clust;
+    if ((int) nclust <= 2) return -1; // 硬盘上根本没有数据区
+    report->clusters = nclust - 2; // 0号和1号簇是保留的
+    uint16_t *fat = (uint16_t *) kmalloc(FAT1_SECTORS * SECTOR_SIZE);
+    uint8_t *run = (uint8_t *) kmalloc(FSCK_RUN_SECTORS * SECTOR_SIZE);
+    uint8_t *pred = (uint8_t *) kmalloc((nclust + 7) / 8); // kmalloc出来就是全0
+    uint16_t *owner = (uint16_t *) kmalloc(nclust * sizeof(uint16_t)); // 目录项下标+1，0表示没有主人
+    fileinfo_t *root_dir = (fileinfo_t *) kmalloc(ROOT_DIR_SECTORS * SECTOR_SIZE);
+    uint8_t fat_dirty[FAT1_SECTORS] = {0}; // 修复时改过的FAT扇区
+    int ret = -1;
+    if (!fat || !run || !pred || !owner || !root_dir) goto out;
+    journal_begin(); // 修复的内容作为一个事务提交
+    // 第一遍：顺序读FAT
+    for (int s = 0; s < FAT1_SECTORS; s += FSCK_RUN_SECTORS) {
+        meta_read(FAT1_START_LBA + s, FSCK_RUN_SECTORS, (uint8_t *) fat + s * SECTOR_SIZE);
+        hd_read(FAT1_START_LBA + FAT1_SECTORS + s, FSCK_RUN_SECTORS, run); // 对应的FAT2
+        for (int k = 0; k < FSCK_RUN_SECTORS; k++) {
+            uint8_t *fat1_sect = (uint8_t *) fat + (s + k) * SECTOR_SIZE;
+            if (memcmp(fat1_sect, run + k * SECTOR_SIZE, SECTOR_SIZE)) {
+                report->fat_mismatches++;
+                if (repair) {
+                    hd_write(FAT1_START_LBA + FAT1_SECTORS + s + k, 1, fat1_sect); // 内核只读FAT1，以它为准
+                    report->repaired++;
+                }
+            }
+        }
+    }
+    for (uint32_t c = 2; c < nclust; c++) {
+        uint16_t next = fat[c];
+        if (next) report->used++;
+        if (next >= 2 && next < nclust) BITMAP_SET(pred, next); // next有前驱了
+    }
+    // 第二遍：顺着每个文件的簇链走
+    meta_read(ROOT_DIR_START_LBA, ROOT_DIR_SECTORS, root_dir);
+    for (int i = 0; i < MAX_FILE_NUM; i++) {
+        if (root_dir[i].name[0] == 0) break; // 后面没有文件了
+        if (root_dir[i].name[0] == 0xe5) continue; // 已删除
+        if (root_dir[i].type & 0x08) continue; // 卷标，没有簇
+        report->files++;
+        if (root_dir[i].clustno == 0 && root_dir[i].size == 0) continue; // 空文件
+        uint32_t expect = (root_dir[i].size + SECTOR_SIZE - 1) / SECTOR_SIZE, len = 0;
+        uint16_t c = root_dir[i].clustno;
+        int broken = 0;
+        while (1) {
+            if (c < 2 || c >= nclust) { // 越界
+                report->bad_chains++;
+                broken = 1;
+                break;
+            }
+            if (owner[c]) {
+                if (owner[c] == i + 1) report->bad_chains++; // 绕回自己了，是个环
+                else report->cross_links++; // 别的文件也在用
+                broken = 1;
+                break;
+            }
+            owner[c] = i + 1;
+            len++;
+            uint16_t next = fat[c];
+            if (next >= 0xfff8) break; // 正常结束
+            if (next == 0 || next == 0xfff7) { // 链断在空闲簇或坏簇上
+                report->bad_chains++;
+                broken = 1;
+                break;
+            }
+            c = next;
+        }
+        if (!broken && len != expect) report->size_mismatches++;
+    }
+    // 最后：已用却没有主人的簇
+    for (uint32_t c = 2; c < nclust; c++) {
+        if (!fat[c] || fat[c] == 0xfff7 || owner[c]) continue;
+        report->lost_clusters++;
+        if (!BITMAP_TEST(pred, c)) report->lost_chains++; // 没有前驱，是一条链的开头
+        if (repair) {
+            fat[c] = 0; // 还给空闲
+            fat_dirty[c * 2 / SECTOR_SIZE] = 1;
+            report->repaired++;
+        }
+    }
+    for (int s = 0; s < FAT1_SECTORS; s++) {
+        if (fat_dirty[s]) meta_write(FAT1_START_LBA + s, 1, (uint8_t *) fat + s * SECTOR_SIZE);
+    }
+    journal_end();
+    ret = report->lost_clusters + report->cross_links + report->bad_chains + report->size_mismatches + report->fat_mismatches;
+out:
+    if (fat) kfree(fat);
+    if (run) kfree(run);
+    if (pred) kfree(pred);
+    if (owner) kfree(owner);
+    if (root_dir) kfree(root_dir);
+    return ret;
+}
+
+int sys_fsck(fsck_report_t *report, int repair)
+{
+    return fat16_fsck(report, repair);
+}
@@ -1,11 +1,42 @@
 #include "monios/fs/file.h"
+#include "monios/fs/fat16.h"
 #include "drivers/mtask.h"
 #include "drivers/memory.h"
 #include "drivers/fifo.h" // 加在开头
+#include "monios/monitor.h"
+#include "mman.h"
+#include "uio.h"
+#include "syscall.h"
 
-extern fifo_t decoded_key; // 加在开头
+
+extern uint32_t load_eflags();
+extern void store_eflags(uint32_t);
+extern taskctl_t *taskctl;
 
 static file_t file_table[MAX_FILE_NUM];
+static task_t *volatile fs_owner = NULL;
+static int fs_depth = 0;
+
+void fs_lock()
+{
+    if (!taskctl) return; // 任务系统起来之前只有一个执行流
+    task_t *cur = task_now();
+    uint32_t eflags = load_eflags();
+    asm("cli"); // 看锁和占锁之间不能被切走
+    while (fs_owner && fs_owner != cur) {
+        task_switch(); // 让拿着锁的任务先跑完
+        kernel_relax(); // 它可能在别的CPU上，得让它进得了内核
+    }
+    fs_owner = cur;
+    fs_depth++;
+    store_eflags(eflags);
+}
+
+void fs_unlock()
+{
+    if (!taskctl) return;
+    if (--fs_depth == 0) fs_owner = NULL;
+}
 
 static int install_to_global(fileinfo_t finfo)
 {
@@ -20,6 +51,7 @@ static int install_to_global(fileinfo_t finfo)
     file_table[i].handle = safer_finfo; // 这就是其内部的handle
     file_table[i].type = FT_REGULAR; // 类型为正常文件
     file_table[i].pos = 0; // 由于刚刚注册，pos设为0
+    file_table[i].open_cnt = 0; // 上一个用这个位置的文件留下的引用数不能算
     return i; // 返回其在文件表内的索引
 }
 
@@ -35,7 +67,67 @@ static int install_to_local(int global_fd)
     return i; // 返回索引，这就是对应的文件描述符了
 }
 
-int sys_open(char *filename, uint32_t flags)
+// 获取task中fd对应的文件，不是被打开的文件返回NULL
+file_t *task_fd2file(task_t *task, int fd)
+{
+    if (fd < 3 || fd >= MAX_FILE_OPEN_PER_TASK) return NULL; // 0 1 2是标准输入输出，不在文件表里
+    int global_fd = task->fd_table[fd]; // 获取文件表中索引
+    if (global_fd == -1) return NULL; // 这个fd没有打开
+    return &file_table[global_fd];
+}
+
+static file_t *fd2file(int fd)
+{
+    return task_fd2file(task_now(), fd);
+}
+
+// 从文件缓冲区的pos处读出最多count个字节，不移动读写指针
+int file_read_at(task_t *task, file_t *cfile, void *buf, int count, int pos)
+{
+    if (count <= 0 || pos < 0 || pos >= cfile->size) return 0; // 已经到达末尾
+    if (count > cfile->size - pos) count = cfile->size - pos; // 最多读到文件末尾
+    memcpy(buf, (char *) cfile->buffer + pos, count); // 整块拷贝
+    task->stats.read_bytes += count;
+    return count;
+}
+
+// 把len个字节写到文件缓冲区的pos处，不移动读写指针，也不同步到硬盘
+int file_write_at(task_t *task, file_t *cfile, const void *msg, int len, int pos)
+{
+    if (len < 0 || pos < 0) return -1;
+    if (pos + len > cfile->size) { // 超出了原本的范围
+        void *new_buffer = krealloc(cfile->buffer, pos + len + 5); // 一次扩容到位
+        if (!new_buffer) return -1; // 扩容失败
+        cfile->buffer = new_buffer; // 这里就是新的缓冲区
+        if (pos > cfile->size) memset((char *) cfile->buffer + cfile->size, 0, pos - cfile->size); // 跳过的部分填0
+        cfile->size = pos + len; // 更新大小
+    }
+    memcpy((char *) cfile->buffer + pos, msg, len); // 向pos处写入内容
+    task->stats.write_bytes += len;
+    return len;
+}
+
+// 把文件缓冲区整个写回硬盘
+int file_sync(task_t *task, file_t *cfile)
+{
+    task->stats.syncs++;
+    return fat16_write_file(cfile->handle, cfile->buffer, cfile->size);
+}
+
+void file_get(file_t *cfile)
+{
+    cfile->open_cnt++;
+}
+
+void file_put(file_t *cfile)
+{
+    if (--cfile->open_cnt > 0) return; // 还有人在用
+    kfree(cfile->buffer); // 释放缓冲区
+    kfree(cfile->handle); // install_to_global中使用kmalloc分配fileinfo指针
+    cfile->type = FT_USABLE; // 设置type为可用
+}
+
+static int do_open(char *filename, uint32_t flags)
 {
     fileinfo_t finfo; // 准备接收打开的文件
     if (flags & O_CREAT) { // flags中含有O_CREAT，则需要创建文件
@@ -46,7 +138,7 @@ int sys_open(char *filename, uint32_t flags)
         if (status == -1) return status; // 打开失败则直接不管
     }
     int global_fd = install_to_global(finfo); // 先安装到全局文件表
-    file_table[global_fd].open_cnt++; // open个数+1，没什么用
+    file_get(&file_table[global_fd]); // fd本身算一个引用
     file_table[global_fd].size = finfo.size; // 设置文件大小
     file_table[global_fd].flags = flags | (~O_CREAT); // flags中剔除O_CREAT
     file_table[global_fd].buffer = kmalloc(finfo.size + 5); // 分配一个缓冲区
@@ -61,6 +153,14 @@ int sys_open(char *filename, uint32_t flags)
     return install_to_local(global_fd); // 最后安装到任务里
 }
 
+int sys_open(char *filename, uint32_t flags)
+{
+    fs_lock();
+    int ret = do_open(filename, flags);
+    fs_unlock();
+    return ret;
+}
+
 int sys_write(int fd, const void *msg, int len)
 {
     if (fd <= 0) return -1; // 是无效fd，返回
@@ -71,24 +171,18 @@ int sys_write(int fd, const void *msg, int len)
         kfree(temp_buf);
         return len;
     }
-    task_t *task = task_now(); // 获取当前任务
-    int global_fd = task->fd_table[fd]; // 获取文件表中索引
-    file_t *cfile = &file_table[global_fd]; // 获取文件表中的文件指针
-    if (cfile->flags == O_RDONLY) return -1; // 只读，不可写，返回
-    for (int i = 0; i < len; i++) { // 对于每一个字节
-        if (cfile->pos >= cfile->size) { // 如果超出了原本的范围
-            cfile->size++; // 大小+1
-            void *new_buffer = krealloc(cfile->buffer, cfile->size); // 使用krealloc扩容，增长缓冲区大小
-            if (new_buffer) cfile->buffer = new_buffer; // 如果缓冲区分配成功，那么这里就是新的缓冲区
+    fs_lock();
+    int ret = -1;
+    file_t *cfile = fd2file(fd); // 获取文件表中的文件指针
+    if (cfile && cfile->flags != O_RDONLY) { // 是被打开的文件，而且不是只读
+        ret = file_write_at(task_now(), cfile, msg, len, cfile->pos); // 写进缓冲区
+        if (ret != -1) { // 扩容成功
+            cfile->pos += ret; // 文件指针后移
+            ret = file_sync(task_now(), cfile) == -1 ? -1 : len; // 写入完毕，立刻更新到硬盘，成功就返回实际写入的长度len
         }
-        char *buf = (char *) cfile->buffer; // 文件的缓冲区，相当于文件的当前内容了
-        char *content = (char *) msg; // 要写入的内容
-        buf[cfile->pos] = content[i]; // 向读写指针处写入当前内容
-        cfile->pos++; // 文件指针后移
     }
-    int status = fat16_write_file(cfile->handle, cfile->buffer, cfile->size); // 写入完毕，立刻更新到硬盘
-    if (status == -1) return status; // 写入失败，返回
-    return len; // 否则，返回实际写入的长度len
+    fs_unlock();
+    return ret;
 }
 
 int sys_read(int fd, void *buf, int count)
@@ -98,28 +192,23 @@ int sys_read(int fd, void *buf, int count)
     if (fd == 0) { // 如果是标准输入
         char *buffer = (char *) buf; // 先转成char *
         uint32_t bytes_read = 0; // 读了多少个
+        fifo_t *keys = console_keys(console_current()); // 只读自己所在控制台的键盘输入
         while (bytes_read < count) { // 没达到count个
-            while (fifo_status(&decoded_key) == 0); // 只要没有新的键我就不读进来
-            *buffer = fifo_get(&decoded_key); // 获取新的键
+            while (fifo_status(keys) == 0) kernel_relax(); // 只要没有新的键我就不读进来；键盘中断在BSP上，要让它能进内核
+            *buffer = fifo_get(keys); // 获取新的键
             bytes_read++;
             buffer++; // buffer指向下一个
         }
         ret = (bytes_read == 0 ? -1 : (int) bytes_read); // 如果啥也没读着就-1，否则就正常返回就行了
         return ret;
     }
-    task_t *task = task_now(); // 获取当前任务
-    int global_fd = task->fd_table[fd]; // 获取fd对应的文件表索引
-    file_t *cfile = &file_table[global_fd]; // 获取文件表中对应文件
-    if (cfile->flags == O_WRONLY) return -1; // 只写，不可读，返回-1
-    ret = 0; // 记录到底读了多少个字节
-    for (int i = 0; i < count; i++) {
-        if (cfile->pos >= cfile->size) break; // 如果已经到达末尾，返回
-        char *filebuf = (char *) cfile->buffer; // 文件缓冲区
-        char *retbuf = (char *) buf; // 接收缓冲区
-        retbuf[i] = filebuf[cfile->pos]; // 逐字节拷贝内容
-        cfile->pos++; // 读写指针后移
-        ret++; // 读取字节数+1
+    fs_lock();
+    file_t *cfile = fd2file(fd); // 获取文件表中对应文件
+    if (cfile && cfile->flags != O_WRONLY) { // 是被打开的文件，而且不是只写
+        ret = file_read_at(task_now(), cfile, buf, count, cfile->pos); // 从读写指针处读
+        cfile->pos += ret; // 读写指针后移
     }
+    fs_unlock();
     return ret; // 返回读取字节数
 }
 
@@ -130,16 +219,15 @@ int sys_close(int fd)
         task_t *task = task_now(); // 获取当前任务
         uint32_t global_fd = task->fd_table[fd]; // 获取对应文件表索引
         task->fd_table[fd] = -1; // 释放文件描述符
-        file_t *cfile = &file_table[global_fd]; // 获取对应文件
-        kfree(cfile->buffer); // 释放缓冲区
-        kfree(cfile->handle); // install_to_global中使用kmalloc分配fileinfo指针
-        cfile->type = FT_USABLE; // 设置type为可用
+        fs_lock();
+        file_put(&file_table[global_fd]); // aio还在用的话等它用完再释放
+        fs_unlock();
         return 0; // 关闭完成
     }
     return ret; // 否则返回-1
 }
 
-int sys_lseek(int fd, int offset, uint8_t whence)
+static int do_lseek(int fd, int offset, uint8_t whence)
 {
     if (fd < 3) return -1; // 不是被打开的文件，返回
     if (whence < 1 || whence > 3) return -1; // whence只能为123，分别对应SET、CUR、END，返回
@@ -164,7 +252,162 @@ int sys_lseek(int fd, int offset, uint8_t whence)
     return new_pos; // 返回新位置
 }
 
+int sys_lseek(int fd, int offset, uint8_t whence)
+{
+    fs_lock(); // aio可能正在推进同一个文件的读写指针
+    int ret = do_lseek(fd, offset, whence);
+    fs_unlock();
+    return ret;
+}
+
 int sys_unlink(const char *filename)
 {
-    return fat16_delete_file((char *) filename); // 直接套皮，不多说
-}
\ No newline at end of file
+    fs_lock();
+    int ret = fat16_delete_file((char *) filename); // 直接套皮，不多说
+    fs_unlock();
+    return ret;
+}
+
+// 把已打开文件的缓存直接映射进应用程序的数据段
+// 没有分页，所以做不到真正共享页面：映射区从program break后面划出来，由文件缓存一次性拷入
+// 比起open+read的逐字节拷贝只剩一次memcpy，返回值同sbrk一样是相对数据段的地址
+static void *do_mmap(void *addr, uint32_t length, int prot, int flags, int fd, int offset)
+{
+    task_t *task = task_now(); // 获取当前任务
+    if (!task->is_user) return MAP_FAILED; // 映射区在数据段里，只有应用程序才有
+    if (!length || offset < 0) return MAP_FAILED; // 长度为0或偏移非法
+    if (fd < 3 || fd >= MAX_FILE_OPEN_PER_TASK || task->fd_table[fd] == -1) return MAP_FAILED; // 不是被打开的文件
+    if ((flags & (MAP_SHARED | MAP_PRIVATE)) == 0 || (flags & (MAP_SHARED | MAP_PRIVATE)) == (MAP_SHARED | MAP_PRIVATE)) return MAP_FAILED; // 二者必须选且只选一个
+    if ((flags & MAP_SHARED) && (prot & PROT_WRITE)) return MAP_FAILED; // 共享映射写不回文件，只允许只读
+    file_t *cfile = &file_table[task->fd_table[fd]]; // 获取fd对应的文件
+    if (cfile->flags == O_WRONLY) return MAP_FAILED; // 只写的文件不能映射
+    if (offset > cfile->size) return MAP_FAILED; // 偏移超出文件
+    int slot;
+    for (slot = 0; slot < MAX_MMAP_PER_TASK; slot++) {
+        if (task->mmaps[slot].addr == NULL) break; // 找一个空闲的映射记录
+    }
+    if (slot == MAX_MMAP_PER_TASK) return MAP_FAILED; // 映射数量到达上限
+    uint32_t area_len = (length + 15) & ~15; // 按16字节对齐，与malloc的块头对齐方式一致
+    void *area = sys_sbrk(area_len); // sbrk可能会搬动数据段，所以ds_base要在这之后再取
+    if (!area || area == (void *) -1) return MAP_FAILED; // 数据段扩不了
+    char *dst = (char *) task->ds_base + (int) area; // 映射区的绝对地址
+    uint32_t avail = cfile->size - offset; // 文件在offset之后还剩多少
+    uint32_t copy_len = length < avail ? length : avail;
+    memcpy(dst, (char *) cfile->buffer + offset, copy_len); // 整块拷入
+    memset(dst + copy_len, 0, area_len - copy_len); // 超出文件末尾的部分填0
+    task->mmaps[slot].addr = area;
+    task->mmaps[slot].length = area_len;
+    task->mmaps[slot].prot = prot;
+    task->mmaps[slot].flags = flags;
+    return area; // 返回相对地址
+}
+
+void *sys_mmap(void *addr, uint32_t length, int prot, int flags, int fd, int offset)
+{
+    fs_lock(); // aio写文件时会换掉文件缓存
+    void *ret = do_mmap(addr, length, prot, flags, fd, offset);
+    fs_unlock();
+    return ret;
+}
+
+int sys_munmap(void *addr, uint32_t length)
+{
+    task_t *task = task_now(); // 获取当前任务
+    if (!task->is_user) return -1;
+    int slot;
+    for (slot = 0; slot < MAX_MMAP_PER_TASK; slot++) {
+        if (task->mmaps[slot].addr == addr && addr != NULL) break; // 只能按mmap返回的起始地址解除映射
+    }
+    if (slot == MAX_MMAP_PER_TASK) return -1; // 没有这个映射
+    uint32_t area_len = task->mmaps[slot].length;
+    if (((length + 15) & ~15) != area_len) return -1; // 不支持只解除一部分
+    task->mmaps[slot].addr = NULL; // 释放映射记录
+    if ((char *) addr + area_len == (char *) task->brk_start) { // 正好在堆顶，可以直接还回去
+        sys_sbrk(-(int) area_len);
+    }
+    // 否则这块内存要等到进程退出时随数据段一起释放
+    return 0;
+}
+
+int sys_pread(int fd, void *buf, int count, int offset)
+{
+    int ret = -1;
+    fs_lock();
+    file_t *cfile = fd2file(fd); // 标准输入没有偏移的概念，不支持
+    if (cfile && offset >= 0 && cfile->flags != O_WRONLY) ret = file_read_at(task_now(), cfile, buf, count, offset); // 不动读写指针；只写的不可读
+    fs_unlock();
+    return ret;
+}
+
+int sys_pwrite(int fd, const void *msg, int len, int offset)
+{
+    int ret = -1;
+    fs_lock();
+    file_t *cfile = fd2file(fd);
+    if (cfile && offset >= 0 && cfile->flags != O_RDONLY) { // 只读，不可写
+        ret = file_write_at(task_now(), cfile, msg, len, offset); // 不动读写指针
+        if (ret != -1 && file_sync(task_now(), cfile) == -1) ret = -1; // 同步到硬盘
+    }
+    fs_unlock();
+    return ret;
+}
+
+// iov中的iov_base已经是内核可以直接访问的地址
+int sys_readv(int fd, const iovec_t *iov, int iovcnt)
+{
+    if (iovcnt < 0 || iovcnt > IOV_MAX) return -1;
+    if (fd == 0) { // 标准输入，逐个缓冲区填满
+        int total = 0;
+        for (int i = 0; i < iovcnt; i++) {
+            if (!iov[i].iov_len) continue;
+            int ret = sys_read(0, iov[i].iov_base, iov[i].iov_len);
+            if (ret == -1) return total ? total : -1;
+            total += ret;
+        }
+        return total;
+    }
+    fs_lock();
+    file_t *cfile = fd2file(fd);
+    if (!cfile || cfile->flags == O_WRONLY) { // 不是被打开的文件，或者只写，不可读
+        fs_unlock();
+        return -1;
+    }
+    int total = 0; // 一共读了多少
+    for (int i = 0; i < iovcnt; i++) {
+        int ret = file_read_at(task_now(), cfile, iov[i].iov_base, iov[i].iov_len, cfile->pos);
+        cfile->pos += ret; // 读写指针后移
+        total += ret;
+        if (ret < (int) iov[i].iov_len) break; // 到达文件末尾，后面的缓冲区不用看了
+    }
+    fs_unlock();
+    return total;
+}
+
+int sys_writev(int fd, const iovec_t *iov, int iovcnt)
+{
+    if (iovcnt < 0 || iovcnt > IOV_MAX) return -1;
+    int total = 0; // 一共要写多少
+    for (int i = 0; i < iovcnt; i++) total += iov[i].iov_len;
+    if (fd == 1 || fd == 2) { // 标准输出，先拼成一整段再一次性输出
+        char *temp_buf = (char *) kmalloc(total + 5);
+        if (!temp_buf) return -1;
+        char *p = temp_buf;
+        for (int i = 0; i < iovcnt; i++) {
+            memcpy(p, iov[i].iov_base, iov[i].iov_len);
+            p += iov[i].iov_len;
+        }
+        monitor_write(temp_buf);
+        kfree(temp_buf);
+        return total;
+    }
+    fs_lock();
+    file_t *cfile = fd2file(fd);
+    int ret = cfile && cfile->flags != O_RDONLY ? total : -1; // 只读，不可写
+    for (int i = 0; ret != -1 && i < iovcnt; i++) {
+        if (file_write_at(task_now(), cfile, iov[i].iov_base, iov[i].iov_len, cfile->pos) == -1) ret = -1;
+        else cfile->pos += iov[i].iov_len; // 文件指针后移
+    }
+    if (ret != -1 && file_sync(task_now(), cfile) == -1) ret = -1; // 所有缓冲区写完只同步一次硬盘
+    fs_unlock();
+    return ret;
+}
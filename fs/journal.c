@@ -0,0 +1,218 @@
+#include "monios/common.h"
+#include "monios/fs/hd.h"
+#include "monios/fs/journal.h"
+#include "monios/fs/file.h"
+#include "monios/monitor.h"
+
+// FAT16元数据日志
+// 一次文件操作里对FAT和根目录的所有改动先攒在内存里（同一个扇区改多少次都只算一次），
+// 结束时按 描述块 -> 数据块 -> 提交块 的顺序连续写进日志区，再写回FAT1/FAT2/根目录，最后把日志标记为干净
+// 中途断电的话，开机时提交块完整就重放一遍，不完整就当这次操作没发生过，FAT和根目录始终是某次操作前后的样子
+
+typedef struct TXN_BLOCK {
+    uint32_t lba; // 对应的元数据扇区
+    int dirty; // 0表示只是读进来的缓存
+} txn_block_t;
+
+static int journal_usable = 0; // 硬盘是否大到放得下日志区
+static int journal_on = 1; // 是否写日志，关掉之后仍然合并写入，只是不再防断电
+static int txn_depth = 0; // 事务嵌套层数，最外层结束时才提交
+static uint32_t txn_seq = 0;
+static int txn_count = 0;
+static txn_block_t txn_blocks[JOURNAL_MAX_BLOCKS];
+static uint8_t txn_data[JOURNAL_MAX_BLOCKS][SECTOR_SIZE];
+static uint8_t sect_buf[SECTOR_SIZE]; // 写描述块和提交块用
+
+static int is_fat1_sect(uint32_t lba)
+{
+    return lba >= FAT1_START_LBA && lba < FAT1_START_LBA + FAT1_SECTORS;
+}
+
+// 把一个元数据扇区写到它最终的位置，FAT1的扇区同时写一份到FAT2
+static void meta_write_through(uint32_t lba, const void *buf)
+{
+    hd_write(lba, 1, (void *) buf);
+    if (is_fat1_sect(lba)) hd_write(lba + FAT1_SECTORS, 1, (void *) buf);
+}
+
+static uint32_t journal_checksum(uint32_t sum, const void *buf)
+{
+    const uint32_t *p = (const uint32_t *) buf;
+    for (int i = 0; i < SECTOR_SIZE / 4; i++) {
+        sum = ((sum << 1) | (sum >> 31)) ^ p[i]; // 循环左移再异或，块的顺序换了也能发现
+    }
+    return sum;
+}
+
+static void journal_write_desc(uint32_t seq, uint32_t nblocks, const uint32_t *lba)
+{
+    journal_desc_t *desc = (journal_desc_t *) sect_buf;
+    memset(sect_buf, 0, SECTOR_SIZE);
+    desc->magic = JOURNAL_DESC_MAGIC;
+    desc->seq = seq;
+    desc->nblocks = nblocks;
+    if (nblocks) memcpy(desc->lba, lba, nblocks * sizeof(uint32_t));
+    hd_write(JOURNAL_START_LBA, 1, sect_buf);
+}
+
+// 在缓存里找lba对应的块，找不到返回-1
+static int txn_find(uint32_t lba)
+{
+    for (int i = 0; i < txn_count; i++) {
+        if (txn_blocks[i].lba == lba) return i;
+    }
+    return -1;
+}
+
+// 把所有改过的块写进日志再写回原处
+static int txn_commit()
+{
+    uint32_t lba[JOURNAL_MAX_BLOCKS];
+    int idx[JOURNAL_MAX_BLOCKS];
+    int n = 0;
+    for (int i = 0; i < txn_count; i++) {
+        if (txn_blocks[i].dirty) {
+            lba[n] = txn_blocks[i].lba;
+            idx[n++] = i;
+        }
+    }
+    if (!n) return 0; // 只读了没改，什么都不用写
+    int logged = journal_usable && journal_on;
+    if (logged) {
+        uint32_t seq = ++txn_seq;
+        uint32_t sum = 0;
+        journal_write_desc(seq, n, lba); // 描述块
+        for (int i = 0; i < n; i++) {
+            hd_write(JOURNAL_START_LBA + 1 + i, 1, txn_data[idx[i]]); // 数据块连续写
+            sum = journal_checksum(sum, txn_data[idx[i]]);
+        }
+        journal_commit_t *commit = (journal_commit_t *) sect_buf;
+        memset(sect_buf, 0, SECTOR_SIZE);
+        commit->magic = JOURNAL_COMMIT_MAGIC;
+        commit->seq = seq;
+        commit->checksum = sum;
+        hd_write(JOURNAL_START_LBA + 1 + n, 1, sect_buf); // 提交块写完，这个事务就算落盘了
+    }
+    for (int i = 0; i < n; i++) {
+        meta_write_through(lba[i], txn_data[idx[i]]); // 写回原处
+        txn_blocks[idx[i]].dirty = 0;
+    }
+    if (logged) journal_write_desc(txn_seq, 0, NULL); // 写回完成，日志可以丢掉了
+    return 0;
+}
+
+// 给lba腾一个缓存块，满了就先把已有的改动提交掉
+static int txn_alloc(uint32_t lba)
+{
+    if (txn_count == JOURNAL_MAX_BLOCKS) {
+        txn_commit(); // 提交之后全是干净块，直接清空
+        txn_count = 0;
+    }
+    txn_blocks[txn_count].lba = lba;
+    txn_blocks[txn_count].dirty = 0;
+    return txn_count++;
+}
+
+// 事务期间拿着文件系统锁：txn_blocks和FAT、根目录一样，一次只能有一个任务在改
+void journal_begin()
+{
+    fs_lock();
+    txn_depth++;
+}
+
+int journal_end()
+{
+    if (txn_depth == 0) return -1; // 没有begin过
+    int ret = 0;
+    if (--txn_depth == 0) { // 外面还有一层的话，等它结束再提交
+        ret = txn_commit();
+        txn_count = 0; // 事务之间不保留缓存，别人可能绕过这里直接改了硬盘
+    }
+    fs_unlock();
+    return ret;
+}
+
+// 读元数据扇区，事务里改过的以缓存为准
+void meta_read(uint32_t lba, int sec_cnt, void *buf)
+{
+    if (!txn_depth) {
+        hd_read(lba, sec_cnt, buf);
+        return;
+    }
+    int miss = 0;
+    for (int i = 0; i < sec_cnt; i++) {
+        if (txn_find(lba + i) == -1) miss = 1;
+    }
+    if (miss) hd_read(lba, sec_cnt, buf); // 有没缓存的就整段读一次，比一个个读快
+    for (int i = 0; i < sec_cnt; i++) {
+        uint8_t *p = (uint8_t *) buf + i * SECTOR_SIZE;
+        int slot = txn_find(lba + i);
+        if (slot != -1) memcpy(p, txn_data[slot], SECTOR_SIZE); // 缓存里的更新
+        else {
+            slot = txn_alloc(lba + i);
+            memcpy(txn_data[slot], p, SECTOR_SIZE); // 记下来，后面再读就不用进硬盘了
+        }
+    }
+}
+
+// 写元数据扇区，事务里只改缓存，内容没变的扇区不会被写
+void meta_write(uint32_t lba, int sec_cnt, const void *buf)
+{
+    for (int i = 0; i < sec_cnt; i++) {
+        const uint8_t *p = (const uint8_t *) buf + i * SECTOR_SIZE;
+        if (!txn_depth) {
+            meta_write_through(lba + i, p);
+            continue;
+        }
+        int slot = txn_find(lba + i);
+        if (slot != -1 && !memcmp(txn_data[slot], p, SECTOR_SIZE)) continue; // 一模一样，不用写
+        if (slot == -1) slot = txn_alloc(lba + i);
+        memcpy(txn_data[slot], p, SECTOR_SIZE);
+        txn_blocks[slot].dirty = 1;
+    }
+}
+
+void journal_set_enabled(int enabled)
+{
+    journal_on = enabled;
+}
+
+int journal_enabled()
+{
+    return journal_usable && journal_on;
+}
+
+// 开机时调用，把上次没写回完的事务重放一遍
+void journal_init()
+{
+    journal_usable = get_hd_sects() >= JOURNAL_START_LBA + JOURNAL_SECTORS;
+    if (!journal_usable) return; // 硬盘太小，放不下日志区
+    journal_desc_t desc;
+    hd_read(JOURNAL_START_LBA, 1, sect_buf);
+    memcpy(&desc, sect_buf, sizeof(journal_desc_t));
+    if (desc.magic != JOURNAL_DESC_MAGIC) { // 第一次用，初始化日志区
+        journal_write_desc(0, 0, NULL);
+        return;
+    }
+    txn_seq = desc.seq;
+    if (desc.nblocks == 0) return; // 干净的
+    if (desc.nblocks > JOURNAL_MAX_BLOCKS) { // 描述块坏了，没法重放
+        journal_write_desc(txn_seq, 0, NULL);
+        return;
+    }
+    journal_commit_t commit;
+    hd_read(JOURNAL_START_LBA + 1 + desc.nblocks, 1, sect_buf);
+    memcpy(&commit, sect_buf, sizeof(journal_commit_t));
+    uint32_t sum = 0;
+    for (int i = 0; i < desc.nblocks; i++) {
+        hd_read(JOURNAL_START_LBA + 1 + i, 1, txn_data[i]);
+        sum = journal_checksum(sum, txn_data[i]);
+    }
+    if (commit.magic == JOURNAL_COMMIT_MAGIC && commit.seq == desc.seq && commit.checksum == sum) {
+        for (int i = 0; i < desc.nblocks; i++) meta_write_through(desc.lba[i], txn_data[i]); // 重放
+        monitor_printf("journal: replayed transaction %d (%d blocks)\n", desc.seq, desc.nblocks);
+    } else {
+        monitor_printf("journal: discarded incomplete transaction %d\n", desc.seq); // 提交块没写完，原处也就一个字都没动过
+    }
+    journal_write_desc(txn_seq, 0, NULL);
+}
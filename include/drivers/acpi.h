@@ -204,10 +204,44 @@ typedef struct {
     u64 hypervisorVendorIdentity; // 虚拟机厂商标识
 } ACPIFadt;
 
+// RSDP，ACPI 1.0的20字节部分
+typedef struct {
+    char signature[8];   // "RSD PTR "
+    u8  checksum;        // 前20字节校验和
+    u8  oemId[6];
+    u8  revision;
+    u32 rsdt;            // RSDT物理地址
+} __attribute__((packed)) ACPIRsdp;
+
+// MADT里用得上的东西，parseApic填
+#define ACPI_MAX_CPUS 16
+typedef struct {
+    u32 lapicAddress;      // 0表示没找到MADT
+    u32 ioapicAddress;     // 0表示没有I/O APIC
+    u32 ioapicGsiBase;
+    int cpuCount;
+    u8  cpuApicIds[ACPI_MAX_CPUS]; // 第0个是MADT里的第一个处理器，一般就是BSP
+    u32 isaGsi[16];        // ISA的IRQ接在I/O APIC的哪个引脚上，没有覆盖记录时就是IRQ号本身
+    u16 isaFlags[16];      // 覆盖记录里的极性和触发方式，0表示ISA默认的高电平边沿触发
+} ACPIMadtInfo;
+
+#define MADT_POLARITY_MASK 0x03
+#define MADT_POLARITY_LOW  0x03
+#define MADT_TRIGGER_MASK  0x0C
+#define MADT_TRIGGER_LEVEL 0x0C
+
 // ACPI全局变量
 extern const ACPIFadt *acpiFadt;
 extern const ACPIHeader *acpiDsdt;
 extern const ACPIHeader *acpiSsdt;
+extern ACPIMadtInfo acpiMadt;
+
+int acpiInit(void); // 找RSDP，把RSDT里的表过一遍，只记录不切ACPI模式，找不到ACPI返回-1
+int acpiEnable(const void *fadt, const void *ssdt); // 切到ACPI模式，关机前才调
+void acpiDump(void); // 打印所有ACPI表和MADT记录
+void parseApic(ACPIHeaderApic *apic);
+void parseHpet(ACPIHeaderHpet *hpet); // 只打印
+void *pa2va(unsigned long physAddr);
 
 // ACPI寄存器状态标志
 #define SCI_ENABLED  0x0001  // ACPI使能标志位
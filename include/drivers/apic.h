@@ -0,0 +1,63 @@
+#ifndef _APIC_H_
+#define _APIC_H_
+
+#include "monios/common.h"
+
+// 本地APIC（每个CPU一个，0xFEE00000）和I/O APIC（0xFEC00000）都是MMIO，没开分页，直接按物理地址访问
+// 有MADT和I/O APIC就用它们代替8259：IRQ按MADT的覆盖记录接到I/O APIC引脚上，向量号和PIC时一样是IRQ0+n
+// 时钟改用LAPIC定时器，IRQ0的引脚（PIT）关掉
+
+#define LAPIC_ID        0x020
+#define LAPIC_VERSION   0x030
+#define LAPIC_TPR       0x080
+#define LAPIC_EOI       0x0B0
+#define LAPIC_SVR       0x0F0
+#define LAPIC_ESR       0x280
+#define LAPIC_ICR_LOW   0x300
+#define LAPIC_ICR_HIGH  0x310
+#define LAPIC_LVT_TIMER 0x320
+#define LAPIC_LVT_LINT0 0x350
+#define LAPIC_LVT_LINT1 0x360
+#define LAPIC_LVT_ERROR 0x370
+#define LAPIC_TIMER_INIT  0x380
+#define LAPIC_TIMER_COUNT 0x390
+#define LAPIC_TIMER_DIV   0x3E0
+
+#define LAPIC_SVR_ENABLE   0x100
+#define LAPIC_LVT_MASKED   0x10000
+#define LAPIC_TIMER_PERIODIC 0x20000
+#define LAPIC_SPURIOUS_VECTOR 0xFF
+
+#define APIC_ICR_INIT    0x500
+#define APIC_ICR_STARTUP 0x600 // 低8位是起始页号，AP从那一页的实模式代码开始跑
+#define APIC_ICR_PENDING 0x1000
+#define APIC_ICR_ASSERT  0x4000
+#define APIC_ICR_LEVEL   0x8000
+
+#define IOAPIC_REGSEL  0x00
+#define IOAPIC_WIN     0x10
+#define IOAPIC_VER     0x01
+#define IOAPIC_REDTBL  0x10 // 第n个引脚的重定向表项是0x10+2n（低32位）和0x11+2n（高32位）
+
+#define IOAPIC_ACTIVE_LOW 0x2000
+#define IOAPIC_LEVEL      0x8000
+#define IOAPIC_MASKED     0x10000
+
+int apic_init(); // 成功返回0；没有APIC或没有MADT返回-1，继续用8259
+void apic_ap_init(); // AP上调，设置它自己的LAPIC
+int apic_enabled();
+void apic_eoi(); // 一次MMIO写
+uint32_t lapic_read(uint32_t reg);
+void lapic_write(uint32_t reg, uint32_t value);
+uint8_t lapic_id();
+
+// irq是ISA的IRQ号，0是LAPIC定时器
+void apic_mask_irq(int irq);
+void apic_unmask_irq(int irq);
+
+uint32_t apic_timer_start(uint32_t freq); // 周期性触发IRQ0，返回实际频率
+uint32_t apic_timer_hz(); // LAPIC定时器的输入频率（已经除过分频）
+void apic_send_ipi(uint8_t apic_id, uint32_t icr);
+void apic_delay_us(uint32_t us); // 用PIT通道2忙等，不依赖中断
+
+#endif
@@ -3,16 +3,24 @@
 
 #include "monios/common.h"
 
+// 单生产者单消费者的环形队列：head只有生产者写，tail只有消费者写，两边都不用关中断
+// 不止一个生产者的话（比如控制台的键盘队列），生产者之间要自己互斥，比如都关着中断放
+// head和tail一直往上加，用的时候和mask与一下；容量必须是2的幂，这样溢出回绕也不会算错
 typedef struct FIFO {
     uint32_t *buf;
-    int p, q, size, free, flags;
+    uint32_t mask; // 容量-1
+    volatile uint32_t head; // 下一个放进来的数据写到哪
+    volatile uint32_t tail; // 下一个从哪里取
+    volatile int flags; // 只有生产者写
 } fifo_t;
 
 #define FIFO_FLAGS_OVERRUN 1
 
-void fifo_init(fifo_t *fifo, int size, uint32_t *buf);
-int fifo_put(fifo_t *fifo, uint32_t data);
-int fifo_get(fifo_t *fifo);
-int fifo_status(fifo_t *fifo);
+void fifo_init(fifo_t *fifo, int size, uint32_t *buf); // size不是2的幂就往下取整
+int fifo_put(fifo_t *fifo, uint32_t data); // 满了返回-1
+int fifo_get(fifo_t *fifo); // 空了返回-1
+int fifo_get_bulk(fifo_t *fifo, uint32_t *out, int n); // 一次最多取n个，返回取到了几个
+int fifo_status(fifo_t *fifo); // 里面有几个
+int fifo_space(fifo_t *fifo); // 还能放几个
 
-#endif
\ No newline at end of file
+#endif
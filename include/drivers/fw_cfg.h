@@ -0,0 +1,15 @@
+#ifndef _FW_CFG_H_
+#define _FW_CFG_H_
+
+#include "monios/common.h"
+
+// QEMU的fw_cfg接口，用来拿启动参数：qemu ... -fw_cfg name=opt/monios/autorun,file=xxx
+#define FW_CFG_PORT_SEL 0x510
+#define FW_CFG_PORT_DATA 0x511
+#define FW_CFG_SIGNATURE 0x0000
+#define FW_CFG_FILE_DIR 0x0019
+
+// 把名为name的fw_cfg文件读进buf，最多size字节，返回读到的字节数；不在QEMU里或没有这个文件返回-1
+int fw_cfg_read_file(const char *name, void *buf, int size);
+
+#endif
@@ -27,7 +27,40 @@ typedef struct registers {
 #define IRQ14 46
 #define IRQ15 47
 
+#define NR_IRQS 16
+#define MAX_IRQ_ACTIONS 32 // 所有中断号加起来最多挂这么多个处理程序
+
 typedef void (*isr_t)(registers_t *);
+// 同一个中断号可以挂多个处理程序（共享的IRQ线），按注册顺序全部调用一遍；同一个函数重复注册只算一次
 void register_interrupt_handler(uint8_t n, isr_t handler);
+void irq_need_resched(); // 处理程序里要切换任务时调用，等最外层的IRQ处理完再切，不在嵌套的中断里切
+
+// 每条IRQ线的统计，cycles只算自己的处理程序，不含嵌套进来的更高优先级中断
+typedef struct IRQ_STAT {
+    uint32_t count;
+    uint32_t nested; // 有几次是打断了别的IRQ进来的
+    uint64_t cycles;
+    uint32_t max_cycles;
+    int handlers; // 挂了几个处理程序
+} irq_stat_t;
+
+void irq_get_stat(int irq, irq_stat_t *st);
+uint32_t irq_spurious(); // IRQ7/IRQ15上的假中断次数
+uint64_t irq_stat_start(); // 统计从哪个时间戳开始
+void irq_reset_stats();
+
+// 下半部：中断处理程序只做读端口、拷数据这些必须马上做的事，其余的挂一个tasklet，
+// 由softirq内核任务在EOI之后开着中断慢慢做，不会挡住别的中断
+typedef struct TASKLET {
+    void (*func)(uint32_t data);
+    uint32_t data;
+    volatile int pending; // 已经挂上还没开始执行
+    struct TASKLET *next;
+} tasklet_t;
+
+#define TASKLET_INIT(func, data) {func, data, 0, NULL}
+
+void tasklet_schedule(tasklet_t *t); // 中断里、任务里都能调；还没执行的不会重复挂，执行期间再挂会再执行一次
+void softirq_init(); // task_init之后调用，之前挂上的tasklet等softirq任务起来以后再执行
 
 #endif
\ No newline at end of file
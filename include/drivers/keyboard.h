@@ -5,6 +5,7 @@ void init_keyboard();
 
 #define NR_SCAN_CODES 0x80
 #define MAP_COLS      3
+#define KB_FIFO_SIZE  128 // 扫描码缓冲，必须是2的幂
 
 #define FLAG_BREAK    0x0080
 #define FLAG_EXT      0x0100
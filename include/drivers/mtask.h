@@ -3,6 +3,9 @@
 
 #include "stdbool.h"
 #include "drivers/gdtidt.h"
+#include "taskstat.h"
+#include "monios/spinlock.h"
+#include "monios/smp.h"
 
 #define TASK_RUNNING    0
 #define TASK_READY     1
@@ -25,6 +28,22 @@ typedef struct exit_retval {
 } exit_retval_t;
 
 #define MAX_FILE_OPEN_PER_TASK 32
+#define MAX_MMAP_PER_TASK 16
+
+typedef struct MMAP_AREA {
+    void *addr; // 相对于数据段的地址，NULL表示空闲
+    uint32_t length;
+    int prot, flags;
+} mmap_area_t;
+
+// 记账用的计数器，只增不减，taskstat把它们交给用户
+typedef struct TASK_STATS {
+    uint32_t ticks, switches, syscalls;
+    uint64_t read_bytes, write_bytes;
+    uint32_t syncs;
+    uint32_t mem_peak;
+    uint32_t start;
+} task_stats_t;
 
 typedef struct TASK {
     uint32_t pid;
@@ -41,15 +60,31 @@ typedef struct TASK {
     int ds_base;
     bool is_user;
     void *brk_start, *brk_end; // here
+    mmap_area_t mmaps[MAX_MMAP_PER_TASK];
+    void *uring; // io_uring_setup注册的队列，相对于数据段的地址，NULL表示没有
+    uint32_t uring_entries; // 注册时检查过的队列长度，应用程序随时能改ring里的entries，内核只信这一份
+    char name[TASK_NAME_LEN]; // 给ps看的名字
+    int console; // 输出到哪个虚拟控制台，从父任务继承
+    task_stats_t stats;
+    void *entry; // create_kernel_task给的入口，先经过task_bootstrap再跳过去
+    int cpu; // 在哪个CPU的运行队列里，正在跑的话就是跑在哪个CPU上
+    volatile int on_cpu; // 正在某个CPU上跑，或者刚被切走、现场还没存完，这时谁都不能切进去
     tss32_t tss;
 } task_t;
 
 #define MAX_TASKS 1000
 #define TASK_GDT0 3
 
-typedef struct TASKCTL {
-    int running, now;
+// 每个CPU一个运行队列，在里面轮转；自己的队列空了就去最长的队列里偷一个应用程序
+typedef struct RUNQUEUE {
+    spinlock_t lock;
+    int running, now; // now是当前任务在tasks里的下标
     task_t *tasks[MAX_TASKS];
+} runqueue_t;
+
+typedef struct TASKCTL {
+    volatile int running; // 所有运行队列里的任务总数
+    runqueue_t rq[MAX_CPUS];
     task_t tasks0[MAX_TASKS];
 } taskctl_t;
 
@@ -63,5 +98,9 @@ void task_exit(int value);
 int task_wait(int pid);
 void task_free(task_t *task);
 void task_start(task_t *task);
+void task_remove(task_t *task);
+void task_sleep(task_t *task);
+void task_wakeup(task_t *task);
+void task_set_name(task_t *task, const char *name);
 
 #endif
\ No newline at end of file
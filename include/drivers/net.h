@@ -1,6 +1,7 @@
 #ifndef MONIOS_NET_H
 #define MONIOS_NET_H
 
+#include "drivers/isr.h"
 #include <stdint.h>
 #include <stddef.h>
 
@@ -54,7 +55,7 @@ typedef struct {
 int  init_network(void);
 void send_packet(const void *data, size_t len);
 void receive_packet(void);       /* 轮询接收（可选） */
-void net_interrupt_handler(void);
+void net_interrupt_handler(registers_t *regs);
 void do_ping_impl(const char *ipstr);
 
 #endif
@@ -31,11 +31,23 @@ typedef enum {
     VGA_WHITE     = 0xFF
 } VGA_Color;
 
+// 切到别的模式之前存下来的VGA寄存器，回来时原样写回
+typedef struct VGA_REGS {
+    uint8_t misc;
+    uint8_t seq[5];
+    uint8_t crtc[25];
+    uint8_t gc[9];
+    uint8_t attr[21];
+} vga_regs_t;
+
 // 函数声明
 void vga_set_mode_13h();
 void vga_clear_screen(uint8_t color);
 void vga_draw_pixel(int x, int y, uint8_t color);
 void vga_draw_rect(int x, int y, int width, int height, uint8_t color);
 void vga_draw_gradient();
+void vga_read_font(uint8_t *buf); // 读出文本模式的8x16字库，256个字符共4KB
+void vga_save_regs(vga_regs_t *regs);
+void vga_restore_regs(const vga_regs_t *regs); // 先写回寄存器，显存里的字库和文字要在这之后再放回去
 
 #endif // VGA_H
\ No newline at end of file
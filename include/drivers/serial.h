@@ -0,0 +1,13 @@
+#ifndef _SERIAL_H_
+#define _SERIAL_H_
+
+#include "monios/common.h"
+
+#define COM1_PORT 0x3F8
+
+// 16550串口，控制台的输出会同时抄一份到COM1，无界面运行时靠它看输出
+int serial_init(); // 没有串口返回-1，之后的输出直接丢掉
+void serial_putc(char c);
+void serial_write(const char *s);
+
+#endif
\ No newline at end of file
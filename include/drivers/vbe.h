@@ -0,0 +1,44 @@
+#ifndef _VBE_H_
+#define _VBE_H_
+
+#include "monios/common.h"
+
+// Bochs/QEMU的VBE扩展（DISPI），通过0x1CE/0x1CF两个端口设置分辨率，显存线性映射在PCI BAR0
+#define VBE_DISPI_IOPORT_INDEX 0x1CE
+#define VBE_DISPI_IOPORT_DATA  0x1CF
+
+#define VBE_DISPI_INDEX_ID          0
+#define VBE_DISPI_INDEX_XRES        1
+#define VBE_DISPI_INDEX_YRES        2
+#define VBE_DISPI_INDEX_BPP         3
+#define VBE_DISPI_INDEX_ENABLE      4
+#define VBE_DISPI_INDEX_VIRT_WIDTH  6
+#define VBE_DISPI_INDEX_VIRT_HEIGHT 7
+
+#define VBE_DISPI_ID0         0xB0C0
+#define VBE_DISPI_ID5         0xB0C5
+#define VBE_DISPI_ENABLED     0x01
+#define VBE_DISPI_LFB_ENABLED 0x40
+#define VBE_DISPI_NOCLEARMEM  0x80
+
+#define VBE_DEFAULT_LFB 0xE0000000 // 找不到PCI设备时Bochs的默认地址
+
+// 颜色都是0xAARRGGBB，alpha只在vbe_blit_alpha里有意义
+#define VBE_RGB(r, g, b) (((r) << 16) | ((g) << 8) | (b))
+
+// 所有绘图都画在内存里的后备缓冲区上，并记下脏矩形；vbe_present只把脏矩形拷到显存
+int vbe_init(int width, int height); // 切到width*height*32位，成功返回0，没有VBE返回-1
+void vbe_disable(); // 回到文本模式
+int vbe_enabled();
+int vbe_width();
+int vbe_height();
+uint32_t *vbe_backbuffer(); // 每行vbe_width()个像素
+
+void vbe_mark_dirty(int x, int y, int w, int h); // 直接改后备缓冲区之后要自己标脏
+void vbe_present();
+
+void vbe_fill_rect(int x, int y, int w, int h, uint32_t color);
+void vbe_blit(int x, int y, int w, int h, const uint32_t *src, int src_pitch); // src_pitch以像素计
+void vbe_blit_alpha(int x, int y, int w, int h, const uint32_t *src, int src_pitch); // 按src的alpha混合
+
+#endif
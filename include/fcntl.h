@@ -0,0 +1,10 @@
+#ifndef _FCNTL_H_
+#define _FCNTL_H_
+
+// open的flags，给应用程序用，数值与内核的oflags_t一致
+#define O_RDONLY 0
+#define O_WRONLY 1
+#define O_RDWR 2
+#define O_CREAT 4
+
+#endif
\ No newline at end of file
@@ -0,0 +1,21 @@
+#ifndef _FORMAT_H_
+#define _FORMAT_H_
+
+#include "stdint.h"
+#include "stdarg.h"
+
+// printf家族共用的格式化核心，结果写进sink的缓冲区
+// flush为NULL时写满就截断（但仍然统计总长度），否则写满时调用flush把缓冲区交出去
+typedef struct FORMAT_SINK {
+    char *buf;
+    int size; // 缓冲区大小，最后1个字节留给\0
+    int len; // 缓冲区里已有多少字节，flush负责把它清零（或留下没处理完的尾巴）
+    int total; // 一共产生了多少字节，包括被截断的
+    void (*flush)(struct FORMAT_SINK *sink, int final); // final为1表示格式化结束，必须全部交出去
+    void *data; // 给flush用，比如FILE *
+} format_sink_t;
+
+// 支持 %[-+ #0][width|*][.precision|*][hh|h|l|ll|z|j]{d i u x X o p c s %}
+int format(format_sink_t *sink, const char *fmt, va_list ap);
+
+#endif
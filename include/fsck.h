@@ -0,0 +1,22 @@
+#ifndef _FSCK_H_
+#define _FSCK_H_
+
+#include "stdint.h"
+
+typedef struct FSCK_REPORT {
+    uint32_t clusters; // 卷上可用于存数据的簇数
+    uint32_t used; // FAT里标记为已用的簇数
+    uint32_t files; // 检查过的文件数
+    uint32_t lost_clusters; // 已用但不属于任何文件的簇
+    uint32_t lost_chains; // 上面这些簇组成了多少条链
+    uint32_t cross_links; // 被两个文件同时占用的簇
+    uint32_t bad_chains; // 链中途走到空闲簇、坏簇、越界簇，或者绕成了环
+    uint32_t size_mismatches; // 簇链长度与目录项里的大小对不上
+    uint32_t fat_mismatches; // FAT1与FAT2不一致的扇区数
+    uint32_t repaired; // 修复了多少处
+} fsck_report_t;
+
+// 返回发现的问题数，repair不为0时释放丢失的簇并以FAT1为准同步FAT2
+int fsck(fsck_report_t *report, int repair);
+
+#endif
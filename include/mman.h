@@ -0,0 +1,21 @@
+#ifndef _MMAN_H_
+#define _MMAN_H_
+
+#include "stdint.h"
+
+// mmap的保护标志
+#define PROT_NONE  0x0
+#define PROT_READ  0x1
+#define PROT_WRITE 0x2
+#define PROT_EXEC  0x4
+
+// mmap的映射类型
+#define MAP_SHARED  0x01 // 与文件缓存共享，目前只允许只读
+#define MAP_PRIVATE 0x02 // 私有写时复制，写入不会回到文件
+
+#define MAP_FAILED ((void *) -1)
+
+void *mmap(void *addr, uint32_t length, int prot, int flags, int fd, int offset);
+int munmap(void *addr, uint32_t length);
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef _FBCON_H_
+#define _FBCON_H_
+
+#include "monios/common.h"
+
+// 帧缓冲文本控制台：monitor.c的影子缓冲区不变，flush时改由这里用8x16点阵字体画到VBE的后备缓冲区
+// 每个格子记着上次画的是什么，只画变了的格子；整屏上滚就是后备缓冲区的一次memmove
+
+#define FBCON_FONT_W 8
+#define FBCON_FONT_H 16
+
+int fbcon_enable(int width, int height); // 切到width*height，成功返回0
+void fbcon_disable(); // 回到VGA文本模式
+int fbcon_enabled();
+
+// 以下由monitor_flush调用，坐标以字符格计
+void fbcon_scroll(int lines); // 画面整体上滚lines行
+void fbcon_draw_row(int y, const uint16_t *cells); // cells和文本模式显存格式一样：低8位字符，高8位属性
+void fbcon_set_cursor(int x, int y); // y为-1表示不显示光标
+void fbcon_present();
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef _FAT16_H_
+#define _FAT16_H_
+
+#include "monios/fs/file.h"
+#include "fsck.h"
+
+// fat16.c，所有改元数据的操作都是一个日志事务
+int fat16_format_hd();
+int fat16_create_file(fileinfo_t *finfo, char *filename);
+int fat16_open_file(fileinfo_t *finfo, char *filename);
+int fat16_read_file(fileinfo_t *finfo, void *buf);
+int fat16_delete_file(char *filename);
+int fat16_write_file(fileinfo_t *finfo, const void *buf, uint32_t size);
+int fat16_open_dir(fileinfo_t *finfo, const char *path);
+int fat16_read_dir(fileinfo_t *finfo, char *filename);
+
+// fat16_fsck.c，返回发现的问题数，出错返回-1
+int fat16_fsck(fsck_report_t *report, int repair);
+
+#endif
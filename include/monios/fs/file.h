@@ -67,6 +67,22 @@ typedef struct FILE_STRUCT {
     oflags_t flags;
 } file_t;
 
+struct TASK;
+
+// file.c，供aio等不在当前任务上下文里的代码使用
+file_t *task_fd2file(struct TASK *task, int fd);
+// 读写的字节数和同步次数记在task头上，aio代提交请求的任务做的时候要传提交者
+int file_read_at(struct TASK *task, file_t *cfile, void *buf, int count, int pos);
+int file_write_at(struct TASK *task, file_t *cfile, const void *msg, int len, int pos);
+int file_sync(struct TASK *task, file_t *cfile);
+void file_get(file_t *cfile); // 用着文件的时候加一个引用，别人close了也不会马上释放
+void file_put(file_t *cfile); // 最后一个引用放掉时才释放缓冲区
+
+// 文件系统锁：fat16、日志和硬盘驱动都是按一次只有一个人用写的，而aio任务写硬盘时是可以被抢占的
+// 锁在任务身上，同一个任务可以重复拿；拿着锁的任务不会睡下去，所以等锁的一方只要让出CPU
+void fs_lock();
+void fs_unlock();
+
 typedef enum seeks {
     SEEK_SET = 1,
     SEEK_CUR,
@@ -0,0 +1,38 @@
+#ifndef _JOURNAL_H_
+#define _JOURNAL_H_
+
+#include "monios/fs/file.h"
+
+// FAT16元数据日志
+// FAT有32个扇区，最多只能寻址8192个簇，再往后的扇区文件系统永远用不到，日志就放在那里
+#define JOURNAL_START_LBA (DATA_START_LBA + FAT1_SECTORS * (SECTOR_SIZE / 2) - 2)
+#define JOURNAL_MAX_BLOCKS (FAT1_SECTORS + ROOT_DIR_SECTORS) // 一个事务最多改动的元数据扇区数，FAT1加根目录全改也装得下
+#define JOURNAL_SECTORS (JOURNAL_MAX_BLOCKS + 2) // 描述块 + 数据块 + 提交块
+
+#define JOURNAL_DESC_MAGIC   0x4c4a4e4d // "MNJL"
+#define JOURNAL_COMMIT_MAGIC 0x434a4e4d // "MNJC"
+
+typedef struct JOURNAL_DESC {
+    uint32_t magic;
+    uint32_t seq; // 事务序号，每提交一次加1
+    uint32_t nblocks; // 0表示日志是干净的，不需要重放
+    uint32_t lba[JOURNAL_MAX_BLOCKS]; // 每个数据块最终要写到哪个扇区
+} journal_desc_t;
+
+typedef struct JOURNAL_COMMIT {
+    uint32_t magic;
+    uint32_t seq; // 必须与描述块一致
+    uint32_t checksum; // 所有数据块的校验和，防止只写了一半
+} journal_commit_t;
+
+void journal_init();
+void journal_set_enabled(int enabled);
+int journal_enabled();
+
+void journal_begin();
+int journal_end();
+
+void meta_read(uint32_t lba, int sec_cnt, void *buf);
+void meta_write(uint32_t lba, int sec_cnt, const void *buf);
+
+#endif
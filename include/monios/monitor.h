@@ -2,6 +2,28 @@
 #define _MONITOR_H_
 
 #include "common.h"
+#include "stdarg.h"
+#include "drivers/fifo.h"
+
+#define CON_TEXT_COLS 80 // VGA文本模式
+#define CON_TEXT_ROWS 25
+#define CON_MAX_COLS 256 // 帧缓冲控制台最大能有多少列，每个控制台的每一行都按这么宽存
+#define CON_MAX_ROWS 96
+#define NR_CONSOLES 4 // Alt+F1~F4切换
+#define CON_SCROLLBACK 200 // 每个控制台能往回翻多少行
+#define CON_KEYBUF 256 // 每个控制台的键盘缓冲，必须是2的幂；粘贴一大段也放得下
+
+#define ANSI_MAX_PARAMS 16
+
+// 每个控制台自己的ANSI转义序列状态，kernel/ansi.c里的状态机一个字节一个字节地推进它
+typedef struct ANSI_STATE {
+    int state; // 普通字符/刚收到ESC/CSI参数中
+    int params[ANSI_MAX_PARAMS], nparams;
+    int private; // CSI后面跟了?之类的私有前缀
+    int save_x, save_y; // \033[s保存的光标位置
+    int fore, back, bright, reverse; // SGR设置的颜色
+    int scroll_top, scroll_bottom; // \033[r设置的滚动区域，从0开始，包含两端
+} ansi_state_t;
 
 void move_cursor_to(int new_x, int new_y);
 void set_color(int fore, int back, int fore_brighten);
@@ -11,9 +33,29 @@ int get_cursor_pos();
 
 void monitor_put(char c); // 打印字符
 void monitor_clear(); // 清屏
+void monitor_flush(); // 把影子缓冲区里改过的行刷到显存
+void monitor_suspend(int on); // 为1时不再碰文本模式显存，为0时恢复并整屏重画
+void monitor_use_framebuffer(int cols, int rows); // 改由kernel/fbcon.c画到帧缓冲，cols为0回到VGA文本模式
 void monitor_write(char *s); // 打印字符串
 void monitor_write_hex(uint32_t hex); // 打印十六进制数
 void monitor_write_dec(uint32_t dec); // 打印十进制数
 void monitor_printf(const char *fmt, ...);
+int monitor_vprintf(const char *fmt, va_list ap);
+void ansi_reset(ansi_state_t *st);
+int ansi_feed(ansi_state_t *st, char c); // 返回1表示c属于转义序列，已经处理掉了
+
+// 虚拟控制台：每个任务输出到自己的控制台（从父任务继承），键盘输入只给前台控制台
+void console_init();
+void console_switch(int n);
+void console_scroll(int lines); // 前台控制台往回翻lines行，负数往前翻，0回到最新
+int console_current(); // 当前任务的控制台
+int console_foreground(); // 屏幕上显示的控制台
+int console_cols(); // 屏幕现在有多少列、多少行，文本模式是80x25
+int console_rows();
+fifo_t *console_keys(int con);
+// 以下都作用于当前任务的控制台，坐标从0开始
+void console_erase(int x0, int y0, int x1, int y1); // 按行优先顺序把(x0,y0)到(x1,y1)擦成空格
+void console_scroll_lines(int top, int bottom, int n); // top~bottom行上滚n行，负数下滚
+void console_clear_history();
 
 #endif
\ No newline at end of file
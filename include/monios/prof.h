@@ -0,0 +1,26 @@
+#ifndef _PROF_H_
+#define _PROF_H_
+
+#include "monios/common.h"
+#include "drivers/isr.h"
+
+// 采样分析器：时钟中断每来一次，就记下被打断的地方（eip、cs）和当时的任务
+// 结果导出成文本文件，拿到宿主机上用tools/profsym.sh对着out/kernel.sym换成函数名
+
+#define PROF_MAX_SAMPLES 32768 // 一次会话最多这么多个样本，1000Hz下大约半分钟
+#define PROF_DEFAULT_HZ 1000
+
+typedef struct PROF_SAMPLE {
+    uint32_t eip; // 内核样本是线性地址，应用程序样本是相对代码段的地址
+    uint16_t cs;
+    uint16_t pid;
+} prof_sample_t;
+
+int prof_start(uint32_t hz); // hz会被取整成时钟频率的整数倍
+void prof_stop();
+int prof_running();
+void prof_tick(registers_t *regs); // 由时钟中断调用
+int prof_dump(const char *filename); // 返回写入的字节数，失败返回-1
+void prof_print_status();
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef _SMP_H_
+#define _SMP_H_
+
+#include "monios/common.h"
+
+// 多处理器：BSP按MADT里的APIC ID用INIT-SIPI-SIPI把其他CPU（AP）叫起来
+// AP从TRAMPOLINE_ADDR的实模式代码进保护模式，用BSP的GDT和IDT，各自有一个idle任务（自己的TSS和栈）
+// 内核其余部分都是按单CPU写的，靠关中断互斥，所以内核代码统一在大内核锁下跑，同一时刻只有一个CPU在内核里
+// 不拿大内核锁的只有：AP的时钟中断、调度器（每个运行队列一把自旋锁）、trace（每个CPU一个环）、kmalloc（自己有锁）
+// 用户态的代码不用锁，所以计算密集的应用程序能在多个CPU上同时跑
+
+#define MAX_CPUS 8
+#define TRAMPOLINE_ADDR 0x7000 // 4KB对齐、1MB以下，引导扇区（0x7C00）早就用完了
+
+struct TASK;
+
+// 每个CPU一份的数据，按cpu_id()下标
+typedef struct CPU {
+    int id;
+    uint8_t apic_id;
+    volatile int online;
+    struct TASK *idle; // 运行队列空了就跑它，它不在任何运行队列里
+    struct TASK *leaving; // 刚切走的任务，现场存完之前不能让别的CPU切进去
+    uint32_t ticks, idle_ticks; // 时钟中断次数，其中有多少次是在idle里
+    uint32_t steals; // 从别的CPU偷来的任务数
+} cpu_t;
+
+extern cpu_t cpus[MAX_CPUS];
+
+void smp_init(); // 在task_init之后调，没有APIC也要调，会给BSP建idle任务
+int smp_cpu_count();
+int cpu_id(); // 当前CPU的编号，BSP是0
+cpu_t *this_cpu();
+void smp_tick(); // 时钟中断里调，记账
+
+// 大内核锁，同一个CPU可以重复拿；切换任务时由task_switch整个放掉，切回来再拿回原来的层数
+void kernel_lock();
+void kernel_unlock();
+int kernel_unlock_all(); // 返回放掉了几层，这个CPU没拿着就是0；要关着中断调
+void kernel_relock(int depth);
+void kernel_relax(); // 在内核里忙等的循环每一轮调一次，让别的CPU有机会进内核
+
+#endif
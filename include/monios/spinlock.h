@@ -0,0 +1,41 @@
+#ifndef _SPINLOCK_H_
+#define _SPINLOCK_H_
+
+#include "monios/common.h"
+
+// 排队自旋锁：lock xadd拿一个号，等owner叫到自己，先到先得，放锁后马上重新拿的CPU也插不了队
+typedef struct SPINLOCK {
+    volatile uint32_t next, owner;
+} spinlock_t;
+
+#define SPINLOCK_INIT {0, 0}
+
+static inline void spin_lock(spinlock_t *lock)
+{
+    uint32_t ticket = 1;
+    asm volatile("lock xaddl %0, %1" : "+r"(ticket), "+m"(lock->next) : : "memory");
+    while (lock->owner != ticket) asm volatile("pause" : : : "memory");
+}
+
+static inline void spin_unlock(spinlock_t *lock)
+{
+    asm volatile("" : : : "memory"); // x86的写不会和前面的读写乱序，挡住编译器就够了
+    lock->owner++; // 只有拿着锁的人会写owner
+}
+
+// 中断处理程序里也要拿的锁必须关着中断拿，否则中断在本CPU上进来就是自己等自己
+static inline uint32_t spin_lock_irqsave(spinlock_t *lock)
+{
+    uint32_t eflags;
+    asm volatile("pushfl; popl %0; cli" : "=r"(eflags) : : "memory");
+    spin_lock(lock);
+    return eflags;
+}
+
+static inline void spin_unlock_irqrestore(spinlock_t *lock, uint32_t eflags)
+{
+    spin_unlock(lock);
+    if (eflags & 0x200) asm volatile("sti" : : : "memory"); // 原来开着中断才开
+}
+
+#endif
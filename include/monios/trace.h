@@ -0,0 +1,62 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include "monios/common.h"
+#include "monios/smp.h"
+
+// 内核事件跟踪：tracepoint把事件写进环形缓冲区，满了就覆盖最旧的，trace dump把它原样存成二进制文件
+// 拿到宿主机上用tools/trace2json.py转成Chrome/Perfetto能打开的JSON
+
+#define TRACE_MAX_CPUS MAX_CPUS // 每个CPU一个环
+#define TRACE_RING_SIZE 8192 // 每个环的事件数，必须是2的幂
+#define TRACE_MAGIC 0x52544e4d // "MNTR"
+#define TRACE_VERSION 1
+
+enum {
+    TRACE_IRQ_ENTER = 1, // arg: IRQ号
+    TRACE_IRQ_EXIT,
+    TRACE_SWITCH, // arg: 切换到的pid
+    TRACE_SYSCALL_ENTER, // arg: 系统调用号
+    TRACE_SYSCALL_EXIT, // arg: 返回值
+    TRACE_HD_READ, // arg: 起始LBA
+    TRACE_HD_READ_DONE, // arg: 扇区数
+    TRACE_HD_WRITE, // arg: 起始LBA
+    TRACE_HD_WRITE_DONE, // arg: 扇区数
+    TRACE_NET_RX, // arg: 帧长度
+    TRACE_NET_TX, // arg: 帧长度
+};
+
+typedef struct TRACE_EVENT {
+    uint64_t tsc;
+    uint16_t type;
+    uint16_t pid;
+    uint32_t arg;
+} __attribute__((packed)) trace_event_t; // 16字节
+
+// 导出文件开头的头部，后面依次是 nnames 个 trace_name_t 和每个CPU的 nevents[cpu] 个事件（从旧到新）
+typedef struct TRACE_FILE_HEADER {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t ncpus;
+    uint32_t event_size;
+    uint32_t hz; // 系统tick的频率，和下面两组时间戳一起用来换算TSC频率
+    uint32_t tick_start, tick_end;
+    uint64_t tsc_start, tsc_end;
+    uint32_t nnames;
+    uint32_t nevents[TRACE_MAX_CPUS];
+    uint32_t lost[TRACE_MAX_CPUS]; // 被覆盖掉的事件数
+} __attribute__((packed)) trace_file_header_t;
+
+typedef struct TRACE_NAME {
+    uint32_t pid;
+    char name[32];
+} __attribute__((packed)) trace_name_t;
+
+void trace_init();
+void trace_set_enabled(int enabled);
+int trace_enabled();
+void trace_event(int type, uint32_t arg);
+int trace_dump(const char *filename); // 返回写入的字节数，失败返回-1
+void trace_print_status();
+
+#endif
@@ -7,7 +7,35 @@
 
 typedef unsigned int size_t;
 
+#define EOF (-1)
+#define BUFSIZ 1024
+
+#define _IOFBF 0 // 缓冲区满了才写
+#define _IOLBF 1 // 遇到换行就写
+#define _IONBF 2 // 不缓冲
+
+typedef struct STDIO_FILE {
+    int fd;
+    int mode; // _IOFBF _IOLBF _IONBF
+    char *buf;
+    int size; // 缓冲区大小
+    int len; // 缓冲区里攒了多少字节
+    int error;
+} FILE;
+
+extern FILE *stdout;
+extern FILE *stderr;
+
+int fflush(FILE *stream);
+int setvbuf(FILE *stream, char *buf, int mode, size_t size);
+size_t fwrite(const void *ptr, size_t size, size_t nmemb, FILE *stream);
+int fputs(const char *str, FILE *stream);
+int fputc(int ch, FILE *stream);
+int vfprintf(FILE *stream, const char *fmt, va_list ap);
+int fprintf(FILE *stream, const char *fmt, ...);
+
 int vsprintf(char *buf, const char *fmt, va_list ap);
+int vsnprintf(char *buf, size_t size, const char *fmt, va_list ap);
 int sprintf(char *buf, const char *fmt, ...);
 int vprintf(const char *fmt, va_list ap);
 int printf(const char *fmt, ...);
@@ -1,7 +1,11 @@
 #ifndef _STDLIB_H_
 #define _STDLIB_H_
 
-void *malloc(int size);
+#include "stdint.h"
+
+void *malloc(uint32_t size);
 void free(void *buf);
+void *calloc(uint32_t nmemb, uint32_t size);
+void *realloc(void *buf, uint32_t size);
 
 #endif
\ No newline at end of file
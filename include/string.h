@@ -5,6 +5,7 @@
 
 void *memset(void *dst_, uint8_t value, uint32_t size);
 void *memcpy(void *dst_, const void *src_, uint32_t size);
+void *memmove(void *dst_, const void *src_, uint32_t size); // 可以重叠
 int memcmp(const void *a_, const void *b_, uint32_t size);
 char *strcpy(char *dst_, const char *src_);
 char *strncpy(char *dst_, const char *src_, uint32_t n);
@@ -1,6 +1,10 @@
 #ifndef _SYSCALL_H_
 #define _SYSCALL_H_
 
+#include "uio.h"
+#include "fsck.h"
+#include "taskstat.h"
+
 int sys_getpid();
 int sys_create_process(const char *app_name, const char *cmdline, const char *work_dir);
 
@@ -11,8 +15,24 @@ int sys_read(int fd, void *buf, int count);
 int sys_close(int fd);
 int sys_lseek(int fd, int offset, uint8_t whence);
 int sys_unlink(const char *filename);
+int sys_pread(int fd, void *buf, int count, int offset);
+int sys_pwrite(int fd, const void *msg, int len, int offset);
+int sys_readv(int fd, const iovec_t *iov, int iovcnt);
+int sys_writev(int fd, const iovec_t *iov, int iovcnt);
+void *sys_mmap(void *addr, uint32_t length, int prot, int flags, int fd, int offset);
+int sys_munmap(void *addr, uint32_t length);
 
 // exec.c
 void *sys_sbrk(int incr);
 
+// aio.c
+int sys_io_uring_setup(void *ring, uint32_t entries);
+int sys_io_uring_enter(uint32_t min_complete);
+
+// fat16_fsck.c
+int sys_fsck(fsck_report_t *report, int repair);
+
+// mtask.c
+int sys_taskstat(int pid, task_stat_t *st);
+
 #endif
\ No newline at end of file
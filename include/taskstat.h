@@ -0,0 +1,30 @@
+#ifndef _TASKSTAT_H_
+#define _TASKSTAT_H_
+
+#include "stdint.h"
+
+#define TASK_NAME_LEN 32
+
+// 一个任务的资源使用情况，ps和top靠它
+typedef struct TASK_STAT {
+    int pid;
+    int state; // 1 刚创建，2 运行中，3 睡眠，4 已退出等待回收
+    char name[TASK_NAME_LEN];
+    uint32_t ticks; // 占用了多少个时钟周期（100Hz）
+    uint32_t switches; // 被调度上CPU的次数
+    uint32_t syscalls; // 发起了多少次系统调用
+    uint64_t read_bytes; // 从文件读了多少字节
+    uint64_t write_bytes; // 往文件写了多少字节
+    uint32_t syncs; // 把文件写回硬盘的次数
+    uint32_t mem; // 数据段里已经用掉的字节数（program break），内核任务为0
+    uint32_t mem_peak; // mem的最大值
+    uint32_t start; // 任务创建时系统的tick数
+    uint32_t now; // 取数据时系统的tick数
+    uint32_t hz; // 每秒多少个tick
+} task_stat_t;
+
+// 从pid开始找第一个存在的任务，把它的信息填进st并返回它的pid，找不到返回-1
+// 遍历所有任务：for (pid = taskstat(0, &st); pid != -1; pid = taskstat(pid + 1, &st))
+int taskstat(int pid, task_stat_t *st);
+
+#endif
@@ -4,5 +4,8 @@
 #include "monios/common.h"
 
 void init_timer(uint32_t freq);
+uint32_t timer_get_ticks(); // 启动以来的时钟中断次数
+uint32_t timer_get_frequency();
+uint32_t timer_set_sample_rate(uint32_t hz);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,16 @@
+#ifndef _UIO_H_
+#define _UIO_H_
+
+#include "stdint.h"
+
+#define IOV_MAX 16 // 一次readv/writev最多带多少个缓冲区
+
+typedef struct iovec {
+    void *iov_base; // 缓冲区起始地址
+    uint32_t iov_len; // 缓冲区长度
+} iovec_t;
+
+int readv(int fd, const iovec_t *iov, int iovcnt);
+int writev(int fd, const iovec_t *iov, int iovcnt);
+
+#endif
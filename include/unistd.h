@@ -3,14 +3,19 @@
 
 #include "stdint.h"
 
+int getpid();
 int open(char *filename, uint32_t flags);
 int write(int fd, const void *msg, int len);
 int read(int fd, void *buf, int count);
 int close(int fd);
 int lseek(int fd, int offset, uint8_t whence);
+int pread(int fd, void *buf, int count, int offset);
+int pwrite(int fd, const void *msg, int len, int offset);
 int unlink(const char *filename);
 int waitpid(int pid);
-int exit(int ret);
+void *sbrk(int incr);
+int exit(int ret); // stdio.c，先刷新stdout/stderr
+int _exit(int ret); // 直接退出
 
 int create_process(const char *app_name, const char *cmdline, const char *work_dir);
 
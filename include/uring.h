@@ -0,0 +1,49 @@
+#ifndef _URING_H_
+#define _URING_H_
+
+#include "stdint.h"
+
+// 应用程序与内核共享的提交/完成队列，放在应用程序自己的数据段里
+// 应用程序填sqe并推进sq_tail，内核取走后推进sq_head；完成队列方向相反
+
+#define IORING_MAX_ENTRIES 64
+
+#define IORING_OP_NOP   0
+#define IORING_OP_READ  1
+#define IORING_OP_WRITE 2
+
+typedef struct io_uring_sqe {
+    uint8_t opcode; // IORING_OP_*
+    uint8_t flags;
+    uint16_t reserved;
+    int fd;
+    int off; // 读写偏移，-1表示使用并推进文件的读写指针
+    void *addr; // 缓冲区，相对于数据段的地址
+    uint32_t len;
+    uint32_t user_data; // 原样带回到cqe里
+} io_uring_sqe_t;
+
+typedef struct io_uring_cqe {
+    uint32_t user_data;
+    int res; // 读写的字节数，失败为-1
+} io_uring_cqe_t;
+
+typedef struct io_uring {
+    volatile uint32_t sq_head, sq_tail; // 内核推进head，应用程序推进tail
+    volatile uint32_t cq_head, cq_tail; // 应用程序推进head，内核推进tail
+    uint32_t entries; // 两个队列的长度，必须是2的幂且不超过IORING_MAX_ENTRIES
+    uint32_t sqe_tail; // 应用程序私有，已经填好但还没有发布给内核的位置
+    io_uring_sqe_t sqes[IORING_MAX_ENTRIES];
+    io_uring_cqe_t cqes[IORING_MAX_ENTRIES];
+} io_uring_t;
+
+int io_uring_setup(io_uring_t *ring, uint32_t entries);
+int io_uring_enter(uint32_t min_complete);
+
+io_uring_sqe_t *io_uring_get_sqe(io_uring_t *ring);
+int io_uring_submit(io_uring_t *ring);
+io_uring_cqe_t *io_uring_peek_cqe(io_uring_t *ring);
+int io_uring_wait_cqe(io_uring_t *ring, io_uring_cqe_t **cqe);
+void io_uring_cqe_seen(io_uring_t *ring);
+
+#endif
@@ -0,0 +1,138 @@
+#include "monios/common.h"
+#include "monios/fs/file.h"
+#include "drivers/mtask.h"
+#include "uring.h"
+
+// 异步I/O：应用程序把请求放进自己数据段里的提交队列，由aio内核任务取走执行，结果放回完成队列
+// 硬盘驱动是轮询的，没有完成中断可用，所以由一个单独的内核任务来跑；
+// 它被时钟抢占时应用程序就能接着算，计算和硬盘读写就这样叠起来了
+
+task_t *create_kernel_task(void *entry, int privilege_level);
+extern taskctl_t *taskctl;
+
+static task_t *aio_task = NULL; // 处理请求的内核任务，第一次io_uring_setup时创建
+static volatile int aio_kicked = 0; // 睡下去之前有没有人来过
+
+// [addr, addr+len)是否整个落在task的数据段里；brk_end就是段上限（相对地址，含）
+static int in_data_segment(task_t *task, uint32_t addr, uint32_t len)
+{
+    uint32_t size = (uint32_t) task->brk_end + 1;
+    return len <= size && addr <= size - len; // 这样写不会溢出
+}
+
+// 取得task的队列的绝对地址，必须在关中断时用，因为sbrk会搬动数据段
+static io_uring_t *task_ring(task_t *task)
+{
+    if (task->flags != 2 || !task->uring) return NULL; // 已经退出或者没有注册
+    return (io_uring_t *) ((char *) task->uring + task->ds_base);
+}
+
+// 处理task的一个请求，没有请求可处理返回0
+static int aio_do_one(task_t *task)
+{
+    io_uring_sqe_t sqe;
+    file_t *cfile;
+    int res = 0;
+    fs_lock(); // 一直拿到写完硬盘，应用程序这时候的文件操作要等着，计算照样跑
+    asm("cli");
+    io_uring_t *ring = task_ring(task);
+    if (!ring || ring->sq_head == ring->sq_tail || ring->cq_tail - ring->cq_head >= task->uring_entries) { // 没有请求或者完成队列没地方放
+        asm("sti");
+        fs_unlock();
+        return 0;
+    }
+    sqe = ring->sqes[ring->sq_head & (task->uring_entries - 1)]; // 拷一份，应用程序马上就可以重新用这个位置
+    ring->sq_head++;
+    cfile = task_fd2file(task, sqe.fd);
+    if (cfile) file_get(cfile); // 写硬盘时应用程序close了也不能释放
+    char *buf = (char *) sqe.addr + task->ds_base;
+    // 不像同步的read，sqe是应用程序随时能改的，缓冲区出了数据段就是任意物理内存
+    if (sqe.opcode != IORING_OP_NOP && !in_data_segment(task, (uint32_t) sqe.addr, sqe.len)) res = -1;
+    else switch (sqe.opcode) {
+        case IORING_OP_NOP:
+            break;
+        case IORING_OP_READ:
+            if (!cfile || cfile->flags == O_WRONLY) { res = -1; break; }
+            res = file_read_at(task, cfile, buf, sqe.len, sqe.off == -1 ? cfile->pos : sqe.off);
+            if (sqe.off == -1) cfile->pos += res; // 跟着读写指针走的要推进读写指针
+            break;
+        case IORING_OP_WRITE:
+            if (!cfile || cfile->flags == O_RDONLY) { res = -1; break; }
+            res = file_write_at(task, cfile, buf, sqe.len, sqe.off == -1 ? cfile->pos : sqe.off);
+            if (res != -1 && sqe.off == -1) cfile->pos += res;
+            break;
+        default:
+            res = -1; // 不认识的操作
+            break;
+    }
+    asm("sti");
+    if (sqe.opcode == IORING_OP_WRITE && res != -1) {
+        if (file_sync(task, cfile) == -1) res = -1; // 写硬盘最慢，开着中断做，应用程序可以继续跑
+    }
+    asm("cli");
+    ring = task_ring(task); // 写硬盘期间数据段可能被搬走，任务也可能已经退出
+    if (ring) {
+        io_uring_cqe_t *cqe = &ring->cqes[ring->cq_tail & (task->uring_entries - 1)];
+        cqe->user_data = sqe.user_data;
+        cqe->res = res;
+        ring->cq_tail++; // 填完再推进，应用程序看到tail变了就能读
+    }
+    asm("sti");
+    if (cfile) file_put(cfile);
+    fs_unlock();
+    return 1;
+}
+
+static void aio_main()
+{
+    while (1) {
+        aio_kicked = 0;
+        int done = 0;
+        for (int i = 0; i < MAX_TASKS; i++) {
+            task_t *task = &taskctl->tasks0[i];
+            if (!task->uring) continue;
+            while (aio_do_one(task)) done++; // 一口气把这个任务的队列清空
+        }
+        asm("cli");
+        if (!done && !aio_kicked) task_sleep(aio_task); // 一轮下来什么都没干，睡到下一次io_uring_enter
+        asm("sti");
+    }
+}
+
+int sys_io_uring_setup(void *ring, uint32_t entries)
+{
+    task_t *task = task_now();
+    if (!task->is_user || !ring) return -1; // 队列在数据段里，只有应用程序才有
+    if (!entries || entries > IORING_MAX_ENTRIES || (entries & (entries - 1))) return -1; // 必须是2的幂
+    if (!in_data_segment(task, (uint32_t) ring, sizeof(io_uring_t))) return -1; // 内核要往里写完成队列
+    if (!aio_task) {
+        aio_task = create_kernel_task(aio_main, 0);
+        if (!aio_task) return -1;
+        task_set_name(aio_task, "aio");
+        asm("cli");
+        task_run(aio_task);
+        asm("sti");
+    }
+    io_uring_t *kring = (io_uring_t *) ((char *) ring + task->ds_base);
+    kring->sq_head = kring->sq_tail = kring->sqe_tail = 0;
+    kring->cq_head = kring->cq_tail = 0;
+    kring->entries = entries; // 给应用程序看的，内核用task->uring_entries
+    task->uring_entries = entries;
+    task->uring = ring;
+    return 0;
+}
+
+// 通知aio任务有新的请求，min_complete不为0时等到完成队列里至少有这么多个
+int sys_io_uring_enter(uint32_t min_complete)
+{
+    task_t *task = task_now();
+    if (!task->uring || !aio_task) return -1; // 没有注册过
+    asm("cli");
+    aio_kicked = 1;
+    task_wakeup(aio_task);
+    asm("sti");
+    io_uring_t *ring = (io_uring_t *) ((char *) task->uring + task->ds_base); // 在系统调用里数据段不会被自己搬走
+    if (min_complete > task->uring_entries) min_complete = task->uring_entries;
+    while (ring->cq_tail - ring->cq_head < min_complete) kernel_relax(); // 同task_wait一样干等，时钟会切走
+    return ring->cq_tail - ring->cq_head;
+}
@@ -1,245 +1,304 @@
 #include "monios/monitor.h"
 #include "drivers/fifo.h"
 #include "stdbool.h"
+#include "stdio.h"
 
 extern uint32_t load_eflags();
 extern void store_eflags(uint32_t);
 
-extern fifo_t decoded_key;
-
 #define min(a, b) ((a) < (b) ? (a) : (b))
 #define max(a, b) ((a) > (b) ? (a) : (b))
 
-static int param_arr[255] = {0}; // 存参数的数组
-static int param_idx = 0; // 现在这个参数应该被放在什么位置
-static int save_x = 0, save_y = 0; // 这一行也是新增的
+// 逐字节解析ANSI/VT100转义序列的状态机
+// 状态全在控制台自己的ansi_state_t里，一个序列被拆到几次write里也没关系；
+// 进入CSI时只清第一个参数，不用每次把整个参数数组清一遍
+
+enum { ANSI_NORMAL = 0, ANSI_ESC, ANSI_CSI };
+
+#define ANSI_PARAM_MAX 9999 // 参数再大也没意义，防止溢出
 
-// 解析ansi控制序列，返回值是开始的esc后一共有多少个字符，不为合法ANSI转义序列返回-1
-int parse_ansi(const char *ansi)
+void ansi_reset(ansi_state_t *st)
 {
-    param_idx = 0;
-    memset(param_arr, 0, sizeof(param_arr)); // 清空参数数组并将当前参数放在第一个
-    char *esc_start = (char *) ansi;
-    ansi++; // 我们假定ansi的第一个字符总是esc
-    if (*ansi == 'c') {
-        // \033c，完全重置终端
-        // 在这里只能是指把显示器恢复到最初的状态，也就是清屏并恢复黑底白字
-        set_color(7, 0, true);
-        monitor_clear();
-        return 1;
-    }
-    if (*ansi != '[') {
-        return -1; // 除了\033c外只支持CSI
+    st->state = ANSI_NORMAL;
+    st->nparams = 0;
+    st->save_x = st->save_y = 1;
+    st->fore = 7;
+    st->back = 0;
+    st->bright = true; // 默认黑底亮白字
+    st->reverse = false;
+    st->scroll_top = 0;
+    st->scroll_bottom = console_rows() - 1;
+}
+
+// 第i个参数，没给或者是0就用默认值
+static inline int arg(ansi_state_t *st, int i, int def)
+{
+    return i < st->nparams && st->params[i] ? st->params[i] : def;
+}
+
+static void apply_color(ansi_state_t *st)
+{
+    if (st->reverse) set_color(st->back, st->fore, false); // 反显时背景色做不了高亮
+    else set_color(st->fore, st->back, st->bright);
+}
+
+// 256色里的颜色挑一个最接近的8色，只看前16个，其余的按灰阶/色块粗略判断
+static int color256(int n, int *bright)
+{
+    if (n < 8) return n;
+    if (n < 16) {
+        *bright = true;
+        return n - 8;
     }
-    ansi++; // 跳过中括号
-    while (*ansi >= '0' && *ansi <= '9') {
-        // 如果是数字，那么统一当做参数处理
-        param_arr[param_idx] = param_arr[param_idx] * 10 + *ansi - '0'; // 当前参数结尾增加一位
-        ansi++;
-        if (*ansi == ';') {
-            // 是分号表示当前参数结束
-            param_idx++;
-            ansi++; // 跳过分号继续进行参数处理
+    if (n >= 232) return n >= 244 ? 7 : 0; // 灰阶
+    n -= 16; // 6x6x6的色块，每个分量0~5，大于2算有
+    int r = n / 36 > 2, g = n / 6 % 6 > 2, b = n % 6 > 2;
+    return r | g << 1 | b << 2;
+}
+
+static void sgr(ansi_state_t *st)
+{
+    int n = st->nparams ? st->nparams : 1; // \033[m等于\033[0m
+    for (int i = 0; i < n; i++) {
+        int p = st->params[i];
+        if (p == 0) {
+            st->fore = 7; st->back = 0; st->bright = true; st->reverse = false;
+        } else if (p == 1) {
+            st->bright = true; // 文本模式没有粗体，用高亮代替
+        } else if (p == 2 || p == 22) {
+            st->bright = false;
+        } else if (p == 7) {
+            st->reverse = true;
+        } else if (p == 27) {
+            st->reverse = false;
+        } else if (p >= 30 && p <= 37) {
+            st->fore = p - 30; st->bright = false;
+        } else if (p == 39) {
+            st->fore = 7; st->bright = true;
+        } else if (p >= 40 && p <= 47) {
+            st->back = p - 40;
+        } else if (p == 49) {
+            st->back = 0;
+        } else if (p >= 90 && p <= 97) {
+            st->fore = p - 90; st->bright = true;
+        } else if (p >= 100 && p <= 107) {
+            st->back = p - 100; // 背景的高亮位是闪烁位，只能当普通色
+        } else if ((p == 38 || p == 48) && i + 1 < n) { // 38;5;n 和 38;2;r;g;b
+            int bright = false, color = 0;
+            if (st->params[i + 1] == 5 && i + 2 < n) {
+                color = color256(st->params[i + 2], &bright);
+                i += 2;
+            } else if (st->params[i + 1] == 2 && i + 4 < n) {
+                color = (st->params[i + 2] > 127) | (st->params[i + 3] > 127) << 1 | (st->params[i + 4] > 127) << 2;
+                i += 4;
+            } else {
+                break; // 格式不对，剩下的参数不知道怎么解释了
+            }
+            if (p == 38) {
+                st->fore = color; st->bright = bright;
+            } else {
+                st->back = color;
+            }
         }
+        // 下划线、闪烁等文本模式显示不了，忽略
     }
-    // 参数解析部分结束，最后一个字符是CSI对应命令
-    char cmd = *ansi;
-    // 至此已将ansi控制序列拆成param_arr和cmd两部分
+    apply_color(st);
+}
+
+// 光标到了滚动区域最后一行就把区域往上滚，否则下移一行
+static void index_down(ansi_state_t *st, int x, int y)
+{
+    if (y - 1 == st->scroll_bottom) console_scroll_lines(st->scroll_top, st->scroll_bottom, 1);
+    else move_cursor_to(x, min(y + 1, console_rows()));
+}
+
+static void index_up(ansi_state_t *st, int x, int y)
+{
+    if (y - 1 == st->scroll_top) console_scroll_lines(st->scroll_top, st->scroll_bottom, -1);
+    else move_cursor_to(x, max(y - 1, 1));
+}
+
+// 键盘的softirq任务也往这个队列里放，队列只允许一个生产者；两边都关着中断放，才不会在写数据和推进head之间被对方插进来
+static void report_cursor(int x, int y)
+{
+    int eflags = load_eflags();
+    asm("cli");
+    // strlen(\e[80;25R) = 8
+    char s[16] = {0};
+    int len = sprintf(s, "\x1b[%d;%dR", y, x); // 先行后列
+    fifo_t *keys = console_keys(console_current()); // 回答给发问的任务所在的控制台
+    for (int i = 0; i < len; i++) fifo_put(keys, s[i]);
+    store_eflags(eflags);
+}
+
+// CSI序列的最后一个字母到了，执行它；光标坐标从1开始
+static void csi_dispatch(ansi_state_t *st, char cmd)
+{
     int cursor_pos = get_cursor_pos();
-    int cursor_x = cursor_pos >> 8;
-    int cursor_y = cursor_pos & 0xff;
-    int color = get_color();
-    int fore = color & 0x7;
-    int fore_brighten = (color & 0xf) >> 3;
-    int back = color >> 4;
+    int x = cursor_pos >> 8;
+    int y = cursor_pos & 0xff;
+    if (st->private) { // \033[?25l之类的私有序列，文本模式下都不支持，吃掉就行
+        return;
+    }
     switch (cmd) {
-        case 'A': {
-            // 上移，y减小
-            int arg = param_arr[0] == 0 ? 1 : param_arr[0];
-            cursor_y = max(cursor_y - arg, 1);
-            move_cursor_to(cursor_x, cursor_y);
+        case 'A': // 上移
+            move_cursor_to(x, max(y - arg(st, 0, 1), 1));
             break;
-        }
-        case 'B': {
-            // 下移，y增大
-            int arg = param_arr[0] == 0 ? 1 : param_arr[0];
-            cursor_y = min(cursor_y + arg, 25);
-            move_cursor_to(cursor_x, cursor_y);
+        case 'B': // 下移
+        case 'e':
+            move_cursor_to(x, min(y + arg(st, 0, 1), console_rows()));
             break;
-        }
-        case 'C': {
-            // 左移，x减小
-            int arg = param_arr[0] == 0 ? 1 : param_arr[0];
-            cursor_x = max(cursor_x - arg, 1);
-            move_cursor_to(cursor_x, cursor_y);
+        case 'C': // 右移
+        case 'a':
+            move_cursor_to(min(x + arg(st, 0, 1), console_cols()), y);
             break;
-        }
-        case 'D': {
-            // 右移，x增大
-            int arg = param_arr[0] == 0 ? 1 : param_arr[0];
-            cursor_x = min(cursor_x + arg, 80);
-            move_cursor_to(cursor_x, cursor_y);
+        case 'D': // 左移
+            move_cursor_to(max(x - arg(st, 0, 1), 1), y);
             break;
-        }
-        case 'E': {
-            // 移到本行下面第n行开头
-            int arg = param_arr[0] == 0 ? 1 : param_arr[0];
-            cursor_x = 1; // 第1列
-            cursor_y = min(cursor_y + arg, 25); // 下面第n行
-            move_cursor_to(cursor_x, cursor_y);
+        case 'E': // 下面第n行开头
+            move_cursor_to(1, min(y + arg(st, 0, 1), console_rows()));
             break;
-        }
-        case 'F': {
-            // 移到本行上面第n行开头
-            int arg = param_arr[0] == 0 ? 1 : param_arr[0];
-            cursor_x = 1; // 第1列
-            cursor_y = max(cursor_y - arg, 1); // 上面第n行
-            move_cursor_to(cursor_x, cursor_y);
+        case 'F': // 上面第n行开头
+            move_cursor_to(1, max(y - arg(st, 0, 1), 1));
             break;
-        }
-        case 'G': {
-            // 移到第n列
-            int arg = param_arr[0] == 0 ? 1 : param_arr[0];
-            cursor_x = min(max(arg, 1), 80);
-            move_cursor_to(cursor_x, cursor_y);
+        case 'G': // 第n列
+        case '`':
+            move_cursor_to(min(arg(st, 0, 1), console_cols()), y);
             break;
-        }
-        case 'H':
-        case 'f': {
-            // 移到坐标 (n, m) 处
-            int n = param_arr[0] == 0 ? 1 : param_arr[0];
-            int m = param_arr[1] == 0 ? 1 : param_arr[1];
-            n = min(max(n, 1), 80);
-            m = min(max(m, 1), 25);
-            move_cursor_to(n, m);
+        case 'd': // 第n行
+            move_cursor_to(x, min(arg(st, 0, 1), console_rows()));
             break;
-        }
-        case 'J': {
-            int n = param_arr[0];
-            switch (n) {
-                case 0: {
-                    // 清除光标位置到屏幕末尾
-                    // 清除光标所在行以后的位置
-                    for (int x = cursor_x; x <= 80; x++) {
-                        set_char_at(x, cursor_y, ' ');
-                    }
-                    // 清理光标后所有行
-                    for (int y = cursor_y + 1; y <= 25; y++) {
-                        for (int x = 0; x <= 80; x++) {
-                            set_char_at(x, y, ' ');
-                        }
-                    }
-                    break;
-                }
-                case 1: {
-                    // 清除光标位置到屏幕开头
-                    // 清除光标所在行以前的位置
-                    for (int x = 0; x <= cursor_x; x++) {
-                        set_char_at(x, cursor_y, ' ');
-                    }
-                    // 清理光标前所有行
-                    for (int y = 0; y < cursor_y; y++) {
-                        for (int x = 0; x <= 80; x++) {
-                            set_char_at(x, y, ' ');
-                        }
-                    }
-                    break;
-                }
-                case 2:
-                case 3: {
-                    // 清空全屏
-                    monitor_clear();
-                    break;
-                }
+        case 'H': // 移到第n行第m列
+        case 'f':
+            move_cursor_to(min(arg(st, 1, 1), console_cols()), min(arg(st, 0, 1), console_rows()));
+            break;
+        case 'J': // 擦屏幕，0：光标到结尾，1：开头到光标，2/3：全屏（3连历史一起）
+            switch (arg(st, 0, 0)) {
+                case 0: console_erase(x - 1, y - 1, console_cols() - 1, console_rows() - 1); break;
+                case 1: console_erase(0, 0, x - 1, y - 1); break;
+                case 3: console_clear_history(); // fallthrough
+                case 2: console_erase(0, 0, console_cols() - 1, console_rows() - 1); break;
             }
-        }
-        case 'K': {
-            int n = param_arr[0];
-            switch (n) {
-                case 0: {
-                    // 清除光标位置到行末尾
-                    // 清除光标所在行以后的位置
-                    for (int x = cursor_x; x <= 80; x++) {
-                        set_char_at(x, cursor_y, ' ');
-                    }
-                    break;
-                }
-                case 1: {
-                    // 清除光标位置到行开头
-                    // 清除光标所在行以前的位置
-                    for (int x = 0; x <= cursor_x; x++) {
-                        set_char_at(x, cursor_y, ' ');
-                    }
-                    break;
-                }
-                case 2:
-                case 3: {
-                    // 清空整行
-                    for (int x = 0; x <= 80; x++) {
-                        set_char_at(x, cursor_y, ' ');
-                    }
-                    break;
-                }
+            break;
+        case 'K': // 擦本行，0：光标到行尾，1：行首到光标，2：整行
+            switch (arg(st, 0, 0)) {
+                case 0: console_erase(x - 1, y - 1, console_cols() - 1, y - 1); break;
+                case 1: console_erase(0, y - 1, x - 1, y - 1); break;
+                case 2: console_erase(0, y - 1, console_cols() - 1, y - 1); break;
             }
+            break;
+        case 'X': // 从光标开始擦n个字符，光标不动
+            console_erase(x - 1, y - 1, min(x - 2 + arg(st, 0, 1), console_cols() - 1), y - 1);
+            break;
+        case 'L': // 在光标处插入n行，光标行到区域底部往下挪
+            if (y - 1 >= st->scroll_top && y - 1 <= st->scroll_bottom) console_scroll_lines(y - 1, st->scroll_bottom, -arg(st, 0, 1));
+            break;
+        case 'M': // 删掉光标处n行，下面的往上补
+            if (y - 1 >= st->scroll_top && y - 1 <= st->scroll_bottom) console_scroll_lines(y - 1, st->scroll_bottom, arg(st, 0, 1));
+            break;
+        case 'S': // 滚动区域上滚n行
+            console_scroll_lines(st->scroll_top, st->scroll_bottom, arg(st, 0, 1));
+            break;
+        case 'T': // 下滚n行
+            console_scroll_lines(st->scroll_top, st->scroll_bottom, -arg(st, 0, 1));
+            break;
+        case 'r': { // 设置滚动区域，光标回到左上角
+            int top = arg(st, 0, 1), bottom = arg(st, 1, console_rows());
+            if (bottom > console_rows()) bottom = console_rows();
+            if (top >= bottom) break; // 至少两行
+            st->scroll_top = top - 1;
+            st->scroll_bottom = bottom - 1;
+            move_cursor_to(1, 1);
+            break;
         }
         case 's':
-            save_x = cursor_x;
-            save_y = cursor_y;
+            st->save_x = x; // 每个控制台各存各的
+            st->save_y = y;
             break;
         case 'u':
-            move_cursor_to(save_x, save_y);
+            move_cursor_to(st->save_x, st->save_y);
+            break;
+        case 'n':
+            if (arg(st, 0, 0) == 6) report_cursor(x, y); // 只支持\033[6n
+            break;
+        case 'm':
+            sgr(st);
             break;
-        case 'n': {
-            if (param_arr[0] != 6) {
-                // 只支持\x1b[6n
-                return -1;
+        default: // 不认识的序列也吃掉，不往屏幕上印乱码
+            break;
+    }
+}
+
+// 喂一个字节，返回1表示它属于转义序列已经被处理了，返回0表示是普通字符，要照常输出
+int ansi_feed(ansi_state_t *st, char c)
+{
+    if (c == 0x18 || c == 0x1a) { // CAN/SUB，放弃当前序列
+        int in_seq = st->state != ANSI_NORMAL;
+        st->state = ANSI_NORMAL;
+        return in_seq;
+    }
+    if (c == 0x1b) { // 序列里再来一个ESC就从头开始
+        st->state = ANSI_ESC;
+        return 1;
+    }
+    switch (st->state) {
+        case ANSI_NORMAL:
+            return 0;
+        case ANSI_ESC: {
+            st->state = ANSI_NORMAL;
+            int cursor_pos = get_cursor_pos();
+            int x = cursor_pos >> 8, y = cursor_pos & 0xff;
+            switch (c) {
+                case '[':
+                    st->state = ANSI_CSI;
+                    st->nparams = 0;
+                    st->params[0] = 0;
+                    st->private = false;
+                    break;
+                case 'c': // \033c，完全重置终端：清屏并恢复黑底白字
+                    ansi_reset(st);
+                    apply_color(st);
+                    monitor_clear();
+                    break;
+                case '7': // 保存光标
+                    st->save_x = x;
+                    st->save_y = y;
+                    break;
+                case '8':
+                    move_cursor_to(st->save_x, st->save_y);
+                    break;
+                case 'D': // 下移一行，到底就滚
+                    index_down(st, x, y);
+                    break;
+                case 'E': // 下一行开头
+                    index_down(st, 1, y);
+                    break;
+                case 'M': // 上移一行，到顶就往下滚
+                    index_up(st, x, y);
+                    break;
+                default: // 别的单字符序列（字符集选择等）都不支持
+                    break;
             }
-            int eflags = load_eflags();
-            asm("cli");
-            // strlen(\e[80;25R) = 8
-            char s[10] = {0};
-            int len = sprintf(s, "\x1b[%d;%dR", cursor_x, cursor_y);
-            for (int i = 0; i < len; i++) fifo_put(&decoded_key, s[i]);
-            store_eflags(eflags);
+            return 1;
         }
-        case 'm': {
-            for (int i = 0; i <= param_idx; i++) {
-                switch (param_arr[i]) {
-                    case 0:
-                        fore = 7; back = 0; fore_brighten = true;
-                        break;
-                    case 7: {
-                        int t = fore; fore = back; back = t;
-                        break;
-                    }
-                    case 30: case 31:
-                    case 32: case 33:
-                    case 34: case 35:
-                    case 36: case 37:
-                        fore = param_arr[i]; fore_brighten = false;
-                        break;
-                    case 39:
-                        fore = 7; fore_brighten = true;
-                        break;
-                    case 40: case 41:
-                    case 42: case 43:
-                    case 44: case 45:
-                    case 46: case 47:
-                        back = param_arr[i];
-                        break;
-                    case 49:
-                        back = 0;
-                        break;
-                    case 90: case 91:
-                    case 92: case 93:
-                    case 94: case 95:
-                    case 96: case 97:
-                        fore = param_arr[i]; fore_brighten = true;
-                        break;
-                }
-                set_color(fore, back, fore_brighten);
+        case ANSI_CSI:
+            if (c >= '0' && c <= '9') {
+                if (st->nparams == 0) st->nparams = 1; // 第一个参数开始了
+                int *p = &st->params[st->nparams - 1];
+                if (*p < ANSI_PARAM_MAX) *p = *p * 10 + c - '0';
+            } else if (c == ';') {
+                if (st->nparams == 0) st->nparams = 1; // \033[;5H，第一个参数是空的
+                if (st->nparams < ANSI_MAX_PARAMS) st->params[st->nparams++] = 0; // 多出来的参数丢掉
+            } else if (c == '?' || c == '>' || c == '=') {
+                st->private = true;
+            } else if (c >= 0x40 && c <= 0x7e) { // 结束字母
+                st->state = ANSI_NORMAL;
+                csi_dispatch(st, c);
+            } else if (c < 0x20) { // 序列中间的控制字符照常执行
+                return 0;
             }
-        }
+            // 0x20~0x2f的中间字节不支持，忽略
+            return 1;
     }
-    return ansi - esc_start; // 返回esc以后的全部字符数
-}
\ No newline at end of file
+    return 0;
+}
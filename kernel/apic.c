@@ -0,0 +1,208 @@
+#include "drivers/apic.h"
+#include "drivers/acpi.h"
+#include "drivers/gdtidt.h"
+#include "drivers/isr.h"
+#include "monios/monitor.h"
+
+#define IA32_APIC_BASE_MSR 0x1B
+#define APIC_BASE_ENABLE   0x800
+#define CALIBRATE_MS 10
+#define PIT_HZ 1193182
+
+extern void apic_spurious_handler();
+
+static volatile uint32_t *lapic;
+static volatile uint32_t *ioapic;
+static int enabled = 0;
+static uint32_t timer_hz = 0;
+static uint8_t isa_pin[16]; // ISA的IRQ接在I/O APIC的第几个引脚
+static uint32_t isa_flags[16]; // 重定向表项低32位里除了向量和屏蔽位以外的部分
+static int ioapic_pins;
+
+uint32_t lapic_read(uint32_t reg)
+{
+    return lapic[reg / 4];
+}
+
+void lapic_write(uint32_t reg, uint32_t value)
+{
+    lapic[reg / 4] = value;
+}
+
+uint8_t lapic_id()
+{
+    return lapic_read(LAPIC_ID) >> 24;
+}
+
+static uint32_t ioapic_read(uint8_t reg)
+{
+    ioapic[IOAPIC_REGSEL / 4] = reg;
+    return ioapic[IOAPIC_WIN / 4];
+}
+
+static void ioapic_write(uint8_t reg, uint32_t value)
+{
+    ioapic[IOAPIC_REGSEL / 4] = reg;
+    ioapic[IOAPIC_WIN / 4] = value;
+}
+
+static int cpu_has_apic()
+{
+    uint32_t eax = 1, ebx, ecx, edx;
+    asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    return (edx >> 9) & 1;
+}
+
+static void lapic_enable(uint32_t base)
+{
+    uint32_t lo, hi;
+    asm volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(IA32_APIC_BASE_MSR));
+    lo = (lo & 0xFFF) | (base & 0xFFFFF000) | APIC_BASE_ENABLE;
+    asm volatile("wrmsr" : : "a"(lo), "d"(hi), "c"(IA32_APIC_BASE_MSR));
+}
+
+// 每个CPU的LAPIC都要这样设一遍，寄存器是各自的
+static void lapic_setup()
+{
+    lapic_enable(acpiMadt.lapicAddress);
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | LAPIC_SPURIOUS_VECTOR);
+    lapic_write(LAPIC_TPR, 0); // 什么都不挡，优先级由irq_handler管
+    lapic_write(LAPIC_LVT_LINT0, LAPIC_LVT_MASKED); // LINT0接的是8259，已经不用了
+    lapic_write(LAPIC_LVT_ERROR, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_ESR, 0);
+    lapic_write(LAPIC_EOI, 0); // 万一有没应答的中断
+}
+
+// PIT的通道2不产生中断，关着中断也能用来计时；方式0：数到0时OUT变高
+static void pit_oneshot(uint32_t count)
+{
+    outb(0x61, (inb(0x61) & ~0x02) & ~0x01); // 关扬声器，门控先拉低
+    outb(0x43, 0xB0); // 通道2，先低后高，方式0
+    outb(0x42, count & 0xFF);
+    outb(0x42, count >> 8);
+    outb(0x61, inb(0x61) | 0x01); // 门控拉高，开始数
+}
+
+static void pit_wait()
+{
+    while (!(inb(0x61) & 0x20)); // 第5位是通道2的OUT
+}
+
+// 用PIT数10ms，看LAPIC定时器（16分频）走了多少
+static uint32_t timer_calibrate()
+{
+    lapic_write(LAPIC_TIMER_DIV, 0x3); // 16分频
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_TIMER_INIT, 0xFFFFFFFF);
+    pit_oneshot(PIT_HZ * CALIBRATE_MS / 1000);
+    pit_wait();
+    uint32_t elapsed = 0xFFFFFFFF - lapic_read(LAPIC_TIMER_COUNT);
+    lapic_write(LAPIC_TIMER_INIT, 0);
+    return elapsed * (1000 / CALIBRATE_MS);
+}
+
+void apic_delay_us(uint32_t us)
+{
+    while (us) {
+        uint32_t n = us > 50000 ? 50000 : us; // 16位计数器最多数55ms
+        pit_oneshot(n * (PIT_HZ / 1000) / 1000);
+        pit_wait();
+        us -= n;
+    }
+}
+
+static void ioapic_route(int irq, uint8_t dest, int masked)
+{
+    int pin = isa_pin[irq];
+    ioapic_write(IOAPIC_REDTBL + 2 * pin + 1, (uint32_t) dest << 24); // 物理目的模式，发给dest这个LAPIC
+    ioapic_write(IOAPIC_REDTBL + 2 * pin, isa_flags[irq] | (IRQ0 + irq) | (masked ? IOAPIC_MASKED : 0));
+}
+
+int apic_init()
+{
+    if (enabled) return 0;
+    if (!cpu_has_apic() || acpiInit() == -1 || !acpiMadt.lapicAddress || !acpiMadt.ioapicAddress) return -1;
+    lapic = (volatile uint32_t *) pa2va(acpiMadt.lapicAddress);
+    ioapic = (volatile uint32_t *) pa2va(acpiMadt.ioapicAddress);
+    ioapic_pins = ((ioapic_read(IOAPIC_VER) >> 16) & 0xFF) + 1;
+    for (int irq = 0; irq < 16; irq++) {
+        uint32_t gsi = acpiMadt.isaGsi[irq] - acpiMadt.ioapicGsiBase;
+        if (gsi >= (uint32_t) ioapic_pins) return -1; // 不在这个I/O APIC上，还是用PIC稳妥
+        isa_pin[irq] = gsi;
+        isa_flags[irq] = 0;
+        if ((acpiMadt.isaFlags[irq] & MADT_POLARITY_MASK) == MADT_POLARITY_LOW) isa_flags[irq] |= IOAPIC_ACTIVE_LOW;
+        if ((acpiMadt.isaFlags[irq] & MADT_TRIGGER_MASK) == MADT_TRIGGER_LEVEL) isa_flags[irq] |= IOAPIC_LEVEL;
+    }
+
+    asm("cli");
+    outb(0x21, 0xFF); // 8259全部屏蔽，以后中断只从I/O APIC来
+    outb(0xA1, 0xFF);
+    outb(0x22, 0x70); // IMCR：有的老主板上要把中断线从PIC切到APIC
+    outb(0x23, 0x01);
+
+    idt_set_gate(LAPIC_SPURIOUS_VECTOR, (uint32_t) apic_spurious_handler, 0x08, 0x8E);
+    lapic_setup();
+
+    timer_hz = timer_calibrate();
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED | IRQ0);
+
+    uint8_t dest = lapic_id();
+    for (int irq = 1; irq < 16; irq++) {
+        if (irq == 2) continue; // 级联线，APIC下不存在
+        ioapic_route(irq, dest, 0);
+    }
+    ioapic_route(0, dest, 1); // PIT不用了，IRQ0由LAPIC定时器产生
+    enabled = 1;
+    monitor_printf("apic: %d CPU(s), LAPIC timer %d kHz, I/O APIC %d pins\n", acpiMadt.cpuCount, timer_hz / 1000, ioapic_pins);
+    return 0;
+}
+
+void apic_ap_init()
+{
+    lapic_setup();
+}
+
+int apic_enabled() { return enabled; }
+uint32_t apic_timer_hz() { return timer_hz; }
+
+void apic_eoi()
+{
+    lapic[LAPIC_EOI / 4] = 0;
+}
+
+void apic_mask_irq(int irq)
+{
+    if (!irq) {
+        lapic_write(LAPIC_LVT_TIMER, lapic_read(LAPIC_LVT_TIMER) | LAPIC_LVT_MASKED);
+        return;
+    }
+    int pin = isa_pin[irq];
+    ioapic_write(IOAPIC_REDTBL + 2 * pin, ioapic_read(IOAPIC_REDTBL + 2 * pin) | IOAPIC_MASKED);
+}
+
+void apic_unmask_irq(int irq)
+{
+    if (!irq) {
+        lapic_write(LAPIC_LVT_TIMER, lapic_read(LAPIC_LVT_TIMER) & ~LAPIC_LVT_MASKED);
+        return;
+    }
+    int pin = isa_pin[irq];
+    ioapic_write(IOAPIC_REDTBL + 2 * pin, ioapic_read(IOAPIC_REDTBL + 2 * pin) & ~IOAPIC_MASKED);
+}
+
+uint32_t apic_timer_start(uint32_t freq)
+{
+    uint32_t count = timer_hz / freq;
+    if (!count) count = 1;
+    lapic_write(LAPIC_TIMER_DIV, 0x3);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_PERIODIC | IRQ0);
+    lapic_write(LAPIC_TIMER_INIT, count); // 写初值就开始数，数到0重新装入并触发中断
+    return timer_hz / count;
+}
+
+void apic_send_ipi(uint8_t apic_id, uint32_t icr)
+{
+    lapic_write(LAPIC_ICR_HIGH, (uint32_t) apic_id << 24);
+    lapic_write(LAPIC_ICR_LOW, icr); // 写低32位就发出去了
+    while (lapic_read(LAPIC_ICR_LOW) & APIC_ICR_PENDING) asm volatile("pause");
+}
@@ -22,25 +22,28 @@ void ldt_set_gate(int32_t num, uint32_t base, uint32_t limit, uint16_t ar)
     task->ldt[num].access_right = ar & 0xFF; // ar部分只能存低4位了
 }
 
-static void expand_user_segment(int increment)
+// 成功返回0；内存不够时返回-1，原来的段原封不动
+static int expand_user_segment(int increment)
 {
     task_t *task = task_now();
-    if (!task->is_user) return; // 内核都打满4GB了还需要扩容？
+    if (!task->is_user) return -1; // 内核都打满4GB了还需要扩容？
     gdt_entry_t *segment = &task->ldt[1];
     // 接下来把base和limit的石块拼出来
     uint32_t base = segment->base_low | (segment->base_mid << 16) | (segment->base_high << 24); // 其实可以不用拼直接用ds_base 但还是拼一下吧当练习
     uint32_t size = segment->limit_low | ((segment->limit_high & 0x0F) << 16);
-    if (segment->limit_high & 0x80) size *= 0x1000;
+    if (segment->limit_high & 0x80) size = (size << 12) | 0xfff; // G位为1时段上限以4KB为单位，低12位全为1
     size++;
+    if (increment <= 0) return -1; // expand是扩容你缩水是几个意思
     // 分配新的内存
     void *new_base = (void *) kmalloc(size + increment + 5);
-    if (increment > 0) return; // expand是扩容你缩水是几个意思
+    if (!new_base) return -1;
     memcpy(new_base, (void *) base, size); // 原来的内容全复制进去
     // 用户进程的base必然由malloc分配，故用free释放之
     kfree((void *) base);
     // 那么接下来就是把new_base设置成新的段了
     ldt_set_gate(1, (int) new_base, size + increment - 1, 0x4092 | 0x60); // 反正只有数据段允许扩容我也就设置成数据段算了
     task->ds_base = (int) new_base; // 既然ds_base变了task里的应该同步更新
+    return 0;
 }
 
 void *sys_sbrk(int incr)
@@ -48,11 +51,12 @@ void *sys_sbrk(int incr)
     task_t *task = task_now();
     if (task->is_user) { // 是应用程序
         if (task->brk_start + incr > task->brk_end) { // 如果超出已有缓冲区
-            expand_user_segment(incr + 32 * 1024); // 再多扩展32KB
+            if (expand_user_segment(incr + 32 * 1024) == -1) return (void *) -1; // 再多扩展32KB；扩不了就什么都不动，段上限还是原来的
             task->brk_end += incr + 32 * 1024; // 由于扩展了32KB，同步将brk_end移到现在的数据段结尾
         }
         void *ret = task->brk_start; // 旧的program break
         task->brk_start += incr; // 直接添加就完事了
+        if ((uint32_t) task->brk_start > task->stats.mem_peak) task->stats.mem_peak = (uint32_t) task->brk_start; // 记下内存用量的峰值
         return ret; // 返回之
     }
     return NULL; // 非用户不允许使用sbrk
@@ -85,6 +89,7 @@ void app_entry(const char *app_name, const char *cmdline, const char *work_dir)
     task_now()->ds_base = (int) ds; // 设置ds基址
     ldt_set_gate(0, (int) code, last - first - 1, 0x409a | 0x60);
     ldt_set_gate(1, (int) ds, last - first + 4 * 1024 * 1024 + 1 * 1024 * 1024 - 1, 0x4092 | 0x60);
+    kernel_unlock(); // 回用户态就不在内核里了，这一层是task_bootstrap拿的
     start_app(entry, 0 * 8 + 4, new_esp, 1 * 8 + 4, &(task_now()->tss.esp0));
     while (1);
 }
@@ -95,6 +100,7 @@ int sys_create_process(const char *app_name, const char *cmdline, const char *wo
     if (fd == -1) return -1;
     sys_close(fd);
     task_t *new_task = create_kernel_task(app_entry);
+    task_set_name(new_task, app_name[0] == '/' ? app_name + 1 : app_name); // 名字里不要开头的/
     new_task->tss.esp -= 12;
     *((int *) (new_task->tss.esp + 4)) = (int) app_name;
     *((int *) (new_task->tss.esp + 8)) = (int) cmdline;
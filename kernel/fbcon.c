@@ -0,0 +1,147 @@
+#include "monios/fbcon.h"
+#include "monios/monitor.h"
+#include "drivers/vbe.h"
+#include "drivers/screen.h"
+
+#define CELL_INVALID 0xFFFFFFFF // 不知道这格画的是什么，下次一定重画
+
+// VGA文本模式的16色
+static const uint32_t palette[16] = {
+    0x000000, 0x0000AA, 0x00AA00, 0x00AAAA, 0xAA0000, 0xAA00AA, 0xAA5500, 0xAAAAAA,
+    0x555555, 0x5555FF, 0x55FF55, 0x55FFFF, 0xFF5555, 0xFF55FF, 0xFFFF55, 0xFFFFFF,
+};
+
+static uint8_t font[256 * FBCON_FONT_H]; // 从VGA字库里读出来的8x16点阵，每个字符16字节，一字节一行
+static int font_loaded = 0;
+// 展开好的字形：每种属性（前景色+背景色）一张表，点阵里一行的8个位有256种可能，每种对应8个现成的像素
+// 画一行字形就是拷8个32位数；整字展开要256种属性*256个字符*512字节，太大了，按行展开只要8KB一张，用到才分配
+static uint32_t *expanded[256];
+static uint32_t *drawn; // 每个格子上次画的内容，和cells格式一样
+static int fb_cols, fb_rows, pitch; // pitch是后备缓冲区每行多少个像素
+static int cur_x, cur_y = -1; // 光标画在哪一格
+static int active = 0;
+
+static inline void copy32(uint32_t *dst, const uint32_t *src, int n)
+{
+    asm volatile("rep movsl" : "+D"(dst), "+S"(src), "+c"(n) : : "memory");
+}
+
+static uint32_t *glyph_table(uint8_t attr)
+{
+    if (expanded[attr]) return expanded[attr];
+    uint32_t *table = (uint32_t *) kmalloc(256 * FBCON_FONT_W * sizeof(uint32_t));
+    if (!table) return NULL;
+    uint32_t fore = palette[attr & 0x0F], back = palette[(attr >> 4) & 0x0F];
+    for (int bits = 0; bits < 256; bits++) {
+        for (int i = 0; i < FBCON_FONT_W; i++) table[bits * FBCON_FONT_W + i] = bits & (0x80 >> i) ? fore : back; // 最高位在最左边
+    }
+    expanded[attr] = table;
+    return table;
+}
+
+// 画一格，不标脏；光标在这一格就在最下面两行画一道下划线
+static void draw_cell(int x, int y, uint16_t cell)
+{
+    uint32_t *table = glyph_table(cell >> 8);
+    if (!table) return;
+    const uint8_t *glyph = font + (cell & 0xFF) * FBCON_FONT_H;
+    uint32_t *dst = vbe_backbuffer() + y * FBCON_FONT_H * pitch + x * FBCON_FONT_W;
+    for (int r = 0; r < FBCON_FONT_H; r++, dst += pitch) copy32(dst, table + glyph[r] * FBCON_FONT_W, FBCON_FONT_W);
+    if (x == cur_x && y == cur_y) {
+        uint32_t *line = table + 0xFF * FBCON_FONT_W; // 全是前景色
+        copy32(dst - 2 * pitch, line, FBCON_FONT_W);
+        copy32(dst - pitch, line, FBCON_FONT_W);
+    }
+}
+
+static void invalidate()
+{
+    for (int i = 0; i < fb_cols * fb_rows; i++) drawn[i] = CELL_INVALID;
+}
+
+int fbcon_enable(int width, int height)
+{
+    if (!font_loaded && !vbe_enabled()) { // 字库只在文本模式下读得到
+        vga_read_font(font);
+        font_loaded = 1;
+    }
+    if (!font_loaded) return -1;
+    if (!drawn) drawn = (uint32_t *) kmalloc(CON_MAX_COLS * CON_MAX_ROWS * sizeof(uint32_t));
+    if (!drawn) return -1;
+    active = 0; // vbe_init里会先回一次文本模式，这时候别画
+    if (vbe_init(width, height) == -1) return -1;
+    pitch = vbe_width();
+    fb_cols = width / FBCON_FONT_W;
+    fb_rows = height / FBCON_FONT_H;
+    if (fb_cols > CON_MAX_COLS) fb_cols = CON_MAX_COLS;
+    if (fb_rows > CON_MAX_ROWS) fb_rows = CON_MAX_ROWS;
+    invalidate();
+    cur_y = -1;
+    active = 1;
+    monitor_use_framebuffer(fb_cols, fb_rows); // 控制台改尺寸，整屏重画
+    return 0;
+}
+
+void fbcon_disable()
+{
+    if (!active) return;
+    active = 0;
+    monitor_use_framebuffer(0, 0);
+    vbe_disable(); // 会让monitor整屏重画文本模式
+}
+
+int fbcon_enabled() { return active; }
+
+void fbcon_scroll(int lines)
+{
+    if (!active || !vbe_enabled()) return;
+    if (lines >= fb_rows) { // 滚过一整屏了，没什么可留的
+        invalidate();
+        return;
+    }
+    fbcon_set_cursor(cur_x, -1); // 光标不能跟着内容一起滚上去
+    int row_pixels = FBCON_FONT_H * pitch;
+    uint32_t *back = vbe_backbuffer();
+    memmove(back, back + lines * row_pixels, (fb_rows - lines) * row_pixels * sizeof(uint32_t));
+    memmove(drawn, drawn + lines * fb_cols, (fb_rows - lines) * fb_cols * sizeof(uint32_t));
+    for (int i = (fb_rows - lines) * fb_cols; i < fb_rows * fb_cols; i++) drawn[i] = CELL_INVALID; // 底下空出来的行下面会重画
+    vbe_mark_dirty(0, 0, fb_cols * FBCON_FONT_W, fb_rows * FBCON_FONT_H);
+}
+
+void fbcon_draw_row(int y, const uint16_t *cells)
+{
+    if (!active || !vbe_enabled() || y >= fb_rows) return;
+    uint32_t *d = drawn + y * fb_cols;
+    int x0 = -1, x1 = 0;
+    for (int x = 0; x < fb_cols; x++) {
+        if (d[x] == cells[x]) continue; // 只改了一两个字的行，大部分格子都不用画
+        draw_cell(x, y, cells[x]);
+        d[x] = cells[x];
+        if (x0 < 0) x0 = x;
+        x1 = x;
+    }
+    if (x0 >= 0) vbe_mark_dirty(x0 * FBCON_FONT_W, y * FBCON_FONT_H, (x1 - x0 + 1) * FBCON_FONT_W, FBCON_FONT_H);
+}
+
+// 擦掉旧光标就是按记下的内容把那一格重画一遍
+void fbcon_set_cursor(int x, int y)
+{
+    if (!active || !vbe_enabled() || (x == cur_x && y == cur_y)) return;
+    if (x >= fb_cols) x = fb_cols - 1;
+    int old_x = cur_x, old_y = cur_y;
+    cur_x = x;
+    cur_y = y;
+    if (old_y >= 0 && old_y < fb_rows && drawn[old_y * fb_cols + old_x] != CELL_INVALID) {
+        draw_cell(old_x, old_y, drawn[old_y * fb_cols + old_x]);
+        vbe_mark_dirty(old_x * FBCON_FONT_W, old_y * FBCON_FONT_H, FBCON_FONT_W, FBCON_FONT_H);
+    }
+    if (y >= 0 && y < fb_rows && drawn[y * fb_cols + x] != CELL_INVALID) { // 还没画过的格子画的时候自己会带上光标
+        draw_cell(x, y, drawn[y * fb_cols + x]);
+        vbe_mark_dirty(x * FBCON_FONT_W, y * FBCON_FONT_H, FBCON_FONT_W, FBCON_FONT_H);
+    }
+}
+
+void fbcon_present()
+{
+    if (active) vbe_present();
+}
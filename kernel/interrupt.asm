@@ -57,7 +57,7 @@ section .data
 %macro IRQ 1
 section .text
 irq%1:
-    cli
+    ; 中断门进来时IF已经清了，什么时候再打开由irq_handler按优先级决定
     push byte 0
     push %1
     jmp irq_common_stub
@@ -86,6 +86,7 @@ section .text
 [extern irq_handler]
 ; 通用中断处理程序
 irq_common_stub:
+    cld ; 被打断的代码可能正设着DF（比如倒着拷的memmove），C代码默认DF=0
     pusha ; 存储所有寄存器
 
     mov ax, ds
@@ -116,6 +117,7 @@ section .text
 
 ; 通用中断处理程序
 isr_common_stub:
+    cld ; 被打断的代码可能正设着DF（比如倒着拷的memmove），C代码默认DF=0
     pusha ; 存储所有寄存器
 
     mov ax, ds
@@ -140,23 +142,54 @@ isr_common_stub:
     add esp, 8 ; 弹出错误码和中断ID
     iret ; 从中断返回
 
-[extern syscall_manager]
+; 系统调用号在eax，参数依次在ebx ecx edx esi edi ebp
+[extern syscall_table]
+[extern syscall_count]
+[extern syscall_enter]
+[extern syscall_leave]
 [global syscall_handler]
 syscall_handler:
+    cld ; 应用程序进来时DF是什么都有可能
     sti
     push ds
     push es
-    pushad
-    pushad
+    pushad ; 返回值最后要写回这里保存的eax
 
+    push ebp ; 按C调用约定把6个参数从右往左压栈
+    push edi
+    push esi
+    push edx
+    push ecx
+    push ebx
+
+    mov ecx, eax ; ecx已经压栈，可以随便用了
     mov ax, 0x10 ; 新增
     mov ds, ax   ; 新增
     mov es, ax   ; 新增
 
-    call syscall_manager
-
-    add esp, 32
+    push ecx
+    push ecx
+    call syscall_enter ; 记账和跟踪，会破坏eax ecx edx
+    add esp, 4
+    pop ecx
+
+    mov eax, -1 ; 调用号不合法时的返回值
+    cmp ecx, [syscall_count]
+    jae .done ; 无符号比较，负数也会被挡住
+    call [syscall_table + ecx * 4] ; 查表调用
+.done:
+    push eax
+    push eax
+    call syscall_leave
+    add esp, 4
+    pop eax
+    add esp, 24 ; 丢掉6个参数
+    mov [esp + 28], eax ; pushad中eax在最上面，距栈顶7个寄存器
     popad
     pop es
     pop ds
-    iretd
\ No newline at end of file
+    iretd
+; LAPIC的假中断：不用发EOI，什么都不做直接返回
+[global apic_spurious_handler]
+apic_spurious_handler:
+    iret
@@ -1,31 +1,230 @@
 #include "monios/monitor.h"
 #include "drivers/isr.h"
 #include "drivers/mtask.h"
+#include "monios/trace.h"
+#include "drivers/apic.h"
 
-static isr_t interrupt_handlers[256];
+#define PIC1_CMD  0x20
+#define PIC1_DATA 0x21
+#define PIC2_CMD  0xA0
+#define PIC2_DATA 0xA1
+#define PIC_EOI   0x20
+#define PIC_READ_ISR 0x0B
 
+// 一个中断号上挂的处理程序串成链表，节点从静态的池子里分，注册可能发生在内存管理初始化之前
+typedef struct IRQ_ACTION {
+    isr_t handler;
+    struct IRQ_ACTION *next;
+} irq_action_t;
+
+extern taskctl_t *taskctl;
+
+static irq_action_t action_pool[MAX_IRQ_ACTIONS];
+static int nactions = 0;
+static irq_action_t *interrupt_handlers[256];
+
+static irq_stat_t irq_stats[NR_IRQS];
+static uint32_t spurious = 0;
+static uint64_t stat_start = 0;
+
+// 8259的优先级：IRQ0最高，然后IRQ1，IRQ8~15（接在IRQ2上），最后IRQ3~7；用APIC时也沿用这个顺序
+// 处理某个IRQ的时候把它自己和比它低的都屏蔽掉，再开中断，这样只有更高优先级的能嵌套进来
+static const uint8_t irq_rank[NR_IRQS] = {0, 1, 2, 11, 12, 13, 14, 15, 3, 4, 5, 6, 7, 8, 9, 10};
+static uint16_t lower_mask[NR_IRQS]; // 处理第i个IRQ时要屏蔽哪些
+static uint16_t irq_mask = 0; // 现在屏蔽着的IRQ，嵌套时一层层叠上去
+static uint16_t irq_deferred = 0; // APIC下来了但被irq_mask挡住、已经在I/O APIC上关掉的IRQ
+static int irq_depth = 0;
+static volatile int resched = 0;
+static uint64_t child_cycles = 0; // 嵌套进来的中断一共花了多久，外层要从自己的时间里减掉
+
+static inline uint64_t rdtsc()
+{
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t) hi << 32) | lo;
+}
+
+static void pic_set_mask(uint16_t mask)
+{
+    outb(PIC1_DATA, mask & 0xFF);
+    outb(PIC2_DATA, mask >> 8);
+}
+
+static void init_irq_masks()
+{
+    for (int i = 0; i < NR_IRQS; i++) {
+        lower_mask[i] = 0;
+        for (int j = 0; j < NR_IRQS; j++) {
+            if (irq_rank[j] >= irq_rank[i] && j != 2) lower_mask[i] |= 1 << j; // IRQ2是级联，屏蔽了从片就全没了
+        }
+    }
+    stat_start = rdtsc();
+}
+
+static const char *exception_names[32] = {
+    "divide error", "debug", "NMI", "breakpoint", "overflow", "bound range exceeded", "invalid opcode", "device not available",
+    "double fault", "coprocessor segment overrun", "invalid TSS", "segment not present", "stack-segment fault", "general protection fault", "page fault", "reserved",
+    "x87 floating-point exception", "alignment check", "machine check", "SIMD floating-point exception", "virtualization exception", "control protection exception", "reserved", "reserved",
+    "reserved", "reserved", "reserved", "reserved", "hypervisor injection exception", "VMM communication exception", "security exception", "reserved",
+};
+
+// 应用程序出错只杀掉它自己；内核出错说明内核的状态已经不可信了，打出现场停机
 void isr_handler(registers_t regs)
 {
     asm("cli");
-    monitor_write("received interrupt: ");
-    monitor_write_dec(regs.int_no);
-    monitor_put('\n');
-    task_exit(-1); // 强制退出
+    kernel_lock(); // 用户态来的异常要进内核处理，和系统调用一样
+    if (interrupt_handlers[regs.int_no]) { // 有人认领这个异常
+        for (irq_action_t *a = interrupt_handlers[regs.int_no]; a; a = a->next) a->handler(&regs);
+        kernel_unlock();
+        return;
+    }
+    const char *name = regs.int_no < 32 ? exception_names[regs.int_no] : "unknown interrupt";
+    if ((regs.cs & 3) == 3) {
+        task_t *task = task_now();
+        monitor_printf("%s (pid %d): %s at eip=0x%x, err=0x%x, killed\n", task->name, task_pid(task), name, regs.eip, regs.err_code);
+        task_exit(-1); // 强制退出
+    }
+    monitor_printf("\nkernel panic: %s (%d) err=0x%x\n", name, regs.int_no, regs.err_code);
+    monitor_printf("eip=0x%x cs=0x%x eflags=0x%x ds=0x%x\n", regs.eip, regs.cs, regs.eflags, regs.ds);
+    monitor_printf("eax=0x%x ebx=0x%x ecx=0x%x edx=0x%x\n", regs.eax, regs.ebx, regs.ecx, regs.edx);
+    monitor_printf("esi=0x%x edi=0x%x ebp=0x%x esp=0x%x\n", regs.esi, regs.edi, regs.ebp, regs.esp);
+    if (taskctl && taskctl->running) monitor_printf("task: %s (pid %d)\n", task_now()->name, task_pid(task_now()));
+    while (1) asm("cli; hlt");
+}
+
+// IRQ7和IRQ15可能是假的：8259的ISR里没有对应的位就不是真中断，IRQ15还得给主片发EOI
+static int is_spurious(int irq)
+{
+    if (irq != 7 && irq != 15) return 0;
+    int port = irq == 7 ? PIC1_CMD : PIC2_CMD;
+    outb(port, PIC_READ_ISR);
+    if (inb(port) & 0x80) return 0;
+    if (irq == 15) outb(PIC1_CMD, PIC_EOI);
+    spurious++;
+    return 1;
+}
+
+// 跑一遍irq的处理程序并记账；进来时关着中断，返回时也关着
+static void run_irq(int irq, registers_t *regs)
+{
+    uint16_t saved_mask = irq_mask;
+    irq_mask |= lower_mask[irq];
+    irq_stat_t *st = &irq_stats[irq];
+    if (irq_depth) st->nested++;
+    irq_depth++;
+    uint64_t child0 = child_cycles;
+    uint64_t t0 = rdtsc();
+    trace_event(TRACE_IRQ_ENTER, irq);
+    asm("sti"); // 更高优先级的IRQ可以嵌套进来了
+    for (irq_action_t *a = interrupt_handlers[IRQ0 + irq]; a; a = a->next) a->handler(regs); // 共享的线上每个设备都问一遍
+    asm("cli");
+    trace_event(TRACE_IRQ_EXIT, irq);
+    uint64_t elapsed = rdtsc() - t0;
+    uint32_t self = elapsed - (child_cycles - child0);
+    child_cycles = child0 + elapsed; // 对外层来说，这一整段都是嵌套进来的
+    st->count++;
+    st->cycles += self;
+    if (self > st->max_cycles) st->max_cycles = self;
+    irq_depth--;
+    irq_mask = saved_mask;
+    if (!apic_enabled()) pic_set_mask(irq_mask);
+}
+
+// 被推迟的IRQ里优先级最高的，没有返回-1
+static int next_deferred()
+{
+    uint16_t ready = irq_deferred & ~irq_mask;
+    int best = -1;
+    for (int i = 0; i < NR_IRQS; i++) {
+        if ((ready & (1 << i)) && (best < 0 || irq_rank[i] < irq_rank[best])) best = i;
+    }
+    return best;
 }
 
 void irq_handler(registers_t regs)
 {
-    if (regs.int_no >= 0x28) outb(0xA0, 0x20); // 中断号 >= 40，来自从片，发送EOI给从片
-    outb(0x20, 0x20); // 发送EOI给主片
+    int irq = regs.int_no - IRQ0;
+    if (cpu_id()) { // AP上只有自己的LAPIC定时器，设备中断都发给BSP；调度器有自己的锁，这里不进大内核锁
+        apic_eoi();
+        smp_tick();
+        task_switch();
+        return;
+    }
+    if (apic_enabled()) {
+        // APIC下屏蔽要写I/O APIC，比EOI还贵，所以先不屏蔽：马上EOI，真有同级或更低的赶上了，再关掉那条线，等外层处理完补上
+        apic_eoi();
+        if (irq_mask & (1 << irq)) {
+            apic_mask_irq(irq);
+            irq_deferred |= 1 << irq;
+            return;
+        }
+    } else {
+        if (is_spurious(irq)) return;
+        pic_set_mask(irq_mask | lower_mask[irq]); // 先屏蔽再发EOI，同级和更低的在处理完之前进不来
+        if (regs.int_no >= 0x28) outb(PIC2_CMD, PIC_EOI); // 中断号 >= 40，来自从片，发送EOI给从片
+        outb(PIC1_CMD, PIC_EOI); // 发送EOI给主片
+    }
 
-    if (interrupt_handlers[regs.int_no])
-    {
-        isr_t handler = interrupt_handlers[regs.int_no]; // 有自定义处理程序，调用之
-        handler(&regs); // 传入寄存器
+    kernel_lock(); // BSP可能是从用户态或idle进来的，这时候别的CPU可能正在内核里
+    run_irq(irq, &regs);
+    for (int i; (i = next_deferred()) >= 0; ) { // 只有APIC会推迟
+        irq_deferred &= ~(1 << i);
+        run_irq(i, &regs);
+        apic_unmask_irq(i);
     }
+
+    if (!irq_depth && resched) { // 最外层才切任务，切走时带着的只有这一层的栈
+        resched = 0;
+        task_switch(); // 时钟中断切走了的话，要等切回来才会从这里返回
+    }
+    kernel_unlock();
+}
+
+void irq_need_resched()
+{
+    resched = 1;
 }
 
 void register_interrupt_handler(uint8_t n, isr_t handler)
 {
-    interrupt_handlers[n] = handler;
-}
\ No newline at end of file
+    static int masks_ready = 0;
+    if (!masks_ready) {
+        init_irq_masks();
+        masks_ready = 1;
+    }
+    irq_action_t **p = &interrupt_handlers[n];
+    for (; *p; p = &(*p)->next) {
+        if ((*p)->handler == handler) return;
+    }
+    if (nactions == MAX_IRQ_ACTIONS) {
+        monitor_printf("register_interrupt_handler: too many handlers, %d dropped\n", n);
+        return;
+    }
+    irq_action_t *a = &action_pool[nactions++];
+    a->handler = handler;
+    a->next = NULL;
+    *p = a; // 挂在链表最后，先注册的先调用
+    if (n >= IRQ0 && n < IRQ0 + NR_IRQS) irq_stats[n - IRQ0].handlers++;
+}
+
+void irq_get_stat(int irq, irq_stat_t *st)
+{
+    asm("cli"); // 64位的cycles要一次读完
+    *st = irq_stats[irq];
+    asm("sti");
+}
+
+uint32_t irq_spurious() { return spurious; }
+uint64_t irq_stat_start() { return stat_start; }
+
+void irq_reset_stats()
+{
+    asm("cli");
+    for (int i = 0; i < NR_IRQS; i++) {
+        irq_stats[i].count = irq_stats[i].nested = irq_stats[i].max_cycles = 0;
+        irq_stats[i].cycles = 0;
+    }
+    spurious = 0;
+    stat_start = rdtsc();
+    asm("sti");
+}
@@ -8,6 +8,10 @@
 #include "shell.h"
 #include "drivers/cmos.h"
 #include "monios/fs/file.h"
+#include "monios/fs/fat16.h"
+#include "monios/fs/journal.h"
+#include "fsck.h"
+#include "monios/trace.h"
 #include <stdio.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -19,6 +23,10 @@
 #include "drivers/dma.h"
 #include "drivers/audio.h"
 #include "drivers/pit.h"
+#include "drivers/serial.h"
+#include "drivers/fw_cfg.h"
+#include "drivers/apic.h"
+#include "monios/smp.h"
 
 // 定义缺失的段选择子常量
 #define KERNEL_CODE_SELECTOR 0x08
@@ -47,12 +55,10 @@ typedef struct {
 } shell_state_t;
 
 static shell_state_t shell_state;
-// 函数声明
-int fat16_open_dir(fileinfo_t *finfo, const char *path);
-int fat16_read_dir(fileinfo_t *finfo, char *filename);
 // 在其他包含头文件后添加
 extern void set_vga_mode(void);
 extern void call_bios_int(void);
+extern void task_bootstrap(); // trampoline.asm
 // 任务创建函数
 task_t *create_kernel_task(void *entry, int privilege_level)
 {
@@ -71,7 +77,8 @@ task_t *create_kernel_task(void *entry, int privilege_level)
     }
     
     new_task->tss.esp = (uint32_t)stack_base + KERNEL_STACK_SIZE - sizeof(uint32_t);
-    new_task->tss.eip = (uint32_t)entry;
+    new_task->tss.eip = (uint32_t)task_bootstrap; // 先去拿大内核锁，再跳到entry
+    new_task->entry = entry;
 
     // 根据特权级设置段选择子
     uint16_t code_sel, data_sel;
@@ -106,7 +113,7 @@ task_t *create_kernel_task(void *entry, int privilege_level)
     new_task->tss.ss = data_sel;
     new_task->tss.fs = data_sel;
     new_task->tss.gs = data_sel;
-    new_task->tss.eflags = 0x202; // 中断使能
+    new_task->tss.eflags = 0x002; // 关着中断进task_bootstrap，拿到锁之后才开
     
     return new_task;
 }
@@ -252,6 +259,56 @@ static void get_rtc_date(char *buf, unsigned int size)
 
 
 
+// 执行一行命令，input_buffer里放的就是这一行
+static void run_command_line()
+{
+    // 跳过空行
+    if (shell_state.input_buffer[0] == '\0') return;
+    
+    // 备份原始命令
+    strncpy(shell_state.backup_buffer, shell_state.input_buffer, 
+           sizeof(shell_state.backup_buffer));
+    
+    // 解析命令
+    shell_state.argc = parse_command(shell_state.input_buffer, 
+                                   shell_state.arguments, ' ');
+    
+    // 执行命令
+    if (shell_state.argc > 0) {
+        execute_command(shell_state.argc, shell_state.arguments);
+    }
+}
+
+#define AUTORUN_MAX 4096
+
+// 启动参数里带了脚本（qemu -fw_cfg name=opt/monios/autorun,file=...）就一行一行执行，跑完关机
+// 无界面跑测试用，配合串口就能拿到全部输出
+static void run_autorun_script()
+{
+    static char script[AUTORUN_MAX];
+    int len = fw_cfg_read_file("opt/monios/autorun", script, AUTORUN_MAX - 1);
+    if (len <= 0) return; // 正常启动
+    script[len] = '\0';
+    printf("autorun: %d bytes\n", len);
+    char *line = script;
+    while (*line) {
+        char *end = line;
+        while (*end && *end != '\n') end++;
+        int n = end - line;
+        if (n > 0 && line[n - 1] == '\r') n--; // 脚本可能是CRLF
+        if (n > 0 && line[0] != '#' && n < (int) sizeof(shell_state.input_buffer)) {
+            memcpy(shell_state.input_buffer, line, n);
+            shell_state.input_buffer[n] = '\0';
+            display_prompt();
+            printf("%s\n", shell_state.input_buffer); // 回显，日志里才知道输出是哪条命令的
+            run_command_line();
+        }
+        line = *end ? end + 1 : end;
+    }
+    printf("autorun: done, powering off\n");
+    doPowerOff();
+}
+
 void shell_main()
 {
     // 显示欢迎信息
@@ -268,6 +325,7 @@ void shell_main()
              
     puts(welcome_msg);
     puts("Type 'help' for available commands\n");
+    run_autorun_script();
     
     // 主命令循环
     while (1) {
@@ -276,22 +334,7 @@ void shell_main()
         // 读取命令
         memset(shell_state.input_buffer, 0, sizeof(shell_state.input_buffer));
         read_command_line(shell_state.input_buffer, sizeof(shell_state.input_buffer));
-        
-        // 跳过空行
-        if (shell_state.input_buffer[0] == '\0') continue;
-        
-        // 备份原始命令
-        strncpy(shell_state.backup_buffer, shell_state.input_buffer, 
-               sizeof(shell_state.backup_buffer));
-        
-        // 解析命令
-        shell_state.argc = parse_command(shell_state.input_buffer, 
-                                       shell_state.arguments, ' ');
-        
-        // 执行命令
-        if (shell_state.argc > 0) {
-            execute_command(shell_state.argc, shell_state.arguments);
-        }
+        run_command_line();
     }
 }
 
@@ -299,15 +342,20 @@ void shell_main()
 void kernel_main()
 {   
     
+    kernel_lock(); // 启动线程一直在内核里，AP起来以后也只能等它切走才能进内核
         // 初始化硬件和核心组件
     monitor_clear();
+    serial_init(); // 越早越好，后面的输出都会抄到COM1
     monitor_printf("Initializing kernel...\n");
+    setvbuf(stdout, NULL, _IONBF, 0); // 内核里的printf要马上显示，shell回显也靠它，不缓冲
     
     // 首先初始化中断控制器
     //init_pic();
     
     init_gdtidt();
     init_memory();
+    if (apic_init() == -1) monitor_printf("apic: not available, using 8259 PIC\n"); // 要在init_timer之前，定时器跟着中断控制器走
+    console_init(); // 虚拟控制台的历史缓冲区和键盘队列，键盘驱动要用
     init_timer(100); // 100 Hz 定时器
     init_keyboard();
     
@@ -334,6 +382,14 @@ void kernel_main()
     // 初始化任务系统
     task_init();
     monitor_printf("Task system initialized\n");
+    smp_init(); // 要在trace_init之前，trace按CPU个数分配缓冲区
+    softirq_init(); // 键盘解码等中断下半部从这里开始执行
+
+    trace_init(); // 只分配缓冲区，trace on之后才开始记
+    journal_init(); // 上次没写回完的FAT/根目录改动在这里补上
+    fsck_report_t fsck_report;
+    int fs_problems = fat16_fsck(&fsck_report, 0); // 开机检查一遍，只报告不修复
+    if (fs_problems > 0) monitor_printf("fsck: %d problem(s) found, run fsck -r to repair\n", fs_problems);
     
     // 创建 shell 任务
     /* task_t *shell_task = create_kernel_task(shell_main, 2); // 用户级任务
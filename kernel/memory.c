@@ -1,6 +1,7 @@
 #include "monios/common.h"
 #include "drivers/memory.h"
 #include "log.h"
+#include "monios/spinlock.h"
 
 #define EFLAGS_AC_BIT 0x00040000
 #define CR0_CACHE_DISABLE 0x60000000
@@ -145,11 +146,15 @@ static int memman_free(memman_t *man, uint32_t addr, uint32_t size)
     return -1; // 失败
 }
 
+static spinlock_t memman_lock = SPINLOCK_INIT; // 不能指望调用的地方都拿着大内核锁
+
 void *kmalloc(uint32_t size)
 {
     uint32_t addr;
     memman_t *memman = (memman_t *) MEMMAN_ADDR;
+    uint32_t eflags = spin_lock_irqsave(&memman_lock);
     addr = memman_alloc(memman, size + 16); // 多分配16字节
+    spin_unlock_irqrestore(&memman_lock, eflags);
     memset((void *) addr, 0, size + 16);
     char *p = (char *) addr;
     if (p) {
@@ -168,7 +173,9 @@ void kfree(void *p)
         size = *((int *) q);
     }
     memman_t *memman = (memman_t *) MEMMAN_ADDR;
+    uint32_t eflags = spin_lock_irqsave(&memman_lock);
     memman_free(memman, (uint32_t) q, size + 16);
+    spin_unlock_irqrestore(&memman_lock, eflags);
     p = NULL;
     return;
 }
@@ -1,85 +1,299 @@
 #include "monios/monitor.h"
+#include "monios/fbcon.h"
 #include "stdarg.h"
+#include "format.h"
+#include "drivers/serial.h"
+#include "drivers/mtask.h"
+
+extern uint32_t load_eflags();
+extern void store_eflags(uint32_t);
+
+#define DIRTY_WORDS (CON_MAX_ROWS / 32)
+
+// 一个虚拟控制台：环形缓冲区里连续的rows行是屏幕，之前的history行是翻得回去的历史
+// 所有输出只写这里；只有显示在屏幕上的那个控制台，改过的行才会被monitor_flush刷到显存
+typedef struct CONSOLE {
+    uint16_t *cells; // nrows行，每行按CON_MAX_COLS个字符存，只用前cols个
+    int nrows;
+    int top; // 屏幕第0行在cells里是第几行
+    int history; // top之前有多少行历史有效
+    int view; // 往回翻了多少行，0表示看的是最新的内容
+    int cursor_x, cursor_y; // 光标位置
+    uint8_t attr; // 当前颜色
+    ansi_state_t ansi;
+    fifo_t keys; // 键盘只往前台控制台里放
+    uint32_t keybuf[CON_KEYBUF];
+} console_t;
 
-static uint16_t cursor_x = 0, cursor_y = 0; // 光标位置
 static uint16_t *video_memory = (uint16_t *) 0xB8000; // 一个字符占两个字节（字符本体+字符属性，即颜色等），因此用uint16_t
+static uint16_t boot_cells[CON_TEXT_ROWS * CON_MAX_COLS]; // console_init分配缓冲区之前，控制台0先用这个，没有历史
 
-static uint8_t attributeByte = (0 << 4) | (15 & 0x0F); // 黑底白字
+static console_t consoles[NR_CONSOLES] = {
+    [0] = { // 黑底白字
+        .cells = boot_cells, .nrows = CON_TEXT_ROWS, .attr = (0 << 4) | (15 & 0x0F),
+        .ansi = {.fore = 7, .bright = 1, .save_x = 1, .save_y = 1, .scroll_bottom = CON_TEXT_ROWS - 1},
+    },
+};
+static int fg = 0; // 屏幕上显示的是哪个控制台
+static int cols = CON_TEXT_COLS, rows = CON_TEXT_ROWS; // 屏幕现在多大，所有控制台都一样
+static int fb_mode = 0; // 为1时画到帧缓冲（kernel/fbcon.c），不再碰0xB8000
+static volatile uint32_t dirty_rows[DIRTY_WORDS]; // 第i位为1表示屏幕第i行要刷到显存
+static volatile int pending_scroll = 0; // 帧缓冲模式下，前台控制台上次flush之后整屏上滚了几行
+static int hw_cursor = -1; // 硬件光标现在在哪，没变就不用再写端口
+static int suspended = 0; // 切到图形模式时不能碰0xB8000，输出只进影子缓冲区
 
+extern taskctl_t *taskctl;
 
-void monitor_printf(const char *fmt, ...) {
-    va_list args;
-    va_start(args, fmt);
-    char buffer[256];
-    char *ptr = buffer;
-    
-    while (*fmt) {
-        if (*fmt == '%') {
-            fmt++;
-            switch (*fmt) {
-                case 'd': {
-                    int num = va_arg(args, int);
-                    char num_buf[32];
-                    char *nptr = num_buf;
-                    int i = 0;
-                    
-                    if (num < 0) {
-                        monitor_put('-');
-                        num = -num;
-                    }
-                    
-                    do {
-                        num_buf[i++] = '0' + (num % 10);
-                        num /= 10;
-                    } while (num > 0);
-                    
-                    while (--i >= 0) {
-                        monitor_put(num_buf[i]);
-                    }
-                    break;
-                }
-                case 'x': {
-                    uint32_t hex = va_arg(args, uint32_t);
-                    monitor_write_hex(hex);
-                    break;
-                }
-                case 's': {
-                    char *str = va_arg(args, char*);
-                    monitor_write(str);
-                    break;
-                }
-                case 'c': {
-                    char c = (char)va_arg(args, int);
-                    monitor_put(c);
-                    break;
-                }
-                default:
-                    monitor_put(*fmt);
-            }
+int console_current()
+{
+    if (!taskctl || !taskctl->running) return 0; // 任务系统还没起来，都算控制台0
+    return task_now()->console;
+}
+
+int console_foreground() { return fg; }
+int console_cols() { return cols; }
+int console_rows() { return rows; }
+
+fifo_t *console_keys(int con) { return &consoles[con].keys; }
+
+static inline console_t *out_console() // 当前任务的输出写到哪个控制台
+{
+    console_t *con = &consoles[console_current()];
+    return con->cells ? con : &consoles[0];
+}
+
+static inline uint16_t *screen_row(console_t *con, int y) // 屏幕第y行在cells里的位置，y为负就是历史
+{
+    int row = con->top + y;
+    while (row < 0) row += con->nrows;
+    while (row >= con->nrows) row -= con->nrows;
+    return con->cells + row * CON_MAX_COLS;
+}
+
+static inline void mark_dirty(console_t *con, int y) // 后台控制台不用记，切过去时会整屏重画
+{
+    if (con != &consoles[fg]) return;
+    y += con->view; // 往回翻着的时候，第y行显示在更下面
+    if (y < rows) dirty_rows[y >> 5] |= 1u << (y & 31);
+}
+
+static void set_all_dirty()
+{
+    for (int w = 0; w < DIRTY_WORDS; w++) {
+        int n = rows - w * 32; // 这个字里有几行在屏幕上
+        dirty_rows[w] = n >= 32 ? ~0u : n > 0 ? (1u << n) - 1 : 0;
+    }
+}
+
+static inline void mark_all_dirty(console_t *con)
+{
+    if (con == &consoles[fg]) set_all_dirty();
+}
+
+// 分配每个控制台的历史缓冲区，要在init_memory之后、init_keyboard之前调用
+// 按帧缓冲控制台最多能有的行数分配，切分辨率时不用重新分配
+void console_init()
+{
+    int nrows = CON_MAX_ROWS + CON_SCROLLBACK;
+    for (int i = 0; i < NR_CONSOLES; i++) {
+        console_t *con = &consoles[i];
+        fifo_init(&con->keys, CON_KEYBUF, con->keybuf);
+        if (i) ansi_reset(&con->ansi); // 控制台0可能已经在用了，不动它
+        uint16_t *cells = (uint16_t *) kmalloc(nrows * CON_MAX_COLS * sizeof(uint16_t));
+        if (!cells) continue; // 控制台0还能接着用boot_cells；其他的没有缓冲区，切不过去，输出也落到控制台0
+        if (i == 0) { // 开机到现在的输出搬过去
+            for (int y = 0; y < rows; y++) memcpy(cells + y * CON_MAX_COLS, screen_row(con, y), cols * sizeof(uint16_t));
         } else {
-            monitor_put(*fmt);
+            con->attr = (0 << 4) | (15 & 0x0F);
+            for (int k = 0; k < rows * CON_MAX_COLS; k++) cells[k] = 0x20 | (con->attr << 8);
         }
-        fmt++;
+        con->cells = cells;
+        con->nrows = nrows;
+        con->top = con->history = con->view = 0;
     }
+}
+
+// 切换前台控制台，只是换一个刷到显存的来源，下一次flush整屏重画
+void console_switch(int n)
+{
+    if (n < 0 || n >= NR_CONSOLES || n == fg || !consoles[n].cells) return;
+    fg = n;
+    pending_scroll = 0; // 帧缓冲上的内容整屏对比着重画，不用再滚
+    set_all_dirty();
+}
+
+// 前台控制台往回翻lines行（负数往前翻），0表示回到最新的内容
+void console_scroll(int lines)
+{
+    console_t *con = &consoles[fg];
+    int view = lines ? con->view + lines : 0;
+    if (view > con->history) view = con->history;
+    if (view < 0) view = 0;
+    if (view == con->view) return;
+    con->view = view;
+    pending_scroll = 0;
+    set_all_dirty();
+}
+
+// 格式化结果攒满一段就交给monitor_write
+// ANSI状态机跨调用保存状态，转义序列被切在两段之间也没关系
+static void console_sink_flush(format_sink_t *sink, int final)
+{
+    sink->buf[sink->len] = 0; // 最后1个字节总是留给\0的
+    monitor_write(sink->buf);
+    sink->len = 0;
+}
+
+int monitor_vprintf(const char *fmt, va_list ap)
+{
+    char buf[128];
+    format_sink_t sink = {buf, sizeof(buf), 0, 0, console_sink_flush, NULL};
+    return format(&sink, fmt, ap);
+}
+
+void monitor_printf(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    monitor_vprintf(fmt, args);
     va_end(args);
 }
 
-static void move_cursor() // 根据当前光标位置（cursor_x，cursor_y）移动光标
+static void move_cursor(console_t *con) // 根据前台控制台的光标位置移动硬件光标
 {
-    uint16_t cursorLocation = cursor_y * 80 + cursor_x; // 当前光标位置
+    int y = con->cursor_y + con->view;
+    uint16_t cursorLocation = y < rows ? y * CON_TEXT_COLS + con->cursor_x : rows * cols; // 往回翻到光标不在屏幕上了，就移到屏幕外面藏起来
+    if (cursorLocation == hw_cursor) return; // 没动，省下4次端口写
+    hw_cursor = cursorLocation;
     outb(0x3D4, 14); // 光标高8位
     outb(0x3D5, cursorLocation >> 8); // 写入
     outb(0x3D4, 15); // 光标低8位
     outb(0x3D5, cursorLocation); // 写入，由于value声明的是uint8_t，因此会自动截断
 }
 
-int get_cursor_pos() { return (cursor_x + 1) << 8 | (cursor_y + 1); }
+static void flush_text(console_t *con, uint32_t *dirty)
+{
+    for (int y = 0; y < rows; y++) {
+        if (dirty[y >> 5] & (1u << (y & 31))) memcpy(video_memory + y * CON_TEXT_COLS, screen_row(con, y - con->view), CON_TEXT_COLS * sizeof(uint16_t)); // 整行写，不读显存
+    }
+    move_cursor(con);
+}
+
+// 先把帧缓冲整体上滚，再只画内容变了的格子
+static void flush_framebuffer(console_t *con, uint32_t *dirty, int scroll)
+{
+    if (scroll) fbcon_scroll(scroll);
+    for (int y = 0; y < rows; y++) {
+        if (dirty[y >> 5] & (1u << (y & 31))) fbcon_draw_row(y, screen_row(con, y - con->view));
+    }
+    int y = con->cursor_y + con->view;
+    fbcon_set_cursor(con->cursor_x, y < rows ? y : -1);
+    fbcon_present();
+}
+
+// 把前台控制台改过的行刷到显存，再更新一次光标
+// 时钟中断里也会调用，整个过程关中断：帧缓冲模式下滚屏和画行的顺序不能被别的任务的输出打乱
+void monitor_flush()
+{
+    if (suspended && !fb_mode) return; // 改过的行都留着，恢复时一起刷
+    uint32_t eflags = load_eflags();
+    asm("cli");
+    console_t *con = &consoles[fg];
+    uint32_t dirty[DIRTY_WORDS];
+    for (int w = 0; w < DIRTY_WORDS; w++) {
+        dirty[w] = dirty_rows[w];
+        dirty_rows[w] = 0;
+    }
+    int scroll = pending_scroll;
+    pending_scroll = 0;
+    if (fb_mode) flush_framebuffer(con, dirty, scroll);
+    else flush_text(con, dirty);
+    store_eflags(eflags);
+}
+
+// 图形模式驱动切走/切回文本模式时调用，切回来以后显存里的内容不可信，整屏重画
+void monitor_suspend(int on)
+{
+    suspended = on;
+    if (!on) {
+        hw_cursor = -1;
+        set_all_dirty();
+        monitor_flush();
+    }
+}
+
+// 改变屏幕大小以后调整一个控制台：变高时先把历史拉回屏幕上，不够再在下面补空行；
+// 变矮时屏幕往下收，保证光标还在屏幕里
+static void resize_console(console_t *con, int old_cols, int old_rows)
+{
+    uint16_t blank = 0x20 | (con->attr << 8);
+    if (cols > old_cols) { // 多出来的列里是以前留下的东西，整个环都擦一遍
+        for (int y = 0; y < con->nrows; y++) {
+            uint16_t *row = con->cells + y * CON_MAX_COLS;
+            for (int x = old_cols; x < cols; x++) row[x] = blank;
+        }
+    }
+    if (rows > old_rows) {
+        int pull = rows - old_rows;
+        if (pull > con->history) pull = con->history;
+        con->top -= pull;
+        if (con->top < 0) con->top += con->nrows;
+        con->history -= pull;
+        con->cursor_y += pull;
+        for (int y = old_rows + pull; y < rows; y++) { // 这些是环里最老的历史，不要了
+            uint16_t *row = screen_row(con, y);
+            for (int x = 0; x < cols; x++) row[x] = blank;
+        }
+    } else if (con->cursor_y >= rows) {
+        int drop = con->cursor_y - rows + 1;
+        con->top = (con->top + drop) % con->nrows;
+        con->history += drop;
+        con->cursor_y -= drop;
+    }
+    if (con->history > con->nrows - rows) con->history = con->nrows - rows;
+    if (con->cursor_x >= cols) con->cursor_x = cols - 1;
+    con->view = 0;
+    con->ansi.scroll_top = 0; // 滚动区域是按原来的行数设的，作废
+    con->ansi.scroll_bottom = rows - 1;
+}
+
+// kernel/fbcon.c切到帧缓冲以后调用，cols为0表示回到VGA文本模式
+void monitor_use_framebuffer(int new_cols, int new_rows)
+{
+    int fb = new_cols != 0;
+    if (!fb) {
+        new_cols = CON_TEXT_COLS;
+        new_rows = CON_TEXT_ROWS;
+    }
+    if (new_cols > CON_MAX_COLS) new_cols = CON_MAX_COLS;
+    if (new_rows > CON_MAX_ROWS) new_rows = CON_MAX_ROWS;
+    if (new_rows > consoles[0].nrows) new_rows = consoles[0].nrows; // 控制台0还在用boot_cells
+    uint32_t eflags = load_eflags();
+    asm("cli");
+    int old_cols = cols, old_rows = rows;
+    cols = new_cols;
+    rows = new_rows;
+    fb_mode = fb;
+    for (int i = 0; i < NR_CONSOLES; i++) {
+        if (consoles[i].cells) resize_console(&consoles[i], old_cols, old_rows);
+    }
+    pending_scroll = 0;
+    hw_cursor = -1;
+    set_all_dirty();
+    store_eflags(eflags);
+    monitor_flush(); // 回文本模式时还没恢复显存，这里什么也不做，等monitor_suspend(0)整屏重画
+}
+int get_cursor_pos()
+{
+    console_t *con = out_console();
+    return (con->cursor_x + 1) << 8 | (con->cursor_y + 1);
+}
 
 void move_cursor_to(int new_x, int new_y)
 {
-    cursor_x = new_x - 1;
-    cursor_y = new_y - 1;
-    move_cursor();
+    console_t *con = out_console();
+    con->cursor_x = new_x - 1;
+    con->cursor_y = new_y - 1; // 硬件光标等flush时再动
 }
 
 void set_color(int fore, int back, int fore_brighten)
@@ -89,100 +303,184 @@ void set_color(int fore, int back, int fore_brighten)
     fore = ansicode2vgacode[fore];
     back = ansicode2vgacode[back];
     fore |= fore_brighten << 3;
-    attributeByte = (back << 4) | (fore & 0x0F);
+    out_console()->attr = (back << 4) | (fore & 0x0F);
 }
 
-int get_color() { return attributeByte; }
+int get_color() { return out_console()->attr; }
 
 void set_char_at(int x, int y, char ch)
 {
+    console_t *con = out_console();
     x--, y--;
-    uint16_t *location = video_memory + (y * 80 + x);
-    *location = ch | (attributeByte << 8);
+    if (x < 0 || x >= cols || y < 0 || y >= rows) return;
+    screen_row(con, y)[x] = ch | (con->attr << 8);
+    mark_dirty(con, y);
+}
+
+static void fill_row(uint16_t *row, int from, int to, uint16_t blank)
+{
+    for (int x = from; x <= to; x++) row[x] = blank;
 }
 
-// 文本控制台共80列，25行（纵列竖行），因此当y坐标不低于25时就要滚屏了
-static void scroll() // 滚屏
+// 整屏上滚一行：只挪环形缓冲区的起点，原来的第0行变成历史，最老的一行历史变成新的最后一行
+static void push_line(console_t *con)
 {
-    uint16_t blank = 0x20 | (attributeByte << 8); // 0x20 -> 空格这个字，attributeByte << 8 -> 属性位
+    uint16_t blank = 0x20 | (con->attr << 8); // 0x20 -> 空格这个字，attr << 8 -> 属性位
+    uint32_t eflags = load_eflags();
+    asm("cli"); // 挪环和记账要一起完成，不能让时钟中断里的flush看到一半
+    con->top = con->top + 1 == con->nrows ? 0 : con->top + 1;
+    fill_row(screen_row(con, rows - 1), 0, cols - 1, blank); // 最后一行用空格覆盖
+    if (con->history < con->nrows - rows) con->history++;
+    if (con->view && con->view < con->history) con->view++; // 正在往回翻，看到的内容保持不动，不用重画
+    else if (fb_mode && con == &consoles[fg] && !con->view) { // 帧缓冲整屏重画太贵，记下来flush时一次memmove
+        pending_scroll++;
+        for (int w = 0; w < DIRTY_WORDS; w++) { // 还没刷的行跟着内容一起往上挪一行
+            uint32_t below = w + 1 < DIRTY_WORDS ? dirty_rows[w + 1] & 1 : 0;
+            dirty_rows[w] = dirty_rows[w] >> 1 | below << 31;
+        }
+        mark_dirty(con, rows - 1);
+    }
+    else mark_all_dirty(con); // 每一行的内容都变了，文本模式下整屏拷一遍也只有4KB
+    store_eflags(eflags);
+}
 
-    if (cursor_y >= 25) // 控制台共25行，超过即滚屏
-    {
-        int i;
-        for (i = 0 * 80; i < 24 * 80; i++) video_memory[i] = video_memory[i + 80]; // 前24行用下一行覆盖
-        for (i = 24 * 80; i < 25 * 80; i++) video_memory[i] = blank; // 第25行用空格覆盖
-        cursor_y = 24; // 光标设置回24行
+// top~bottom行上滚n行（n为负就下滚），空出来的行填空格
+// 整屏上滚走push_line，滚出去的行进历史；只滚一部分（比如设了滚动区域）就在环里一行一行地搬
+static void scroll_lines(console_t *con, int top, int bottom, int n)
+{
+    uint16_t blank = 0x20 | (con->attr << 8);
+    if (top < 0) top = 0;
+    if (bottom > rows - 1) bottom = rows - 1;
+    if (top > bottom || !n) return;
+    int height = bottom - top + 1;
+    if (n >= height) n = height;
+    if (n <= -height) n = -height;
+    if (top == 0 && bottom == rows - 1 && n > 0) {
+        while (n--) push_line(con);
+        return;
+    }
+    if (n > 0) {
+        for (int y = top; y + n <= bottom; y++) memcpy(screen_row(con, y), screen_row(con, y + n), cols * sizeof(uint16_t));
+        for (int y = bottom - n + 1; y <= bottom; y++) fill_row(screen_row(con, y), 0, cols - 1, blank);
+    } else {
+        n = -n;
+        for (int y = bottom; y - n >= top; y--) memcpy(screen_row(con, y), screen_row(con, y - n), cols * sizeof(uint16_t));
+        for (int y = top; y < top + n; y++) fill_row(screen_row(con, y), 0, cols - 1, blank);
+    }
+    for (int y = top; y <= bottom; y++) mark_dirty(con, y);
+}
+
+void console_scroll_lines(int top, int bottom, int n) { scroll_lines(out_console(), top, bottom, n); }
+
+void console_erase(int x0, int y0, int x1, int y1)
+{
+    console_t *con = out_console();
+    uint16_t blank = 0x20 | (con->attr << 8);
+    if (y0 < 0) y0 = 0, x0 = 0;
+    if (y1 > rows - 1) y1 = rows - 1, x1 = cols - 1;
+    for (int y = y0; y <= y1; y++) {
+        int from = y == y0 ? x0 : 0, to = y == y1 ? x1 : cols - 1;
+        if (from < 0) from = 0;
+        if (to > cols - 1) to = cols - 1;
+        fill_row(screen_row(con, y), from, to, blank);
+        mark_dirty(con, y);
+    }
+}
+
+void console_clear_history()
+{
+    console_t *con = out_console();
+    con->history = 0;
+    if (con->view) {
+        con->view = 0;
+        mark_all_dirty(con);
+    }
+}
+
+// 换行：光标在滚动区域最后一行时只滚这个区域，到了屏幕底部就整屏滚
+static void line_feed(console_t *con)
+{
+    ansi_state_t *st = &con->ansi;
+    if (con->cursor_y == st->scroll_bottom && (st->scroll_top != 0 || st->scroll_bottom != rows - 1)) {
+        scroll_lines(con, st->scroll_top, st->scroll_bottom, 1);
+        return;
+    }
+    // 文本模式共80列，25行（纵列竖行），因此当y坐标不低于25时就要滚屏了；帧缓冲模式下是cols列rows行
+    if (++con->cursor_y >= rows) {
+        push_line(con);
+        con->cursor_y = rows - 1; // 光标设置回最后一行
     }
 }
 
 void monitor_put(char c) // 打印字符
 {
-    uint8_t backColor = 0, foreColor = 15; // 背景：黑，前景：白
-    uint16_t attribute = attributeByte << 8; // 高8位为字符属性位
+    console_t *con = out_console();
+    uint16_t attribute = con->attr << 8; // 高8位为字符属性位
     uint16_t *location; // 写入位置
 
+    serial_putc(c); // 抄一份到串口，ANSI转义序列在monitor_write里已经被吃掉了，串口日志是纯文本
     // 接下来对字符种类做各种各样的判断
-    if (c == 0x08 && cursor_x) // 退格，且光标不在某行开始处
+    if (c == 0x08 && con->cursor_x) // 退格，且光标不在某行开始处
     {
-        cursor_x--; // 直接把光标向后移一格
-        video_memory[cursor_y * 80 + cursor_x] = 0x20 | (attributeByte << 8); // 空格
+        con->cursor_x--; // 直接把光标向后移一格
+        screen_row(con, con->cursor_y)[con->cursor_x] = 0x20 | attribute; // 空格
+        mark_dirty(con, con->cursor_y);
     }
     else if (c == 0x09) // 制表符
     {
-        cursor_x = (cursor_x + 8) & ~(8 - 1); // 把光标后移至8的倍数为止
+        con->cursor_x = (con->cursor_x + 8) & ~(8 - 1); // 把光标后移至8的倍数为止
         // 这一段代码实际上的意思是：先把cursor_x + 8，然后把这一个数值变为小于它的最大的8的倍数（位运算的魅力，具体的可以在纸上推推）
     }
     else if (c == '\r') // CR
     {
-        cursor_x = 0; // 光标回首
+        con->cursor_x = 0; // 光标回首
     }
     else if (c == '\n') // LF
     {
-        cursor_x = 0; // 光标回首
-        cursor_y++; // 下一行
+        con->cursor_x = 0; // 光标回首
+        line_feed(con); // 下一行
     }
     else if (c >= ' ' && c <= '~') // 可打印字符
     {
-        location = video_memory + (cursor_y * 80 + cursor_x); // 当前光标处就是写入字符位置
-        *location = c | attribute; // 低8位：字符本体，高8位：属性，黑底白字
-        cursor_x++; // 光标后移
+        location = screen_row(con, con->cursor_y) + con->cursor_x; // 当前光标处就是写入字符位置
+        *location = c | attribute; // 低8位：字符本体，高8位：属性
+        mark_dirty(con, con->cursor_y);
+        con->cursor_x++; // 光标后移
     }
 
-    if (cursor_x >= 80) // 总共80列，到行尾必须换行
+    if (con->cursor_x >= cols) // 到行尾必须换行
     {
-        cursor_x = 0;
-        cursor_y++;
+        con->cursor_x = 0;
+        line_feed(con);
     }
-
-    scroll(); // 滚屏，如果需要的话
-    move_cursor(); // 移动光标
+    // 光标和显存都等monitor_flush再更新
 }
 
 void monitor_write(char *s)
 {
+    console_t *con = out_console();
     for (; *s; s++) {
-        if (*s == 0x1b) {
-            // 是esc，则解析ansi转义序列
-            int offset = parse_ansi(s);
-            // offset不为-1表示有意义的ANSI转义序列
-            if (offset != -1) {
-                s += offset; // 跳过后续这些字符不二次输出
-                continue;
-            }
-        }
+        if ((*s == 0x1b || con->ansi.state) && ansi_feed(&con->ansi, *s)) continue; // 转义序列交给状态机，普通字符不用进去
         monitor_put(*s); // 遍历字符串直到结尾，输出每一个字符
     }
+    if (con == &consoles[fg]) monitor_flush(); // 整个字符串写完才刷一次显存；后台控制台只写内存
 }
 
-void monitor_clear()
+void monitor_clear() // 只清屏幕，历史还在
 {
-    uint16_t blank = 0x20 | (attributeByte << 8); // 0x20 -> 空格这个字，attributeByte << 8 -> 属性位
+    console_t *con = out_console();
+    uint16_t blank = 0x20 | (con->attr << 8); // 0x20 -> 空格这个字，attr << 8 -> 属性位
 
-    for (int i = 0; i < 80 * 25; i++) video_memory[i] = blank; // 全部打印为空格
+    for (int y = 0; y < rows; y++) {
+        uint16_t *row = screen_row(con, y);
+        for (int x = 0; x < cols; x++) row[x] = blank; // 全部打印为空格
+    }
+    con->view = 0;
+    mark_all_dirty(con);
 
-    cursor_x = 0;
-    cursor_y = 0;
-    move_cursor(); // 光标置于左上角
+    con->cursor_x = 0;
+    con->cursor_y = 0; // 光标置于左上角
+    if (con == &consoles[fg]) monitor_flush();
 }
 
 void monitor_write_dec(uint32_t dec)
@@ -2,9 +2,14 @@
 #include "drivers/gdtidt.h"
 #include "drivers/memory.h"
 #include "drivers/isr.h"
+#include "timer.h"
+#include "monios/trace.h"
+#include "string.h"
 
 extern void load_tr(int);
 extern void farjmp(int, int);
+extern uint32_t load_eflags();
+extern void store_eflags(uint32_t);
 
 taskctl_t *taskctl;
 
@@ -35,7 +40,10 @@ void task_start(task_t *task) {
 task_t *task_init()
 {
     task_t *task;
-    taskctl = (taskctl_t *) kmalloc(sizeof(taskctl_t));
+    uint32_t eflags = load_eflags();
+    asm("cli"); // TR装好之前task_now()是错的，时钟中断不能进来
+    taskctl = (taskctl_t *) kmalloc(sizeof(taskctl_t)); // kmalloc清过零，运行队列都是空的，锁都是开的
+    taskctl->running = 0; // task_alloc要据此判断有没有父任务
     for (int i = 0; i < MAX_TASKS; i++) {
         taskctl->tasks0[i].flags = 0;
         taskctl->tasks0[i].sel = (TASK_GDT0 + i) * 8;
@@ -44,11 +52,11 @@ task_t *task_init()
         gdt_set_gate(TASK_GDT0 + MAX_TASKS + i, (int) &taskctl->tasks0[i].ldt, 15, 0x82); // 0x82 代表 LDT，两个 GDT 表项共计 16 字节
     }
     task = task_alloc();
-    task->flags = 2;
-    taskctl->running = 1;
-    taskctl->now = 0;
-    taskctl->tasks[0] = task;
+    task_set_name(task, "kernel");
+    task->on_cpu = 1;
     load_tr(task->sel); // 向CPU报告当前task->sel对应的任务为正在运行的任务
+    task_run(task);
+    store_eflags(eflags);
     return task;
 }
 
@@ -72,7 +80,19 @@ task_t *task_alloc()
             for (int i = 3; i < MAX_FILE_OPEN_PER_TASK; i++) {
                 task->fd_table[i] = -1;
             }
+            for (int i = 0; i < MAX_MMAP_PER_TASK; i++) {
+                task->mmaps[i].addr = NULL; // 没有任何映射
+            }
+            task->uring = NULL; // 没有注册异步队列
+            task->uring_entries = 0;
+            task->name[0] = '\0';
+            task->console = taskctl->running ? task_now()->console : 0; // 子任务跟父任务用同一个控制台
+            memset(&task->stats, 0, sizeof(task->stats)); // 记账从零开始
+            task->stats.start = timer_get_ticks();
             task->is_user = false; // here
+            task->entry = NULL;
+            task->cpu = taskctl->running ? cpu_id() : 0; // 先放在创建它的CPU上
+            task->on_cpu = 0;
             return task;
         }
     }
@@ -81,25 +101,131 @@ task_t *task_alloc()
 
 void task_run(task_t *task)
 {
+    runqueue_t *rq = &taskctl->rq[task->cpu]; // 唤醒的任务回到它上次所在的CPU
+    uint32_t eflags = spin_lock_irqsave(&rq->lock);
     task->flags = 2;
-    taskctl->tasks[taskctl->running] = task;
-    taskctl->running++;
+    rq->tasks[rq->running++] = task;
+    spin_unlock_irqrestore(&rq->lock, eflags);
+    __sync_fetch_and_add(&taskctl->running, 1);
 }
 
-void task_switch()
+// 调用者拿着rq->lock
+static void rq_remove(runqueue_t *rq, int i)
+{
+    rq->running--;
+    if (i <= rq->now) rq->now--; // now在被删的任务后面（或者就是它）就前移一个，下次++正好落在后面补上来的任务上
+    for (; i < rq->running; i++) {
+        rq->tasks[i] = rq->tasks[i + 1]; // 整体前移，不必多说
+    }
+    __sync_fetch_and_sub(&taskctl->running, 1);
+}
+
+// 从now往后轮转找下一个能跑的任务，找到了就标上on_cpu，转一圈回到cur就返回cur；调用者拿着rq->lock
+static task_t *pick_next(runqueue_t *rq, task_t *cur)
+{
+    for (int n = 0; n < rq->running; n++) {
+        if (++rq->now >= rq->running) rq->now = 0; // 到结尾了就转为第一个
+        task_t *task = rq->tasks[rq->now];
+        if (task == cur) return cur;
+        if (!task->on_cpu) { // 刚被切走、现场还没存完的跳过
+            task->on_cpu = 1;
+            return task;
+        }
+    }
+    return NULL;
+}
+
+// 自己的队列空了，从最长的队列里拿一个应用程序过来；内核任务不挪窝
+// 两把锁从不同时拿，不会和反方向偷的CPU死锁
+static task_t *steal_task(cpu_t *cpu)
 {
-    if (taskctl->running >= 2) { // 显然，至少得有两个任务才能切换
-        taskctl->now++; // 下一个任务
-        if (taskctl->now == taskctl->running) { // 到结尾了
-            taskctl->now = 0; // 转换为第一个
+    int victim = -1, most = 1; // 只有一个任务的队列，那个任务肯定正在跑
+    for (int i = 0; i < smp_cpu_count(); i++) {
+        if (i != cpu->id && taskctl->rq[i].running > most) {
+            most = taskctl->rq[i].running;
+            victim = i;
         }
-        farjmp(0, taskctl->tasks[taskctl->now]->sel); // 跳入任务对应的 TSS
     }
+    if (victim < 0) return NULL;
+    runqueue_t *rq = &taskctl->rq[victim];
+    task_t *task = NULL;
+    spin_lock(&rq->lock);
+    for (int i = rq->running - 1; i >= 0; i--) { // 从队尾找，新来的还没在那个CPU的缓存里
+        if (rq->tasks[i]->on_cpu || !rq->tasks[i]->is_user) continue;
+        task = rq->tasks[i];
+        task->on_cpu = 1;
+        rq_remove(rq, i);
+        break;
+    }
+    spin_unlock(&rq->lock);
+    if (!task) return NULL;
+    rq = &taskctl->rq[cpu->id];
+    spin_lock(&rq->lock);
+    task->cpu = cpu->id;
+    rq->now = rq->running; // 轮转从它接着往下走
+    rq->tasks[rq->running++] = task;
+    spin_unlock(&rq->lock);
+    __sync_fetch_and_add(&taskctl->running, 1);
+    cpu->steals++;
+    return task;
+}
+
+// 刚切进来的任务先调这个：能跑到这里，说明切走的那个任务的现场已经存好了，可以让别人切进去了
+static void schedule_tail()
+{
+    cpu_t *cpu = this_cpu();
+    if (cpu->leaving) {
+        cpu->leaving->on_cpu = 0;
+        cpu->leaving = NULL;
+    }
+}
+
+// 从prev切到next，next已经标了on_cpu；prev被切回来之后才返回，那时可能已经在另一个CPU上了
+static void switch_to(cpu_t *cpu, task_t *prev, task_t *next)
+{
+    next->cpu = cpu->id;
+    next->stats.switches++;
+    trace_event(TRACE_SWITCH, task_pid(next));
+    cpu->leaving = prev;
+    int depth = kernel_unlock_all(); // 大内核锁记在CPU头上，切走前放掉，next自己会拿回它要的层数
+    farjmp(0, next->sel); // 跳入任务对应的 TSS
+    schedule_tail();
+    kernel_relock(depth);
+}
+
+// 新任务第一次被切进来时从task_bootstrap（trampoline.asm）到这里，返回真正的入口
+// 这时还关着中断，收拾完切换才能开，否则时钟中断会在cpu->leaving清掉之前再切一次
+void *task_bootstrap_c()
+{
+    schedule_tail();
+    kernel_lock(); // 任务从内核里开始跑
+    asm("sti");
+    return task_now()->entry;
 }
 
+void task_switch()
+{
+    if (!taskctl) return; // 时钟中断比task_init先打开，这时还没有任务可记
+    uint32_t eflags = load_eflags();
+    asm("cli");
+    cpu_t *cpu = this_cpu();
+    task_t *cur = task_now();
+    cur->stats.ticks++; // 这一个tick记在刚才运行的任务头上
+    runqueue_t *rq = &taskctl->rq[cpu->id];
+    spin_lock(&rq->lock);
+    task_t *next = pick_next(rq, cur);
+    spin_unlock(&rq->lock);
+    if (!next && cur == cpu->idle) next = steal_task(cpu); // 闲着才去偷，忙的CPU不抢别人的活
+    if (next && next != cur) switch_to(cpu, cur, next);
+    store_eflags(eflags);
+}
+
+// 每个CPU的TR就是它正在跑的任务的TSS，不用查per-CPU数据
 task_t *task_now()
 {
-    return taskctl->tasks[taskctl->now];
+    uint16_t tr;
+    asm volatile("str %0" : "=r"(tr));
+    return &taskctl->tasks0[tr / 8 - TASK_GDT0];
 }
 
 int task_pid(task_t *task)
@@ -107,29 +233,58 @@ int task_pid(task_t *task)
     return task->sel / 8 - TASK_GDT0;
 }
 
-void task_remove(task_t *task)
+// 把任务从运行队列里摘掉，摘完之后flags设为new_flags；摘的是自己就切走，被唤醒切回来才返回
+// 只能摘自己或者没在跑的任务
+static void task_dequeue(task_t *task, int new_flags)
 {
-    bool need_switch = false; // 是否要进行切换？
-    int i;
-    if (task->flags == 2) { // 此任务正在运行，如果不运行那就根本不在tasks里，什么都不用干
-        if (task == task_now()) { // 是当前任务
-            need_switch = true; // 待会还得润
-        }
-        for (i = 0; i < taskctl->running; i++) {
-            if (taskctl->tasks[i] == task) break; // 在tasks中找到当前任务
-        }
-        taskctl->running--; // 运行任务数量减1
-        if (i < taskctl->now) taskctl->now--; // 如果now在这个任务的后面，那now也要前移一个（因为这个任务要删了，后面的要填上来，会整体前移一个）
-        for (; i < taskctl->running; i++) {
-            taskctl->tasks[i] = taskctl->tasks[i + 1]; // 整体前移，不必多说
+    if (task->flags != 2) return; // 不在运行队列里，什么都不用干
+    uint32_t eflags = load_eflags();
+    asm("cli"); // 从摘下自己到切走之间不能被时钟中断切走，否则标了on_cpu的next就再也没人跑了
+    cpu_t *cpu = this_cpu();
+    task_t *cur = task_now();
+    runqueue_t *rq = &taskctl->rq[task->cpu];
+    spin_lock(&rq->lock);
+    for (int i = 0; i < rq->running; i++) {
+        if (rq->tasks[i] == task) { // 在tasks中找到这个任务
+            rq_remove(rq, i);
+            break;
         }
-        if (need_switch) { // 需要切换
-            if (taskctl->now >= taskctl->running) {
-                taskctl->now = 0; // now超限，重置为0
-            }
-            farjmp(0, task_now()->sel); // 跳入到现在的当前任务中
+    }
+    task->flags = new_flags; // 必须在跳走之前设好，否则自己摘自己时就没机会设了
+    task_t *next = task == cur ? pick_next(rq, cur) : NULL;
+    spin_unlock(&rq->lock);
+    if (task == cur) { // 待会还得润
+        if (!next) next = steal_task(cpu);
+        if (!next) {
+            next = cpu->idle; // 什么都没有了，去idle里等
+            next->on_cpu = 1;
         }
+        switch_to(cpu, cur, next);
     }
+    store_eflags(eflags);
+}
+
+void task_remove(task_t *task)
+{
+    task_dequeue(task, task->flags);
+}
+
+// 让任务睡眠，不再参与调度，直到task_wakeup
+// 调用者需要关中断，避免检查条件和睡下去之间被唤醒漏掉
+void task_sleep(task_t *task)
+{
+    task_dequeue(task, 3); // 3表示睡眠中
+}
+
+void task_wakeup(task_t *task)
+{
+    if (task->flags == 3) task_run(task); // 只唤醒睡着的任务，重复唤醒没有影响
+}
+
+void task_set_name(task_t *task, const char *name)
+{
+    strncpy(task->name, name, TASK_NAME_LEN - 1);
+    task->name[TASK_NAME_LEN - 1] = '\0';
 }
 
 void task_exit(int value)
@@ -137,14 +292,17 @@ void task_exit(int value)
     task_t *cur = task_now(); // 当前任务
     cur->my_retval.pid = task_pid(cur); // pid变为当前任务的pid
     cur->my_retval.val = value; // val为此时的值
-    task_remove(cur); // 删除当前任务
-    cur->flags = 4; // 返回值还没人收，暂时还不能释放这个块为可用（0）
+    cur->uring = NULL; // 数据段马上就要被释放，不能再让aio线程碰它
+    cur->uring_entries = 0;
+    task_dequeue(cur, 4); // 返回值还没人收，暂时还不能释放这个块为可用（0），切走就不会回来了
 }
 
 int task_wait(int pid)
 {
     task_t *task = &taskctl->tasks0[pid]; // 找出对应的task
-    while (task->my_retval.pid == -1); // 若没有返回值就一直等着
+    // 若没有返回值就一直等着；光有返回值还不够，要等它从CPU上彻底切走，否则这个块马上被复用，它的现场会存进别人的TSS
+    // 子任务可能在别的CPU上，要让它进得了内核
+    while (task->flags != 4 || task->on_cpu) kernel_relax();
     task->flags = 0; // 释放为可用
     // 总算把你等死了，释放该任务所占资源
     for (int i = 3; i < MAX_FILE_OPEN_PER_TASK; i++) {
@@ -153,4 +311,29 @@ int task_wait(int pid)
     // 该任务malloc的所有东西都在数据段里，所以释放了数据段就相当于全释放了
     if (task->is_user) kfree((void *) task->ds_base); // 释放数据段
     return task->my_retval.val; // 拿到返回值
+}
+
+int sys_taskstat(int pid, task_stat_t *st)
+{
+    if (pid < 0) return -1;
+    for (; pid < MAX_TASKS; pid++) {
+        task_t *task = &taskctl->tasks0[pid];
+        if (task->flags == 0) continue; // 空位
+        st->pid = pid;
+        st->state = task->flags;
+        memcpy(st->name, task->name, TASK_NAME_LEN);
+        st->ticks = task->stats.ticks;
+        st->switches = task->stats.switches;
+        st->syscalls = task->stats.syscalls;
+        st->read_bytes = task->stats.read_bytes;
+        st->write_bytes = task->stats.write_bytes;
+        st->syncs = task->stats.syncs;
+        st->mem = task->is_user ? (uint32_t) task->brk_start : 0; // brk_start是相对数据段的地址，正好就是用掉的大小
+        st->mem_peak = task->stats.mem_peak > st->mem ? task->stats.mem_peak : st->mem;
+        st->start = task->stats.start;
+        st->now = timer_get_ticks();
+        st->hz = timer_get_frequency();
+        return pid;
+    }
+    return -1;
 }
\ No newline at end of file
@@ -0,0 +1,168 @@
+#include "monios/prof.h"
+#include "monios/fs/file.h"
+#include "drivers/mtask.h"
+#include "drivers/memory.h"
+#include "syscall.h"
+#include "timer.h"
+#include "stdio.h"
+#include "string.h"
+
+extern taskctl_t *taskctl;
+
+static prof_sample_t *samples = NULL; // 第一次start时分配，之后一直复用
+static volatile uint32_t nsamples = 0;
+static volatile uint32_t dropped = 0; // 缓冲区满了之后丢掉的样本数
+static volatile int running = 0;
+static uint32_t session_hz = 0;
+static uint32_t session_start = 0, session_ticks = 0; // 会话起止，单位是调度tick
+
+int prof_start(uint32_t hz)
+{
+    if (running) return -1;
+    if (!samples) samples = (prof_sample_t *) kmalloc(PROF_MAX_SAMPLES * sizeof(prof_sample_t));
+    if (!samples) return -1;
+    nsamples = dropped = 0;
+    session_hz = timer_set_sample_rate(hz);
+    session_start = timer_get_ticks();
+    running = 1;
+    return session_hz;
+}
+
+void prof_stop()
+{
+    if (!running) return;
+    running = 0;
+    timer_set_sample_rate(0); // 恢复原来的时钟频率
+    session_ticks = timer_get_ticks() - session_start;
+}
+
+int prof_running()
+{
+    return running;
+}
+
+void prof_tick(registers_t *regs)
+{
+    if (!running) return;
+    if (nsamples >= PROF_MAX_SAMPLES) {
+        dropped++;
+        return;
+    }
+    prof_sample_t *s = &samples[nsamples];
+    s->eip = regs->eip;
+    s->cs = regs->cs;
+    s->pid = task_pid(task_now());
+    nsamples++;
+}
+
+// 内核样本排在前面按地址排，应用程序样本按 pid、地址 排，这样相同的地址挨在一起，数一遍就是直方图
+static int sample_cmp(const prof_sample_t *a, const prof_sample_t *b)
+{
+    int ua = (a->cs & 3) != 0, ub = (b->cs & 3) != 0;
+    if (ua != ub) return ua - ub;
+    if (ua && a->pid != b->pid) return a->pid < b->pid ? -1 : 1;
+    if (a->eip != b->eip) return a->eip < b->eip ? -1 : 1;
+    return 0;
+}
+
+static void sift_down(prof_sample_t *arr, int root, int n)
+{
+    while (1) {
+        int child = root * 2 + 1;
+        if (child >= n) return;
+        if (child + 1 < n && sample_cmp(&arr[child], &arr[child + 1]) < 0) child++;
+        if (sample_cmp(&arr[root], &arr[child]) >= 0) return;
+        prof_sample_t tmp = arr[root];
+        arr[root] = arr[child];
+        arr[child] = tmp;
+        root = child;
+    }
+}
+
+// 堆排序，不需要额外内存
+static void sort_samples(prof_sample_t *arr, int n)
+{
+    for (int i = n / 2 - 1; i >= 0; i--) sift_down(arr, i, n);
+    for (int i = n - 1; i > 0; i--) {
+        prof_sample_t tmp = arr[0];
+        arr[0] = arr[i];
+        arr[i] = tmp;
+        sift_down(arr, 0, i);
+    }
+}
+
+typedef struct DUMP_BUF {
+    char *buf;
+    int len, size;
+} dump_buf_t;
+
+static void dump_printf(dump_buf_t *d, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(d->buf + d->len, d->size - d->len, fmt, ap);
+    va_end(ap);
+    d->len += n;
+    if (d->len > d->size - 1) d->len = d->size - 1; // 截断了，buf大小是事先算好的，正常不会发生
+}
+
+// 文件格式（每行一条，#开头是注释）：
+//   task <pid> <name> <样本数>
+//   k <样本数> <地址>          内核，地址可以直接在kernel.sym里查
+//   u <样本数> <pid> <地址>    应用程序，地址相对于它的代码段
+int prof_dump(const char *filename)
+{
+    if (running || !samples) return -1; // 先stop才能导出
+    int n = nsamples;
+    sort_samples(samples, n);
+    int groups = 0;
+    for (int i = 0; i < n; i++) {
+        if (!i || sample_cmp(&samples[i - 1], &samples[i])) groups++;
+    }
+    uint32_t *per_task = (uint32_t *) kmalloc(MAX_TASKS * sizeof(uint32_t));
+    if (!per_task) return -1;
+    memset(per_task, 0, MAX_TASKS * sizeof(uint32_t));
+    int ntasks = 0;
+    for (int i = 0; i < n; i++) {
+        if (!per_task[samples[i].pid]) ntasks++;
+        per_task[samples[i].pid]++;
+    }
+    dump_buf_t d;
+    d.size = 256 + ntasks * (TASK_NAME_LEN + 32) + groups * 32;
+    d.buf = (char *) kmalloc(d.size);
+    d.len = 0;
+    if (!d.buf) {
+        kfree(per_task);
+        return -1;
+    }
+    uint32_t hz = timer_get_frequency() ? timer_get_frequency() : 100;
+    dump_printf(&d, "# monios profile\n");
+    dump_printf(&d, "# rate %d Hz, %d samples, %d dropped, %d.%02d s\n", session_hz, n, dropped,
+                session_ticks / hz, session_ticks % hz * 100 / hz);
+    for (int pid = 0; pid < MAX_TASKS; pid++) {
+        if (!per_task[pid]) continue;
+        const char *name = taskctl->tasks0[pid].name; // 任务可能已经退出了，名字还留在那里
+        dump_printf(&d, "task %d %s %d\n", pid, name[0] ? name : "-", per_task[pid]);
+    }
+    for (int i = 0, j; i < n; i = j) {
+        for (j = i + 1; j < n && !sample_cmp(&samples[i], &samples[j]); j++);
+        if (samples[i].cs & 3) dump_printf(&d, "u %d %d 0x%08x\n", j - i, samples[i].pid, samples[i].eip);
+        else dump_printf(&d, "k %d 0x%08x\n", j - i, samples[i].eip);
+    }
+    kfree(per_task);
+    sys_unlink(filename); // 覆盖上一次的结果，不存在也没关系
+    int fd = sys_open((char *) filename, O_CREAT | O_RDWR);
+    int ret = -1;
+    if (fd != -1) {
+        ret = sys_write(fd, d.buf, d.len);
+        sys_close(fd);
+    }
+    kfree(d.buf);
+    return ret;
+}
+
+void prof_print_status()
+{
+    printf("profiler: %s, rate %d Hz, %d samples, %d dropped\n",
+           running ? "running" : "stopped", session_hz, nsamples, dropped);
+}
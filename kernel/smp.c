@@ -0,0 +1,189 @@
+#include "monios/smp.h"
+#include "monios/spinlock.h"
+#include "monios/monitor.h"
+#include "drivers/mtask.h"
+#include "drivers/apic.h"
+#include "drivers/acpi.h"
+#include "drivers/gdtidt.h"
+#include "timer.h"
+#include "string.h"
+
+#define AP_BOOT_TIMEOUT_US 100000 // 100ms还没起来就当它坏了
+
+task_t *create_kernel_task(void *entry, int privilege_level);
+extern uint32_t load_eflags();
+extern void store_eflags(uint32_t);
+extern uint32_t load_cr0();
+extern void load_tr(int);
+extern void idt_flush(uint32_t);
+extern gdt_ptr_t gdt_ptr;
+extern idt_ptr_t idt_ptr;
+extern taskctl_t *taskctl;
+
+extern char ap_trampoline[], ap_trampoline_end[];
+extern char ap_trampoline_gdtr[], ap_trampoline_cr0[], ap_trampoline_stack[], ap_trampoline_entry[];
+
+cpu_t cpus[MAX_CPUS];
+static int ncpus = 1;
+static cpu_t *volatile ap_booting; // 正在启动的AP，ap_main靠它知道自己是谁
+
+static spinlock_t big_lock = SPINLOCK_INIT;
+static volatile int big_owner = -1; // 哪个CPU拿着大内核锁
+static int big_depth = 0; // 拿了几层，只有拿着锁的CPU会改
+
+int smp_cpu_count() { return ncpus; }
+
+int cpu_id()
+{
+    return taskctl ? task_now()->cpu : 0; // task_init之前只有BSP
+}
+
+cpu_t *this_cpu()
+{
+    return &cpus[cpu_id()];
+}
+
+void kernel_lock()
+{
+    uint32_t eflags = load_eflags();
+    asm("cli"); // 拿到锁和记下owner之间不能有中断，否则中断里的kernel_lock会自己等自己
+    int cpu = cpu_id();
+    if (big_owner == cpu) big_depth++;
+    else {
+        spin_lock(&big_lock);
+        big_owner = cpu;
+        big_depth = 1;
+    }
+    store_eflags(eflags);
+}
+
+void kernel_unlock()
+{
+    uint32_t eflags = load_eflags();
+    asm("cli");
+    if (--big_depth == 0) {
+        big_owner = -1;
+        spin_unlock(&big_lock);
+    }
+    store_eflags(eflags);
+}
+
+int kernel_unlock_all()
+{
+    if (big_owner != cpu_id()) return 0;
+    int depth = big_depth;
+    big_depth = 0;
+    big_owner = -1;
+    spin_unlock(&big_lock);
+    return depth;
+}
+
+void kernel_relock(int depth)
+{
+    if (!depth) return;
+    spin_lock(&big_lock);
+    big_owner = cpu_id();
+    big_depth = depth;
+}
+
+void kernel_relax()
+{
+    uint32_t eflags = load_eflags();
+    asm("cli");
+    int depth = kernel_unlock_all();
+    asm volatile("pause");
+    kernel_relock(depth); // 排队锁，等着的CPU一定排在前面
+    store_eflags(eflags);
+}
+
+void smp_tick()
+{
+    cpu_t *cpu = this_cpu();
+    cpu->ticks++;
+    if (taskctl && task_now() == cpu->idle) cpu->idle_ticks++;
+}
+
+static void idle_loop()
+{
+    while (1) asm("sti; hlt"); // 有活干了时钟中断会切走
+}
+
+// BSP的idle第一次是切进来的，会经过task_bootstrap拿大内核锁，idle不能拿着它
+static void idle_main()
+{
+    kernel_unlock();
+    idle_loop();
+}
+
+static task_t *make_idle(int id)
+{
+    task_t *idle = create_kernel_task(idle_main, 0);
+    if (!idle) return NULL;
+    char name[8] = "idle0";
+    name[4] = '0' + id;
+    task_set_name(idle, name);
+    idle->flags = 2; // ps里看着是在跑的，但它不进运行队列
+    idle->cpu = id;
+    return idle;
+}
+
+// AP从trampoline出来就到这里，栈是自己idle任务的栈
+static void ap_main()
+{
+    cpu_t *cpu = ap_booting;
+    idt_flush((uint32_t) &idt_ptr);
+    cpu->idle->on_cpu = 1;
+    load_tr(cpu->idle->sel); // 从现在起task_now()就是idle，cpu_id()也对了
+    apic_ap_init();
+    apic_timer_start(timer_get_frequency());
+    cpu->online = 1;
+    idle_loop();
+}
+
+static int boot_ap(cpu_t *cpu)
+{
+    *(uint32_t *) (TRAMPOLINE_ADDR + (ap_trampoline_stack - ap_trampoline)) = cpu->idle->tss.esp;
+    *(uint32_t *) (TRAMPOLINE_ADDR + (ap_trampoline_entry - ap_trampoline)) = (uint32_t) ap_main;
+    ap_booting = cpu;
+    // Intel MP规范的顺序：INIT，等10ms，SIPI，等200us，还没起来再来一次SIPI
+    apic_send_ipi(cpu->apic_id, APIC_ICR_INIT | APIC_ICR_ASSERT | APIC_ICR_LEVEL);
+    apic_send_ipi(cpu->apic_id, APIC_ICR_INIT | APIC_ICR_LEVEL); // 老CPU要再撤销一次
+    apic_delay_us(10000);
+    for (int i = 0; i < 2 && !cpu->online; i++) {
+        apic_send_ipi(cpu->apic_id, APIC_ICR_STARTUP | (TRAMPOLINE_ADDR >> 12));
+        apic_delay_us(200);
+    }
+    for (int us = 0; us < AP_BOOT_TIMEOUT_US && !cpu->online; us += 1000) apic_delay_us(1000);
+    return cpu->online ? 0 : -1;
+}
+
+void smp_init()
+{
+    cpu_t *bsp = &cpus[0];
+    bsp->id = 0;
+    bsp->apic_id = apic_enabled() ? lapic_id() : 0;
+    bsp->online = 1;
+    bsp->idle = make_idle(0);
+    if (!apic_enabled() || acpiMadt.cpuCount < 2) return;
+
+    memcpy((void *) TRAMPOLINE_ADDR, ap_trampoline, ap_trampoline_end - ap_trampoline);
+    memcpy((void *) (TRAMPOLINE_ADDR + (ap_trampoline_gdtr - ap_trampoline)), &gdt_ptr, sizeof(gdt_ptr));
+    *(uint32_t *) (TRAMPOLINE_ADDR + (ap_trampoline_cr0 - ap_trampoline)) = load_cr0();
+
+    for (int i = 0; i < acpiMadt.cpuCount && ncpus < MAX_CPUS; i++) {
+        if (acpiMadt.cpuApicIds[i] == bsp->apic_id) continue;
+        cpu_t *cpu = &cpus[ncpus];
+        cpu->id = ncpus;
+        cpu->apic_id = acpiMadt.cpuApicIds[i];
+        cpu->idle = make_idle(ncpus);
+        if (!cpu->idle) break;
+        if (boot_ap(cpu) == -1) {
+            monitor_printf("smp: CPU with APIC ID %d did not start\n", cpu->apic_id);
+            task_free(cpu->idle);
+            cpu->idle = NULL;
+            continue;
+        }
+        ncpus++; // AP已经在idle里了，从现在起别的CPU偷任务时也会看它的队列
+    }
+    monitor_printf("smp: %d CPU(s) online\n", ncpus);
+}
@@ -0,0 +1,58 @@
+#include "drivers/isr.h"
+#include "drivers/mtask.h"
+
+// tasklet队列和执行它们的softirq内核任务
+// 挂队列只在关中断时做，队列本身很短；tasklet执行时是开着中断的，可以被新的中断打断，也可以被时钟切走
+
+task_t *create_kernel_task(void *entry, int privilege_level);
+extern uint32_t load_eflags();
+extern void store_eflags(uint32_t);
+
+static tasklet_t *pending_head = NULL, *pending_tail = NULL; // 按挂上的顺序执行
+static task_t *softirq_task = NULL;
+
+void tasklet_schedule(tasklet_t *t)
+{
+    uint32_t eflags = load_eflags();
+    asm("cli");
+    if (!t->pending) {
+        t->pending = 1;
+        t->next = NULL;
+        if (pending_tail) pending_tail->next = t;
+        else pending_head = t;
+        pending_tail = t;
+        if (softirq_task) task_wakeup(softirq_task); // 睡着的话叫醒，醒着的话这一轮就会看到
+    }
+    store_eflags(eflags);
+}
+
+static void softirq_main()
+{
+    while (1) {
+        asm("cli");
+        tasklet_t *list = pending_head; // 整条链表一次摘下来，执行的时候中断可以接着往新链表上挂
+        pending_head = pending_tail = NULL;
+        if (!list) {
+            task_sleep(softirq_task); // 睡到下一次tasklet_schedule
+            asm("sti");
+            continue;
+        }
+        asm("sti");
+        while (list) {
+            tasklet_t *t = list;
+            list = t->next;
+            t->pending = 0; // 先清掉再执行，执行期间中断又来了就会再挂一次，不会漏
+            t->func(t->data);
+        }
+    }
+}
+
+void softirq_init()
+{
+    softirq_task = create_kernel_task(softirq_main, 0);
+    if (!softirq_task) return; // 没有下半部任务，挂上的tasklet永远不会执行，键盘也就不能用了
+    task_set_name(softirq_task, "softirq");
+    asm("cli");
+    task_run(softirq_task);
+    asm("sti");
+}
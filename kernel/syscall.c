@@ -1,50 +1,181 @@
 #include "monios/common.h"
 #include "syscall.h"
 #include "drivers/mtask.h"
+#include "monios/trace.h"
 
-void syscall_manager(int edi, int esi, int ebp, int esp, int ebx, int edx, int ecx, int eax)
-{
-    int ds_base = task_now()->ds_base;
-    int ret = 0;
-    switch (eax) {
-        case 0:
-            ret = sys_getpid();
-            break;
-        case 1:
-            ret = sys_write(ebx, (char *) ecx + ds_base, edx);
-            break;
-        case 2:
-            ret = sys_read(ebx, (char *) ecx + ds_base, edx);
-            break;
-        case 3: // 从这里开始
-            ret = sys_open((char *) ebx + ds_base, ecx);
-            break;
-        case 4:
-            ret = sys_close(ebx);
-            break;
-        case 5:
-            ret = sys_lseek(ebx, ecx, edx);
-            break;
-        case 6:
-            ret = sys_unlink((char *) ebx + ds_base);
-            break;
-        case 7:
-            ret = sys_create_process((const char *) ebx + ds_base, (const char *) ecx + ds_base, (const char *) edx + ds_base);
-            break;
-        case 8:
-            ret = task_wait(ebx);
-            break;
-        case 9:
-            task_exit(ebx);
-            break; // 到这里结束
-        case 10:
-            ret = (int) sys_sbrk(ebx);
-            break;
+// 把应用程序传来的iovec数组拷进内核，顺便把每个iov_base换成绝对地址
+static int translate_iov(iovec_t *kiov, const iovec_t *uiov, int iovcnt, int ds_base)
+{
+    if (iovcnt < 0 || iovcnt > IOV_MAX) return -1;
+    for (int i = 0; i < iovcnt; i++) {
+        kiov[i].iov_base = (char *) uiov[i].iov_base + ds_base;
+        kiov[i].iov_len = uiov[i].iov_len;
     }
-    int *save_reg = &eax + 1;
-    save_reg[7] = ret;
+    return 0;
+}
+
+// 系统调用入口把ebx ecx edx esi edi ebp按顺序作为参数传进来，返回值由入口写回应用程序的eax
+typedef int (*syscall_fn_t)(int ebx, int ecx, int edx, int esi, int edi, int ebp);
+
+static inline int user_base()
+{
+    return task_now()->ds_base;
+}
+
+static int sc_getpid(int ebx, int ecx, int edx, int esi, int edi, int ebp)
+{
+    return sys_getpid();
+}
+
+static int sc_write(int ebx, int ecx, int edx, int esi, int edi, int ebp)
+{
+    return sys_write(ebx, (char *) ecx + user_base(), edx);
+}
+
+static int sc_read(int ebx, int ecx, int edx, int esi, int edi, int ebp)
+{
+    return sys_read(ebx, (char *) ecx + user_base(), edx);
+}
+
+static int sc_open(int ebx, int ecx, int edx, int esi, int edi, int ebp)
+{
+    return sys_open((char *) ebx + user_base(), ecx);
+}
+
+static int sc_close(int ebx, int ecx, int edx, int esi, int edi, int ebp)
+{
+    return sys_close(ebx);
+}
+
+static int sc_lseek(int ebx, int ecx, int edx, int esi, int edi, int ebp)
+{
+    return sys_lseek(ebx, ecx, edx);
+}
+
+static int sc_unlink(int ebx, int ecx, int edx, int esi, int edi, int ebp)
+{
+    return sys_unlink((char *) ebx + user_base());
+}
+
+static int sc_create_process(int ebx, int ecx, int edx, int esi, int edi, int ebp)
+{
+    int ds_base = user_base();
+    return sys_create_process((const char *) ebx + ds_base, (const char *) ecx + ds_base, (const char *) edx + ds_base);
+}
+
+static int sc_waitpid(int ebx, int ecx, int edx, int esi, int edi, int ebp)
+{
+    return task_wait(ebx);
+}
+
+static int sc_exit(int ebx, int ecx, int edx, int esi, int edi, int ebp)
+{
+    task_exit(ebx);
+    return 0; // 不会走到这里
+}
+
+static int sc_sbrk(int ebx, int ecx, int edx, int esi, int edi, int ebp)
+{
+    return (int) sys_sbrk(ebx);
 }
 
+static int sc_mmap(int ebx, int ecx, int edx, int esi, int edi, int ebp)
+{
+    return (int) sys_mmap((void *) ebx, ecx, edx, esi, edi, ebp); // 映射地址相对于数据段，不用加ds_base
+}
+
+static int sc_munmap(int ebx, int ecx, int edx, int esi, int edi, int ebp)
+{
+    return sys_munmap((void *) ebx, ecx);
+}
+
+static int sc_readv(int ebx, int ecx, int edx, int esi, int edi, int ebp)
+{
+    iovec_t kiov[IOV_MAX];
+    int ds_base = user_base();
+    if (translate_iov(kiov, (iovec_t *) (ecx + ds_base), edx, ds_base) == -1) return -1;
+    return sys_readv(ebx, kiov, edx);
+}
+
+static int sc_writev(int ebx, int ecx, int edx, int esi, int edi, int ebp)
+{
+    iovec_t kiov[IOV_MAX];
+    int ds_base = user_base();
+    if (translate_iov(kiov, (iovec_t *) (ecx + ds_base), edx, ds_base) == -1) return -1;
+    return sys_writev(ebx, kiov, edx);
+}
+
+static int sc_pread(int ebx, int ecx, int edx, int esi, int edi, int ebp)
+{
+    return sys_pread(ebx, (char *) ecx + user_base(), edx, esi);
+}
+
+static int sc_pwrite(int ebx, int ecx, int edx, int esi, int edi, int ebp)
+{
+    return sys_pwrite(ebx, (char *) ecx + user_base(), edx, esi);
+}
+
+static int sc_io_uring_setup(int ebx, int ecx, int edx, int esi, int edi, int ebp)
+{
+    return sys_io_uring_setup((void *) ebx, ecx); // 队列地址相对于数据段保存，不用加ds_base
+}
+
+static int sc_io_uring_enter(int ebx, int ecx, int edx, int esi, int edi, int ebp)
+{
+    return sys_io_uring_enter(ebx);
+}
+
+static int sc_fsck(int ebx, int ecx, int edx, int esi, int edi, int ebp)
+{
+    return sys_fsck((fsck_report_t *) (ebx + user_base()), ecx);
+}
+
+static int sc_taskstat(int ebx, int ecx, int edx, int esi, int edi, int ebp)
+{
+    return sys_taskstat(ebx, (task_stat_t *) (ecx + user_base()));
+}
+
+// syscall_handler在查表之前和之后各调用一次，负责记账和跟踪
+void syscall_enter(int nr)
+{
+    kernel_lock(); // 系统调用的实现都是按单CPU写的
+    task_now()->stats.syscalls++;
+    trace_event(TRACE_SYSCALL_ENTER, nr);
+}
+
+void syscall_leave(int ret)
+{
+    trace_event(TRACE_SYSCALL_EXIT, ret);
+    kernel_unlock();
+}
+
+// 下标就是eax里的系统调用号，syscall_handler直接查表跳过去
+syscall_fn_t syscall_table[] = {
+    sc_getpid,          // 0
+    sc_write,           // 1
+    sc_read,            // 2
+    sc_open,            // 3
+    sc_close,           // 4
+    sc_lseek,           // 5
+    sc_unlink,          // 6
+    sc_create_process,  // 7
+    sc_waitpid,         // 8
+    sc_exit,            // 9
+    sc_sbrk,            // 10
+    sc_mmap,            // 11
+    sc_munmap,          // 12
+    sc_readv,           // 13
+    sc_writev,          // 14
+    sc_pread,           // 15
+    sc_pwrite,          // 16
+    sc_io_uring_setup,  // 17
+    sc_io_uring_enter,  // 18
+    sc_fsck,            // 19
+    sc_taskstat,        // 20
+};
+
+int syscall_count = sizeof(syscall_table) / sizeof(syscall_fn_t); // 超过这个数的调用号直接返回-1
+
 int sys_getpid()
 {
     return task_pid(task_now());
@@ -85,8 +85,8 @@ waitpid:
     pop ebx
     ret
 
-[global exit]
-exit:
+[global _exit]
+_exit:
     push ebx
     mov eax, 9
     mov ebx, [esp + 8]
@@ -101,4 +101,123 @@ sbrk:
     mov ebx, [esp + 8]
     int 80h
     pop ebx
+    ret
+
+[global mmap]
+mmap:
+    push ebx
+    push esi
+    push edi
+    push ebp
+    mov eax, 11
+    mov ebx, [esp + 20]
+    mov ecx, [esp + 24]
+    mov edx, [esp + 28]
+    mov esi, [esp + 32]
+    mov edi, [esp + 36]
+    mov ebp, [esp + 40]
+    int 80h
+    pop ebp
+    pop edi
+    pop esi
+    pop ebx
+    ret
+
+[global munmap]
+munmap:
+    push ebx
+    mov eax, 12
+    mov ebx, [esp + 8]
+    mov ecx, [esp + 12]
+    int 80h
+    pop ebx
+    ret
+
+[global readv]
+readv:
+    push ebx
+    mov eax, 13
+    mov ebx, [esp + 8]
+    mov ecx, [esp + 12]
+    mov edx, [esp + 16]
+    int 80h
+    pop ebx
+    ret
+
+[global writev]
+writev:
+    push ebx
+    mov eax, 14
+    mov ebx, [esp + 8]
+    mov ecx, [esp + 12]
+    mov edx, [esp + 16]
+    int 80h
+    pop ebx
+    ret
+
+[global pread]
+pread:
+    push ebx
+    push esi
+    mov eax, 15
+    mov ebx, [esp + 12]
+    mov ecx, [esp + 16]
+    mov edx, [esp + 20]
+    mov esi, [esp + 24]
+    int 80h
+    pop esi
+    pop ebx
+    ret
+
+[global pwrite]
+pwrite:
+    push ebx
+    push esi
+    mov eax, 16
+    mov ebx, [esp + 12]
+    mov ecx, [esp + 16]
+    mov edx, [esp + 20]
+    mov esi, [esp + 24]
+    int 80h
+    pop esi
+    pop ebx
+    ret
+
+[global io_uring_setup]
+io_uring_setup:
+    push ebx
+    mov eax, 17
+    mov ebx, [esp + 8]
+    mov ecx, [esp + 12]
+    int 80h
+    pop ebx
+    ret
+
+[global io_uring_enter]
+io_uring_enter:
+    push ebx
+    mov eax, 18
+    mov ebx, [esp + 8]
+    int 80h
+    pop ebx
+    ret
+
+[global fsck]
+fsck:
+    push ebx
+    mov eax, 19
+    mov ebx, [esp + 8]
+    mov ecx, [esp + 12]
+    int 80h
+    pop ebx
+    ret
+
+[global taskstat]
+taskstat:
+    push ebx
+    mov eax, 20
+    mov ebx, [esp + 8]
+    mov ecx, [esp + 12]
+    int 80h
+    pop ebx
     ret
\ No newline at end of file
@@ -1,16 +1,32 @@
 #include "timer.h"
 #include "drivers/isr.h"
 #include "drivers/mtask.h"
+#include "monios/prof.h"
+#include "monios/monitor.h"
+#include "drivers/apic.h"
+
+static volatile uint32_t timer_ticks = 0;
+static uint32_t timer_freq = 0;
+static uint32_t timer_mult = 1; // 采样时定时器比调度快这么多倍
+static uint32_t timer_sub = 0; // 攒够timer_mult次中断才算一个tick
 
 static void timer_callback(registers_t *regs)
 {
-    task_switch(); // 每出现一次时钟中断，切换一次任务
+    prof_tick(regs); // regs是被打断的现场，嵌套在别的IRQ里时记到那个处理程序头上
+    if (++timer_sub < timer_mult) return; // 调度频率不跟着采样频率变
+    timer_sub = 0;
+    timer_ticks++;
+    smp_tick(); // AP的时钟在irq_handler里直接记
+    monitor_flush(); // 直接调monitor_put的输出也最多晚一个tick显示出来
+    irq_need_resched(); // 每出现一次时钟中断，切换一次任务；等irq_handler记完账、退出嵌套再切
 }
 
-void init_timer(uint32_t freq)
+static void timer_program(uint32_t freq)
 {
-    register_interrupt_handler(IRQ0, &timer_callback); // 将时钟中断处理程序注册给IRQ框架
-
+    if (apic_enabled()) { // 有APIC就用LAPIC定时器，PIT的引脚在apic_init里已经关了
+        apic_timer_start(freq);
+        return;
+    }
     uint32_t divisor = 1193180 / freq;
 
     outb(0x43, 0x36); // 指令位，写入频率
@@ -20,4 +36,35 @@ void init_timer(uint32_t freq)
 
     outb(0x40, l);
     outb(0x40, h); // 分两次发出
+}
+
+void init_timer(uint32_t freq)
+{
+    register_interrupt_handler(IRQ0, &timer_callback); // 将时钟中断处理程序注册给IRQ框架
+    timer_freq = freq;
+    timer_program(freq);
+}
+
+uint32_t timer_get_ticks()
+{
+    return timer_ticks;
+}
+
+uint32_t timer_get_frequency()
+{
+    return timer_freq;
+}
+
+// 让定时器以hz（取整成timer_freq的整数倍）触发中断，hz为0则恢复原来的频率，返回实际频率
+uint32_t timer_set_sample_rate(uint32_t hz)
+{
+    uint32_t mult = hz / timer_freq;
+    if (mult < 1) mult = 1;
+    if (mult > 100) mult = 100; // 100Hz * 100 = 10kHz，再快中断本身就要把CPU吃光了
+    asm("cli");
+    timer_mult = mult;
+    timer_sub = 0;
+    timer_program(timer_freq * mult);
+    asm("sti");
+    return timer_freq * mult;
 }
\ No newline at end of file
@@ -0,0 +1,137 @@
+#include "monios/trace.h"
+#include "monios/fs/file.h"
+#include "drivers/mtask.h"
+#include "drivers/memory.h"
+#include "syscall.h"
+#include "timer.h"
+#include "stdio.h"
+#include "string.h"
+
+extern taskctl_t *taskctl;
+
+// 一个CPU一个环，写的时候只用lock xadd抢一个下标，不加锁也不关中断
+// 中断在两次写之间插进来也只是各自拿到不同的槽；只有读（dump）的时候要先把跟踪停掉
+typedef struct TRACE_RING {
+    trace_event_t *events;
+    volatile uint32_t head; // 一直往上加，取模之后才是下标
+} trace_ring_t;
+
+static trace_ring_t rings[TRACE_MAX_CPUS];
+static volatile int trace_on = 0;
+static uint32_t tick_start = 0;
+static uint64_t tsc_start = 0;
+
+static inline uint64_t rdtsc()
+{
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t) hi << 32) | lo;
+}
+
+static inline int trace_cpu()
+{
+    return cpu_id();
+}
+
+void trace_init()
+{
+    for (int cpu = 0; cpu < smp_cpu_count(); cpu++) { // 没起来的CPU不占内存，导出时它的环是空的
+        rings[cpu].events = (trace_event_t *) kmalloc(TRACE_RING_SIZE * sizeof(trace_event_t));
+        rings[cpu].head = 0;
+    }
+}
+
+void trace_set_enabled(int enabled)
+{
+    if (enabled && !trace_on) { // 每次打开都是一段新的记录
+        for (int cpu = 0; cpu < TRACE_MAX_CPUS; cpu++) rings[cpu].head = 0;
+        tick_start = timer_get_ticks();
+        tsc_start = rdtsc();
+    }
+    trace_on = enabled && rings[0].events;
+}
+
+int trace_enabled()
+{
+    return trace_on;
+}
+
+void trace_event(int type, uint32_t arg)
+{
+    if (!trace_on) return;
+    trace_ring_t *ring = &rings[trace_cpu()];
+    uint32_t idx = 1;
+    asm volatile("lock xaddl %0, %1" : "+r"(idx), "+m"(ring->head) : : "memory"); // idx = head++
+    trace_event_t *ev = &ring->events[idx & (TRACE_RING_SIZE - 1)];
+    ev->tsc = rdtsc();
+    ev->type = type;
+    ev->pid = taskctl ? task_pid(task_now()) : 0;
+    ev->arg = arg;
+}
+
+int trace_dump(const char *filename)
+{
+    int was_on = trace_on;
+    trace_on = 0; // 导出的时候不能有人再写
+    if (!rings[0].events) return -1;
+    trace_file_header_t hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = TRACE_MAGIC;
+    hdr.version = TRACE_VERSION;
+    hdr.ncpus = TRACE_MAX_CPUS;
+    hdr.event_size = sizeof(trace_event_t);
+    hdr.hz = timer_get_frequency();
+    hdr.tick_start = tick_start;
+    hdr.tick_end = timer_get_ticks();
+    hdr.tsc_start = tsc_start;
+    hdr.tsc_end = rdtsc();
+    uint32_t total = 0;
+    for (int cpu = 0; cpu < TRACE_MAX_CPUS; cpu++) {
+        uint32_t head = rings[cpu].head;
+        hdr.nevents[cpu] = head < TRACE_RING_SIZE ? head : TRACE_RING_SIZE;
+        hdr.lost[cpu] = head - hdr.nevents[cpu];
+        total += hdr.nevents[cpu];
+    }
+    for (int pid = 0; pid < MAX_TASKS; pid++) {
+        if (taskctl->tasks0[pid].name[0]) hdr.nnames++; // 退出了的任务名字也还在，一并带上
+    }
+    int size = sizeof(hdr) + hdr.nnames * sizeof(trace_name_t) + total * sizeof(trace_event_t);
+    char *buf = (char *) kmalloc(size);
+    if (!buf) {
+        trace_on = was_on;
+        return -1;
+    }
+    char *p = buf;
+    memcpy(p, &hdr, sizeof(hdr));
+    p += sizeof(hdr);
+    for (int pid = 0; pid < MAX_TASKS; pid++) {
+        if (!taskctl->tasks0[pid].name[0]) continue;
+        trace_name_t *name = (trace_name_t *) p;
+        name->pid = pid;
+        memcpy(name->name, taskctl->tasks0[pid].name, sizeof(name->name));
+        p += sizeof(trace_name_t);
+    }
+    for (int cpu = 0; cpu < TRACE_MAX_CPUS; cpu++) {
+        uint32_t first = rings[cpu].head - hdr.nevents[cpu]; // 最旧的那个
+        for (uint32_t i = 0; i < hdr.nevents[cpu]; i++) {
+            memcpy(p, &rings[cpu].events[(first + i) & (TRACE_RING_SIZE - 1)], sizeof(trace_event_t));
+            p += sizeof(trace_event_t);
+        }
+    }
+    sys_unlink(filename); // 覆盖上一次的结果
+    int fd = sys_open((char *) filename, O_CREAT | O_RDWR);
+    int ret = -1;
+    if (fd != -1) {
+        ret = sys_write(fd, buf, size);
+        sys_close(fd);
+    }
+    kfree(buf);
+    return ret;
+}
+
+void trace_print_status()
+{
+    uint32_t head = rings[0].head;
+    printf("trace: %s, %d events recorded, %d overwritten\n", trace_on ? "on" : "off",
+           head < TRACE_RING_SIZE ? head : TRACE_RING_SIZE, head < TRACE_RING_SIZE ? 0 : head - TRACE_RING_SIZE);
+}
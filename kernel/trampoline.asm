@@ -0,0 +1,63 @@
+; AP的启动代码：BSP把ap_trampoline到ap_trampoline_end这一段拷到TRAMPOLINE_ADDR，再把SIPI的向量设成它的页号
+; AP收到SIPI后在实模式下从CS=页号*256、IP=0开始执行，这里的标号都要换算成拷过去之后的地址
+; BSP在拷贝里填好gdtr、cr0、栈和入口，一次只叫起一个AP，所以一份就够了
+
+TRAMPOLINE_ADDR equ 0x7000 ; 和smp.h里的一致
+
+%define REL(x) (x - ap_trampoline)
+
+[section .data]
+[global ap_trampoline]
+[global ap_trampoline_end]
+[global ap_trampoline_gdtr]
+[global ap_trampoline_cr0]
+[global ap_trampoline_stack]
+[global ap_trampoline_entry]
+
+[bits 16]
+ap_trampoline:
+    cli
+    mov ax, cs
+    mov ds, ax ; 下面的数据都按段内偏移访问
+    o32 lgdt [REL(ap_trampoline_gdtr)] ; 直接用BSP的GDT
+    mov eax, [REL(ap_trampoline_cr0)] ; 和BSP一样的CR0：打开PE，缓存也跟BSP一样开着（INIT之后CD/NW是置位的）
+    mov cr0, eax
+    jmp dword 0x08:(TRAMPOLINE_ADDR + REL(ap_pm_entry)) ; 刷新CS，进入32位
+
+[bits 32]
+ap_pm_entry:
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+    mov esp, [TRAMPOLINE_ADDR + REL(ap_trampoline_stack)] ; 这个AP的idle任务的栈
+    call [TRAMPOLINE_ADDR + REL(ap_trampoline_entry)] ; ap_main，不会返回
+.halt:
+    cli
+    hlt
+    jmp .halt
+
+align 4
+ap_trampoline_gdtr:
+    dw 0
+    dd 0
+align 4
+ap_trampoline_cr0:
+    dd 0
+ap_trampoline_stack:
+    dd 0
+ap_trampoline_entry:
+    dd 0
+ap_trampoline_end:
+
+[section .text]
+[bits 32]
+[extern task_bootstrap_c]
+[global task_bootstrap]
+; create_kernel_task把新任务的eip设成这里，栈上是给真正入口的参数
+; 先调task_bootstrap_c收拾切换、拿大内核锁，它返回真正的入口，栈原样不动跳过去
+task_bootstrap:
+    call task_bootstrap_c
+    jmp eax
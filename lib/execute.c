@@ -8,6 +8,8 @@
 #include "shell.h"
 #include "drivers/cmos.h"
 #include "monios/fs/file.h"
+#include "monios/fs/fat16.h"
+#include "monios/fs/journal.h"
 #include <stdio.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -21,7 +23,15 @@
 #include "drivers/pit.h"
 #include "log.h"
 #include "drivers/screen.h"
+#include "drivers/vbe.h"
+#include "monios/fbcon.h"
 #include "math.h"
+#include "taskstat.h"
+#include "drivers/fifo.h"
+#include "monios/prof.h"
+#include "drivers/apic.h"
+#include "drivers/acpi.h"
+#include "monios/trace.h"
 
 // 定义缺失的段选择子常量
 #define KERNEL_CODE_SELECTOR 0x08
@@ -44,9 +54,6 @@ typedef struct {
 } shell_state_t;
 
 static shell_state_t shell_state;
-// 函数声明
-int fat16_open_dir(fileinfo_t *finfo, const char *path);
-int fat16_read_dir(fileinfo_t *finfo, char *filename);
 // 在其他包含头文件后添加
 extern void set_vga_mode(void);
 extern void call_bios_int(void);
@@ -578,6 +585,367 @@ int cmd_rm(const char *path) {
     return 0;
 }
 
+
+#define MAX_STAT_TASKS 64 // ps和top最多显示这么多个任务
+
+static const char *task_state_name(int state)
+{
+    switch (state) {
+        case 1: return "new";
+        case 2: return "run";
+        case 3: return "sleep";
+        case 4: return "exit";
+    }
+    return "?";
+}
+
+// 把所有任务的信息取出来，返回个数
+static int collect_task_stats(task_stat_t *stats, int max)
+{
+    int n = 0;
+    for (int pid = taskstat(0, &stats[0]); pid != -1 && n < max; ) {
+        n++;
+        if (n == max) break;
+        pid = taskstat(pid + 1, &stats[n]);
+    }
+    return n;
+}
+
+static task_stat_t ps_stats[MAX_STAT_TASKS];
+
+// 列出所有任务，CPU%是整个生命周期里的平均值
+int cmd_ps(void)
+{
+    int n = collect_task_stats(ps_stats, MAX_STAT_TASKS);
+    printf("  PID STATE NAME             CPU%%     TIME  SYSCALLS  READ(KB) WRITE(KB)  SYNCS  MEM(KB)\n");
+    for (int i = 0; i < n; i++) {
+        task_stat_t *st = &ps_stats[i];
+        uint32_t alive = st->now - st->start;
+        uint32_t hz = st->hz ? st->hz : 100;
+        printf("%5d %-5s %-16s %3d%% %5d.%02ds %9u %9u %9u %6u %8u\n",
+               st->pid, task_state_name(st->state), st->name[0] ? st->name : "-",
+               alive ? st->ticks * 100 / alive : 0, st->ticks / hz, st->ticks % hz * 100 / hz,
+               st->syscalls, (uint32_t) (st->read_bytes >> 10), (uint32_t) (st->write_bytes >> 10),
+               st->syncs, st->mem >> 10);
+    }
+    return 0;
+}
+
+static task_stat_t top_prev[MAX_STAT_TASKS], top_cur[MAX_STAT_TASKS];
+static uint32_t top_delta[MAX_STAT_TASKS]; // 这一秒内每个任务用掉的tick
+static int top_order[MAX_STAT_TASKS];
+
+// 在上一次的采样里找同一个任务，pid会被复用，所以连创建时间一起比
+static task_stat_t *top_find_prev(task_stat_t *st, int nprev)
+{
+    for (int i = 0; i < nprev; i++) {
+        if (top_prev[i].pid == st->pid && top_prev[i].start == st->start) return &top_prev[i];
+    }
+    return NULL;
+}
+
+// 每秒刷新一次，按这一秒内的CPU占用排序，按任意键退出；top -n N 只刷新N次
+int cmd_top(int argc, char **argv)
+{
+    int rounds = -1;
+    if (argc > 2 && strcmp(argv[1], "-n") == 0) {
+        rounds = 0;
+        for (const char *p = argv[2]; *p >= '0' && *p <= '9'; p++) rounds = rounds * 10 + (*p - '0');
+    }
+    int nprev = collect_task_stats(top_prev, MAX_STAT_TASKS);
+    fifo_t *keys = console_keys(console_current());
+    while (rounds != 0) {
+        uint32_t hz = timer_get_frequency() ? timer_get_frequency() : 100;
+        uint32_t t = timer_get_ticks();
+        while (timer_get_ticks() - t < hz && !fifo_status(keys)) asm("hlt"); // 等一秒，有键按下就提前醒
+        if (fifo_status(keys)) {
+            fifo_get(keys); // 吃掉这个键，免得漏进下一条命令
+            break;
+        }
+        int n = collect_task_stats(top_cur, MAX_STAT_TASKS);
+        uint32_t interval = 0;
+        for (int i = 0; i < n; i++) {
+            task_stat_t *prev = top_find_prev(&top_cur[i], nprev);
+            top_delta[i] = top_cur[i].ticks - (prev ? prev->ticks : 0);
+            interval += top_delta[i];
+            top_order[i] = i;
+        }
+        if (!interval) interval = 1;
+        for (int i = 1; i < n; i++) { // 插入排序，任务不多
+            int k = top_order[i], j = i - 1;
+            while (j >= 0 && top_delta[top_order[j]] < top_delta[k]) {
+                top_order[j + 1] = top_order[j];
+                j--;
+            }
+            top_order[j + 1] = k;
+        }
+        monitor_clear();
+        uint32_t up = n ? top_cur[0].now / hz : 0;
+        printf("top - up %d:%02d:%02d, %d tasks, press any key to quit\n\n", up / 3600, up / 60 % 60, up % 60, n);
+        printf("  PID STATE NAME             CPU%%  SYSCALL/s  READ(KB/s) WRITE(KB/s)  MEM(KB)\n");
+        for (int i = 0; i < n && i < 20; i++) {
+            task_stat_t *st = &top_cur[top_order[i]], *prev = top_find_prev(st, nprev);
+            uint32_t rd = (uint32_t) ((st->read_bytes - (prev ? prev->read_bytes : 0)) >> 10);
+            uint32_t wr = (uint32_t) ((st->write_bytes - (prev ? prev->write_bytes : 0)) >> 10);
+            printf("%5d %-5s %-16s %3d%% %10u %11u %11u %8u\n",
+                   st->pid, task_state_name(st->state), st->name[0] ? st->name : "-",
+                   top_delta[top_order[i]] * 100 / interval,
+                   st->syscalls - (prev ? prev->syscalls : 0), rd, wr, st->mem >> 10);
+        }
+        memcpy(top_prev, top_cur, sizeof(task_stat_t) * n);
+        nprev = n;
+        if (rounds > 0) rounds--;
+    }
+    return 0;
+}
+
+// prof start [hz] / prof stop / prof dump [file] / prof
+int cmd_prof(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "start") == 0) {
+        uint32_t hz = 0;
+        if (argc > 2) {
+            for (const char *p = argv[2]; *p >= '0' && *p <= '9'; p++) hz = hz * 10 + (*p - '0');
+        }
+        int rate = prof_start(hz ? hz : PROF_DEFAULT_HZ);
+        if (rate == -1) printf("prof: already running or out of memory\n");
+        else printf("prof: sampling at %d Hz\n", rate);
+    } else if (argc > 1 && strcmp(argv[1], "stop") == 0) {
+        prof_stop();
+        prof_print_status();
+    } else if (argc > 1 && strcmp(argv[1], "dump") == 0) {
+        const char *file = argc > 2 ? argv[2] : "prof.txt";
+        int ret = prof_dump(file);
+        if (ret == -1) printf("prof: nothing to dump (stop the profiler first)\n");
+        else printf("prof: wrote %d bytes to %s, symbolize with tools/profsym.sh\n", ret, file);
+    } else if (argc == 1) {
+        prof_print_status();
+    } else {
+        printf("Usage: prof [start [hz]|stop|dump [file]]\n");
+        return -1;
+    }
+    return 0;
+}
+
+// trace on / trace off / trace dump [file] / trace
+int cmd_trace(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "on") == 0) {
+        trace_set_enabled(1);
+        if (!trace_enabled()) printf("trace: no buffer\n");
+    } else if (argc > 1 && strcmp(argv[1], "off") == 0) {
+        trace_set_enabled(0);
+    } else if (argc > 1 && strcmp(argv[1], "dump") == 0) {
+        const char *file = argc > 2 ? argv[2] : "trace.bin";
+        int ret = trace_dump(file); // 导出之后跟踪就停了
+        if (ret == -1) printf("trace: dump failed\n");
+        else printf("trace: wrote %d bytes to %s, convert with tools/trace2json.py\n", ret, file);
+        return ret == -1 ? -1 : 0;
+    } else if (argc > 1) {
+        printf("Usage: trace [on|off|dump [file]]\n");
+        return -1;
+    }
+    trace_print_status();
+    return 0;
+}
+
+// 每个控制台上最多挂一个后台程序，0表示没有；名字和命令行要一直留到程序自己读走，所以也按控制台各放一份
+static int con_jobs[NR_CONSOLES];
+static char con_names[NR_CONSOLES][MAX_CMD_LEN], con_cmdlines[NR_CONSOLES][MAX_CMD_LEN];
+
+// 后台程序没人waitpid，退出以后数据段一直不释放，在这里收掉
+static void con_reap()
+{
+    for (int n = 0; n < NR_CONSOLES; n++) {
+        task_stat_t st;
+        if (!con_jobs[n] || taskstat(con_jobs[n], &st) != con_jobs[n] || st.state != 4) continue;
+        int status = waitpid(con_jobs[n]);
+        printf("[con %d] %s (pid %d) exited with %d\n", n, st.name, con_jobs[n], status);
+        con_jobs[n] = 0;
+    }
+}
+
+// con：看看自己在哪个控制台；con N 程序 [参数...]：在控制台N上后台运行，Alt+F(N+1)切过去看
+int cmd_con(int argc, char **argv)
+{
+    con_reap();
+    if (argc == 1) {
+        printf("console %d, showing %d; Alt+F1..F%d switch, Shift+PgUp/PgDn scroll\n",
+               console_current(), console_foreground(), NR_CONSOLES);
+        for (int n = 0; n < NR_CONSOLES; n++) {
+            if (con_jobs[n]) printf("[con %d] pid %d: %s\n", n, con_jobs[n], con_cmdlines[n]);
+        }
+        return 0;
+    }
+    int n = argv[1][0] - '0';
+    if (argc < 3 || argv[1][1] || n < 0 || n >= NR_CONSOLES) {
+        printf("Usage: con [N program [args...]]\n");
+        return -1;
+    }
+    if (n == console_current() || con_jobs[n]) {
+        printf("con: console %d is busy\n", n);
+        return -1;
+    }
+    char *cmdline = con_cmdlines[n], *name = con_names[n];
+    int len = 0;
+    cmdline[0] = '\0';
+    for (int i = 2; i < argc; i++) { // 重新拼出命令行，去掉前面的con N
+        int k = strlen(argv[i]);
+        if (len + k + 2 > MAX_CMD_LEN) break;
+        if (i > 2) cmdline[len++] = ' ';
+        strcpy(cmdline + len, argv[i]);
+        len += k;
+    }
+    task_t *self = task_now();
+    int old = self->console;
+    self->console = n; // 子任务继承创建它的任务的控制台，借用一下
+    strcpy(name, argv[2]);
+    int pid = create_process(name, cmdline, "/");
+    if (pid == -1 && strlen(name) + 5 <= MAX_CMD_LEN) {
+        strcpy(name + strlen(name), ".bin"); // 再试试加上.bin
+        pid = create_process(name, cmdline, "/");
+    }
+    self->console = old;
+    if (pid == -1) {
+        printf("Command not found: %s\n", argv[2]);
+        return -1;
+    }
+    con_jobs[n] = pid;
+    printf("[con %d] pid %d, Alt+F%d to watch\n", n, pid, n + 1);
+    return 0;
+}
+
+static inline uint32_t rdtsc_lo()
+{
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return lo; // 单次测量不会超过2^32个周期，低32位够用
+}
+
+static inline uint64_t rdtsc64()
+{
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t) hi << 32) | lo;
+}
+
+static int parse_uint(const char *s)
+{
+    int v = 0;
+    for (; *s >= '0' && *s <= '9'; s++) v = v * 10 + (*s - '0');
+    return v;
+}
+
+// vbe [宽 高]：切到线性帧缓冲画一屏测试图，顺便测一下各个绘图原语要多少周期，按任意键回文本模式
+int cmd_vbe(int argc, char **argv)
+{
+    int w = argc > 2 ? parse_uint(argv[1]) : 1024, h = argc > 2 ? parse_uint(argv[2]) : 768;
+    if (fbcon_enabled()) { // 画完会回文本模式，帧缓冲控制台就没了
+        puts("vbe: framebuffer console is on, run 'fbcon off' first");
+        return -1;
+    }
+    uint32_t *sprite = (uint32_t *) kmalloc(128 * 128 * sizeof(uint32_t));
+    if (!sprite) return -1;
+    for (int y = 0; y < 128; y++) { // 中间不透明、往外越来越透明的圆
+        for (int x = 0; x < 128; x++) {
+            int d2 = (x - 64) * (x - 64) + (y - 64) * (y - 64);
+            int a = d2 >= 64 * 64 ? 0 : 255 - d2 * 255 / (64 * 64);
+            sprite[y * 128 + x] = (a << 24) | VBE_RGB(255, x * 2, y * 2);
+        }
+    }
+    if (vbe_init(w, h) == -1) {
+        kfree(sprite);
+        printf("vbe: cannot set %dx%d, no Bochs VBE adapter (qemu -vga std)?\n", w, h);
+        return -1;
+    }
+    uint32_t t0 = rdtsc_lo();
+    vbe_fill_rect(0, 0, w, h, VBE_RGB(0, 0, 64));
+    uint32_t t_fill = rdtsc_lo() - t0;
+    t0 = rdtsc_lo();
+    vbe_present();
+    uint32_t t_present = rdtsc_lo() - t0;
+    uint32_t *back = vbe_backbuffer();
+    for (int y = 0; y < h / 2; y++) { // 上半屏渐变，直接写后备缓冲区
+        for (int x = 0; x < w; x++) back[y * w + x] = VBE_RGB(x * 255 / w, y * 255 / (h / 2), 128);
+    }
+    vbe_mark_dirty(0, 0, w, h / 2);
+    for (int i = 0; i < 8; i++) vbe_fill_rect(32 + i * (w - 64) / 8, h / 2 + 32, (w - 64) / 8 - 8, h / 4, VBE_RGB(i & 1 ? 255 : 0, i & 2 ? 255 : 0, i & 4 ? 255 : 0));
+    t0 = rdtsc_lo();
+    for (int i = 0; i < 16; i++) vbe_blit_alpha(i * (w - 128) / 15, h / 2 - 64, 128, 128, sprite, 128);
+    uint32_t t_alpha = (rdtsc_lo() - t0) / 16;
+    t0 = rdtsc_lo();
+    vbe_blit(w - 160, h - 160, 128, 128, sprite, 128); // 不混合，alpha为0的地方也照样盖上去
+    uint32_t t_blit = rdtsc_lo() - t0;
+    vbe_present();
+    fifo_t *keys = console_keys(console_current());
+    while (!fifo_status(keys)) asm("hlt");
+    fifo_get(keys);
+    vbe_disable();
+    kfree(sprite);
+    printf("vbe %dx%d: fill %u, present %u, blit 128x128 %u, alpha blit 128x128 %u cycles\n",
+           w, h, t_fill, t_present, t_blit, t_alpha);
+    return 0;
+}
+
+// fbcon [宽 高|off]：控制台改用帧缓冲画字，1024x768就是128x48个字符
+int cmd_fbcon(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "off") == 0) {
+        fbcon_disable();
+        return 0;
+    }
+    int w = argc > 2 ? parse_uint(argv[1]) : 1024, h = argc > 2 ? parse_uint(argv[2]) : 768;
+    if (fbcon_enable(w, h) == -1) {
+        printf("fbcon: cannot set %dx%d, no Bochs VBE adapter (qemu -vga std)?\n", w, h);
+        return -1;
+    }
+    printf("fbcon: %dx%d, %d columns %d rows\n", w, h, console_cols(), console_rows());
+    return 0;
+}
+
+// irqstat [reset]：每条IRQ线的次数、自身耗时（不含嵌套进来的中断）和占总时间的比例
+int cmd_irqstat(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+        irq_reset_stats();
+        return 0;
+    }
+    uint64_t elapsed = rdtsc64() - irq_stat_start();
+    int shift = 0;
+    while ((elapsed >> shift) >= (1 << 22)) shift++; // 乘1000也不溢出32位，没有64位除法
+    uint32_t total = (uint32_t) (elapsed >> shift);
+    if (!total) total = 1;
+    printf("IRQ  handlers     count   cycles/irq   max cycles  nested   time\n");
+    for (int i = 0; i < NR_IRQS; i++) {
+        irq_stat_t st;
+        irq_get_stat(i, &st);
+        if (!st.count && !st.handlers) continue;
+        int s = 0;
+        while (st.cycles >> s > 0xFFFFFFFFu) s++;
+        uint32_t avg = st.count ? (uint32_t) (st.cycles >> s) / st.count << s : 0;
+        uint32_t permille = (uint32_t) (st.cycles >> shift) * 1000 / total;
+        printf("%3d  %8d  %8u  %11u  %11u  %6u  %2u.%u%%\n", i, st.handlers, st.count, avg, st.max_cycles, st.nested, permille / 10, permille % 10);
+    }
+    if (apic_enabled()) printf("controller: APIC, LAPIC timer %u Hz\n", apic_timer_hz());
+    else printf("controller: 8259 PIC, spurious: %u\n", irq_spurious());
+    return 0;
+}
+
+// cpus：每个CPU的APIC ID、时钟中断数、忙的比例（不在idle里的tick占多少）、运行队列长度和偷来的任务数
+extern taskctl_t *taskctl;
+
+int cmd_cpus(int argc, char **argv)
+{
+    printf("CPU  APIC       ticks   busy  runq  steals\n");
+    for (int i = 0; i < smp_cpu_count(); i++) {
+        cpu_t *cpu = &cpus[i];
+        uint32_t ticks = cpu->ticks, busy = ticks - cpu->idle_ticks;
+        uint32_t permille = ticks > 4000000 ? busy / (ticks / 1000) : ticks ? busy * 1000 / ticks : 0; // 乘1000别溢出
+        printf("%3d  %4d  %10u  %2u.%u%%  %4d  %6u\n", i, cpu->apic_id, ticks, permille / 10, permille % 10, taskctl->rq[i].running, cpu->steals);
+    }
+    return 0;
+}
+
 static int16_t tone[48000 * 2]; // 1秒 48kHz 立体声
 
 static void gen_tone(){
@@ -627,7 +995,7 @@ static void handle_internal_command(int argc, char **argv)
         monitor_clear();
     } 
     else if (strcmp(cmd, "help") == 0) {
-        puts("Available commands: ver, time, clear, help, echo, shutdown");
+        puts("Available commands: ver, time, clear, help, echo, shutdown, ps, top, prof, trace, con, vbe, fbcon, irqstat, cpus, acpi");
     } 
     else if (strcmp(cmd, "echo") == 0) {
         for (int i = 1; i < argc; i++) {
@@ -698,6 +1066,34 @@ static void handle_internal_command(int argc, char **argv)
         } else {
             printf("Usage: rm <file or directory>\n");
         }
+    } else if (strcmp(cmd, "journal") == 0) {
+        if (argc > 1 && strcmp(argv[1], "on") == 0) journal_set_enabled(1);
+        else if (argc > 1 && strcmp(argv[1], "off") == 0) journal_set_enabled(0);
+        else if (argc > 1) {
+            printf("Usage: journal [on|off]\n");
+            return;
+        }
+        printf("FAT16 journal: %s\n", journal_enabled() ? "on" : "off");
+    } else if (strcmp(cmd, "ps") == 0) {
+        cmd_ps();
+    } else if (strcmp(cmd, "top") == 0) {
+        cmd_top(argc, argv);
+    } else if (strcmp(cmd, "prof") == 0) {
+        cmd_prof(argc, argv);
+    } else if (strcmp(cmd, "trace") == 0) {
+        cmd_trace(argc, argv);
+    } else if (strcmp(cmd, "con") == 0) {
+        cmd_con(argc, argv);
+    } else if (strcmp(cmd, "vbe") == 0) {
+        cmd_vbe(argc, argv);
+    } else if (strcmp(cmd, "fbcon") == 0) {
+        cmd_fbcon(argc, argv);
+    } else if (strcmp(cmd, "irqstat") == 0) {
+        cmd_irqstat(argc, argv);
+    } else if (strcmp(cmd, "cpus") == 0) {
+        cmd_cpus(argc, argv);
+    } else if (strcmp(cmd, "acpi") == 0) {
+        acpiDump(); // 开机时不打印，想看固件给了哪些表就用这个
     }else if(strcmp(cmd, "demo") == 0) {
         //call_bios_int();
         //set_vga_mode();
@@ -758,6 +1154,17 @@ void execute_command(int argc, char **argv)
         strcmp(argv[0], "mkdir") == 0 ||
         strcmp(argv[0], "rm") == 0 ||
         strcmp(argv[0], "demo") == 0 ||
+        strcmp(argv[0], "journal") == 0 ||
+        strcmp(argv[0], "ps") == 0 ||
+        strcmp(argv[0], "top") == 0 ||
+        strcmp(argv[0], "prof") == 0 ||
+        strcmp(argv[0], "trace") == 0 ||
+        strcmp(argv[0], "con") == 0 ||
+        strcmp(argv[0], "vbe") == 0 ||
+        strcmp(argv[0], "fbcon") == 0 ||
+        strcmp(argv[0], "irqstat") == 0 ||
+        strcmp(argv[0], "cpus") == 0 ||
+        strcmp(argv[0], "acpi") == 0 ||
         strcmp(argv[0], "cls") == 0){
         handle_internal_command(argc, argv);
         return;
@@ -1,40 +1,67 @@
 #include "drivers/fifo.h"
 
+// 只挡住编译器重排；x86上写和写、读和读之间本来就不会乱序
+#define barrier() asm volatile("" : : : "memory")
+
 void fifo_init(fifo_t *fifo, int size, uint32_t *buf)
 {
-    fifo->size = size;
+    uint32_t cap = 1;
+    while (cap * 2 <= (uint32_t) size) cap *= 2; // 多出来的那点缓冲区就不用了
     fifo->buf = buf;
-    fifo->free = size;
+    fifo->mask = cap - 1;
     fifo->flags = 0;
-    fifo->p = 0;
-    fifo->q = 0;
+    fifo->head = 0;
+    fifo->tail = 0;
 }
 
 int fifo_put(fifo_t *fifo, uint32_t data)
 {
-    if (fifo->free == 0) {
+    uint32_t head = fifo->head;
+    if (head - fifo->tail > fifo->mask) {
         fifo->flags |= FIFO_FLAGS_OVERRUN;
         return -1;
     }
-    fifo->buf[fifo->p] = data;
-    fifo->p++;
-    if (fifo->p == fifo->size) fifo->p = 0;
-    fifo->free--;
+    fifo->buf[head & fifo->mask] = data;
+    barrier(); // 数据先写好，消费者才能看到新的head
+    fifo->head = head + 1;
     return 0;
 }
 
 int fifo_get(fifo_t *fifo)
 {
-    int data;
-    if (fifo->free == fifo->size) return -1;
-    data = fifo->buf[fifo->q];
-    fifo->q++;
-    if (fifo->q == fifo->size) fifo->q = 0;
-    fifo->free++;
+    uint32_t tail = fifo->tail;
+    if (tail == fifo->head) return -1;
+    barrier(); // 看到head以后再读数据
+    int data = fifo->buf[tail & fifo->mask];
+    barrier(); // 读完了才把位置还给生产者
+    fifo->tail = tail + 1;
     return data;
 }
 
+// 一次取一批，只更新一次tail；绕回开头的话分两段拷
+int fifo_get_bulk(fifo_t *fifo, uint32_t *out, int n)
+{
+    uint32_t tail = fifo->tail;
+    uint32_t avail = fifo->head - tail;
+    if (n <= 0 || !avail) return 0;
+    if ((uint32_t) n > avail) n = avail;
+    barrier();
+    uint32_t start = tail & fifo->mask;
+    uint32_t first = fifo->mask + 1 - start;
+    if (first > (uint32_t) n) first = n;
+    memcpy(out, fifo->buf + start, first * sizeof(uint32_t));
+    if (first < (uint32_t) n) memcpy(out + first, fifo->buf, (n - first) * sizeof(uint32_t));
+    barrier();
+    fifo->tail = tail + n;
+    return n;
+}
+
 int fifo_status(fifo_t *fifo)
 {
-    return fifo->size - fifo->free;
-}
\ No newline at end of file
+    return fifo->head - fifo->tail;
+}
+
+int fifo_space(fifo_t *fifo)
+{
+    return fifo->mask + 1 - (fifo->head - fifo->tail);
+}
@@ -0,0 +1,266 @@
+#include "format.h"
+#include "string.h"
+
+// 两位一组查表，除法次数减半
+static const char digit_pairs[201] =
+    "00010203040506070809101112131415161718192021222324"
+    "25262728293031323334353637383940414243444546474849"
+    "50515253545556575859606162636465666768697071727374"
+    "75767778798081828384858687888990919293949596979899";
+
+static void sink_write(format_sink_t *sink, const char *str, int n)
+{
+    sink->total += n;
+    while (n > 0) {
+        int room = sink->size - 1 - sink->len;
+        if (room <= 0) {
+            if (!sink->flush) return; // 截断，只计数
+            sink->flush(sink, 0);
+            room = sink->size - 1 - sink->len;
+            if (room <= 0) return;
+        }
+        int k = n < room ? n : room;
+        memcpy(sink->buf + sink->len, str, k);
+        sink->len += k;
+        str += k;
+        n -= k;
+    }
+}
+
+static void sink_pad(format_sink_t *sink, char ch, int n)
+{
+    char pad[16];
+    memset(pad, ch, sizeof(pad));
+    while (n > 0) {
+        int k = n < (int) sizeof(pad) ? n : (int) sizeof(pad);
+        sink_write(sink, pad, k);
+        n -= k;
+    }
+}
+
+// 从end往前写十进制数字，返回第一个数字的位置
+static char *utoa32_dec(uint32_t val, char *end)
+{
+    char *p = end;
+    while (val >= 100) {
+        uint32_t q = val / 100;
+        uint32_t r = val - q * 100;
+        p -= 2;
+        p[0] = digit_pairs[r * 2];
+        p[1] = digit_pairs[r * 2 + 1];
+        val = q;
+    }
+    if (val >= 10) {
+        p -= 2;
+        p[0] = digit_pairs[val * 2];
+        p[1] = digit_pairs[val * 2 + 1];
+    } else {
+        *--p = '0' + val;
+    }
+    return p;
+}
+
+// 64位数除以100，返回余数
+// 内核和应用程序都不链接libgcc，没有__udivdi3，只好拆成4段16位做长除法，每一步都在32位以内
+static uint32_t udiv64_100(uint64_t *n)
+{
+    uint32_t hi = (uint32_t) (*n >> 32), lo = (uint32_t) *n;
+    uint32_t limb[4] = {hi >> 16, hi & 0xffff, lo >> 16, lo & 0xffff};
+    uint32_t rem = 0;
+    for (int i = 0; i < 4; i++) {
+        uint32_t cur = (rem << 16) | limb[i]; // rem < 100，不会溢出
+        limb[i] = cur / 100;
+        rem = cur % 100;
+    }
+    *n = ((uint64_t) ((limb[0] << 16) | limb[1]) << 32) | ((limb[2] << 16) | limb[3]);
+    return rem;
+}
+
+static char *utoa64_dec(uint64_t val, char *end)
+{
+    char *p = end;
+    while (val >> 32) { // 高32位清空之后就交给32位的版本
+        uint32_t r = udiv64_100(&val);
+        p -= 2;
+        p[0] = digit_pairs[r * 2];
+        p[1] = digit_pairs[r * 2 + 1];
+    }
+    return utoa32_dec((uint32_t) val, p);
+}
+
+// 十六进制和八进制只需要移位
+static char *utoa_pow2(uint64_t val, int shift, int upper, char *end)
+{
+    const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    uint32_t mask = (1 << shift) - 1;
+    char *p = end;
+    uint32_t lo = (uint32_t) val;
+    if (val >> 32) {
+        do {
+            *--p = digits[(uint32_t) val & mask];
+            val >>= shift;
+        } while (val >> 32);
+        lo = (uint32_t) val;
+        if (!lo) return p;
+    }
+    do {
+        *--p = digits[lo & mask];
+        lo >>= shift;
+    } while (lo);
+    return p;
+}
+
+enum { LEN_NONE, LEN_HH, LEN_H, LEN_L, LEN_LL };
+
+int format(format_sink_t *sink, const char *fmt, va_list ap)
+{
+    sink->total = 0;
+    while (*fmt) {
+        const char *start = fmt;
+        while (*fmt && *fmt != '%') fmt++;
+        if (fmt > start) sink_write(sink, start, fmt - start); // 普通字符整段输出
+        if (!*fmt) break;
+        fmt++; // 跳过%
+        // 标志
+        int left = 0, zero = 0, plus = 0, space = 0, alt = 0;
+        while (1) {
+            if (*fmt == '-') left = 1;
+            else if (*fmt == '0') zero = 1;
+            else if (*fmt == '+') plus = 1;
+            else if (*fmt == ' ') space = 1;
+            else if (*fmt == '#') alt = 1;
+            else break;
+            fmt++;
+        }
+        // 宽度
+        int width = 0;
+        if (*fmt == '*') {
+            width = va_arg(ap, int);
+            if (width < 0) { // 负的宽度等于左对齐
+                left = 1;
+                width = -width;
+            }
+            fmt++;
+        } else {
+            while (*fmt >= '0' && *fmt <= '9') width = width * 10 + (*fmt++ - '0');
+        }
+        // 精度，-1表示没有指定
+        int precision = -1;
+        if (*fmt == '.') {
+            fmt++;
+            precision = 0;
+            if (*fmt == '*') {
+                precision = va_arg(ap, int);
+                if (precision < 0) precision = -1;
+                fmt++;
+            } else {
+                while (*fmt >= '0' && *fmt <= '9') precision = precision * 10 + (*fmt++ - '0');
+            }
+        }
+        // 长度
+        int length = LEN_NONE;
+        if (*fmt == 'h') {
+            fmt++;
+            length = LEN_H;
+            if (*fmt == 'h') { fmt++; length = LEN_HH; }
+        } else if (*fmt == 'l') {
+            fmt++;
+            length = LEN_L;
+            if (*fmt == 'l') { fmt++; length = LEN_LL; }
+        } else if (*fmt == 'j') {
+            fmt++;
+            length = LEN_LL;
+        } else if (*fmt == 'z' || *fmt == 't') {
+            fmt++; // size_t和ptrdiff_t都是32位，与int一样
+        }
+        char conv = *fmt;
+        if (!conv) break; // 格式串在%后面就结束了
+        fmt++;
+
+        if (conv == '%') {
+            sink_write(sink, "%", 1);
+            continue;
+        }
+        if (conv == 'c') {
+            char ch = (char) va_arg(ap, int);
+            if (!left) sink_pad(sink, ' ', width - 1);
+            sink_write(sink, &ch, 1);
+            if (left) sink_pad(sink, ' ', width - 1);
+            continue;
+        }
+        if (conv == 's') {
+            const char *str = va_arg(ap, const char *);
+            if (!str) str = "(null)";
+            int n = 0;
+            while (str[n] && (precision < 0 || n < precision)) n++; // 有精度时最多输出这么多个
+            if (!left) sink_pad(sink, ' ', width - n);
+            sink_write(sink, str, n);
+            if (left) sink_pad(sink, ' ', width - n);
+            continue;
+        }
+
+        // 剩下的都是整数
+        uint64_t uval;
+        int negative = 0;
+        if (conv == 'd' || conv == 'i') {
+            int64_t sval;
+            if (length == LEN_LL) sval = va_arg(ap, int64_t);
+            else sval = va_arg(ap, int);
+            if (length == LEN_HH) sval = (int8_t) sval;
+            else if (length == LEN_H) sval = (int16_t) sval;
+            if (sval < 0) {
+                negative = 1;
+                uval = -(uint64_t) sval; // 先转无符号再取负，最小的负数也不会溢出
+            } else uval = sval;
+        } else if (conv == 'u' || conv == 'x' || conv == 'X' || conv == 'o') {
+            if (length == LEN_LL) uval = va_arg(ap, uint64_t);
+            else uval = va_arg(ap, uint32_t);
+            if (length == LEN_HH) uval = (uint8_t) uval;
+            else if (length == LEN_H) uval = (uint16_t) uval;
+        } else if (conv == 'p') {
+            uval = (uint32_t) va_arg(ap, void *);
+            conv = 'x';
+            alt = 1;
+            if (precision < 0) precision = 8; // 指针总是输出8位
+        } else { // 不认识的转换，原样输出
+            sink_write(sink, "%", 1);
+            sink_write(sink, &conv, 1);
+            continue;
+        }
+
+        char tmp[24]; // 64位八进制最多22位
+        char *end = tmp + sizeof(tmp), *digits;
+        if (conv == 'x' || conv == 'X') digits = utoa_pow2(uval, 4, conv == 'X', end);
+        else if (conv == 'o') digits = utoa_pow2(uval, 3, 0, end);
+        else if (uval >> 32) digits = utoa64_dec(uval, end);
+        else digits = utoa32_dec((uint32_t) uval, end);
+        int ndigits = end - digits;
+        if (precision == 0 && uval == 0) ndigits = 0; // C标准：精度为0时0不输出任何数字
+
+        char prefix[3];
+        int nprefix = 0;
+        if (negative) prefix[nprefix++] = '-';
+        else if ((conv == 'd' || conv == 'i') && plus) prefix[nprefix++] = '+';
+        else if ((conv == 'd' || conv == 'i') && space) prefix[nprefix++] = ' ';
+        if (alt && (conv == 'x' || conv == 'X') && uval) {
+            prefix[nprefix++] = '0';
+            prefix[nprefix++] = conv;
+        }
+        int zeros = precision > ndigits ? precision - ndigits : 0;
+        if (alt && conv == 'o' && !zeros && (ndigits == 0 || digits[0] != '0')) zeros = 1; // #o保证以0开头
+        int body = nprefix + zeros + ndigits;
+        if (zero && !left && precision < 0) { // 用0填充宽度，0要放在符号和0x后面
+            zeros += width - body;
+            if (zeros < 0) zeros = 0;
+            body = nprefix + zeros + ndigits;
+        }
+        if (!left) sink_pad(sink, ' ', width - body);
+        sink_write(sink, prefix, nprefix);
+        sink_pad(sink, '0', zeros);
+        sink_write(sink, digits, ndigits);
+        if (left) sink_pad(sink, ' ', width - body);
+    }
+    if (sink->flush) sink->flush(sink, 1);
+    else if (sink->size > 0) sink->buf[sink->len] = 0; // 截断时也保证以\0结尾
+    return sink->total;
+}
@@ -5,9 +5,7 @@ int printk(const char *fmt, ...)
 {
     va_list ap;
     va_start(ap, fmt);
-    char buf[1024] = {0};
-    int ret = vsprintf(buf, fmt, ap);
+    int ret = monitor_vprintf(fmt, ap); // 直接格式化到屏幕，不再经过1KB的栈缓冲区
     va_end(ap);
-    monitor_write(buf);
     return ret;
 }
\ No newline at end of file
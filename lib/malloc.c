@@ -1,81 +1,237 @@
 #include <unistd.h>
 #include <stddef.h>
+#include <string.h>
 
-typedef char ALIGN[16];
+// 分级空闲链表 + 边界标记的malloc
+// 每块前面有8字节的块头，空闲块的用户区里放前后指针；空闲块的大小还会记在下一块块头的prev_size里，
+// 这样free时前后两块都能O(1)找到并合并。空闲块按大小挂在不同的桶里，小块每8字节一个桶，大块每2倍一个桶
 
-typedef union header {
-    struct {
-        uint32_t size;
-        uint32_t is_free;
-        union header *next;
-    } s;
-    ALIGN stub;
-} header_t;
+typedef struct BLOCK {
+    uint32_t prev_size; // 前一块空闲时有效，就是前一块的大小（边界标记）
+    uint32_t size; // 本块大小，含块头；低两位借来当标志
+    struct BLOCK *next, *prev; // 只有空闲块才有，占的是用户区
+} block_t;
 
-static header_t *head, *tail;
+#define HDR_SIZE 8 // 块头只有prev_size和size
+#define MIN_BLOCK (HDR_SIZE + 2 * sizeof(block_t *)) // 空闲块至少要放得下两个指针，也就是16字节
+#define IN_USE 1 // 本块在用
+#define PREV_IN_USE 2 // 前一块在用
+#define SIZE_MASK (~7u)
 
-// 寻找一个符合条件的指定大小的空闲内存块
-static header_t *get_free_block(uint32_t size)
+#define SMALL_BINS 32 // 16~256字节，每8字节一个桶，桶里的块大小都一样
+#define NBINS (SMALL_BINS + 24) // 之后每个桶覆盖[2^k, 2^(k+1))
+#define SBRK_CHUNK (64 * 1024) // 一次至少向系统要这么多，省得频繁sbrk
+#define TRIM_THRESHOLD (128 * 1024) // 堆顶空闲超过这么多才还给系统
+
+static block_t *bins[NBINS];
+static uint32_t binmap[2]; // 哪些桶不空，找块时直接跳过空桶
+static block_t *heap_fence; // 最近一段堆末尾的哨兵块
+
+#define BLOCK_SIZE(b) ((b)->size & SIZE_MASK)
+#define NEXT_BLOCK(b) ((block_t *) ((char *) (b) + BLOCK_SIZE(b)))
+
+static int bin_index(uint32_t size)
 {
-    header_t *curr = head; // 从头开始
-    while (curr) {
-        if (curr->s.is_free && curr->s.size >= size) return curr; // 空闲，并且大小也满足条件，直接返回
-        curr = curr->s.next; // 下一位
+    if (size < 256 + 16) return (size >> 3) - 2; // 16 -> 0, 264 -> 31
+    int idx = SMALL_BINS;
+    size >>= 9; // 272~511 -> 0，512~1023 -> 1 ...
+    while (size && idx < NBINS - 1) {
+        size >>= 1;
+        idx++;
     }
-    return NULL; // 找不到
+    return idx;
 }
 
-void *malloc(uint32_t size)
+static void bin_insert(block_t *b)
+{
+    int idx = bin_index(BLOCK_SIZE(b));
+    b->prev = NULL;
+    b->next = bins[idx];
+    if (bins[idx]) bins[idx]->prev = b;
+    bins[idx] = b;
+    binmap[idx >> 5] |= 1u << (idx & 31);
+}
+
+static void bin_remove(block_t *b)
+{
+    int idx = bin_index(BLOCK_SIZE(b));
+    if (b->prev) b->prev->next = b->next;
+    else bins[idx] = b->next;
+    if (b->next) b->next->prev = b->prev;
+    if (!bins[idx]) binmap[idx >> 5] &= ~(1u << (idx & 31));
+}
+
+// 把b标记为空闲并告诉下一块，但不挂进桶里
+static void set_free(block_t *b, uint32_t size)
+{
+    b->size = size | (b->size & PREV_IN_USE);
+    block_t *next = NEXT_BLOCK(b);
+    next->prev_size = size;
+    next->size &= ~PREV_IN_USE;
+}
+
+// 从在用的块b里切出need大小，剩下的够大就变成新的空闲块
+static void split(block_t *b, uint32_t need)
+{
+    uint32_t size = BLOCK_SIZE(b);
+    if (size - need < MIN_BLOCK) return; // 剩下的太小，就不切了
+    b->size = need | (b->size & (IN_USE | PREV_IN_USE));
+    block_t *rest = NEXT_BLOCK(b);
+    rest->size = PREV_IN_USE; // 前面就是b，在用
+    set_free(rest, size - need);
+    block_t *next = NEXT_BLOCK(rest);
+    if (!(next->size & IN_USE)) { // 后面本来就是空闲块（realloc缩小时会出现），合起来
+        bin_remove(next);
+        set_free(rest, BLOCK_SIZE(rest) + BLOCK_SIZE(next));
+    }
+    bin_insert(rest);
+}
+
+// 在桶里找一块至少need大的空闲块
+static block_t *find_block(uint32_t need)
+{
+    int idx = bin_index(need);
+    for (int i = idx; i < NBINS; i++) {
+        if (!(binmap[i >> 5] & (1u << (i & 31)))) { // 空桶
+            if ((i & 31) == 0 && !binmap[i >> 5]) i += 31; // 这32个桶全空
+            continue;
+        }
+        if (i < SMALL_BINS) return bins[i]; // 小块桶里的块大小都一样，第一块就行
+        for (block_t *b = bins[i]; b; b = b->next) { // 大块桶里首次适配
+            if (BLOCK_SIZE(b) >= need) return b;
+        }
+    }
+    return NULL;
+}
+
+// 向系统要一段至少能放下need的内存，挂成空闲块
+static block_t *grow_heap(uint32_t need)
 {
-    uint32_t total_size;
-    void *block;
-    header_t *header;
-    if (!size) return NULL; // size == 0，自然不用返回
-    header = get_free_block(size);
-    if (header) { // 找到了对应的header！
-        header->s.is_free = 0;
-        return (void *) (header + 1);
-        // header + 1，相当于把header的值在指针上后移了一个header_t，从而在返回的内存中不存在覆写header的现象
+    uint32_t incr = need + HDR_SIZE; // 还要放新的哨兵
+    if (incr < SBRK_CHUNK) incr = SBRK_CHUNK;
+    incr = (incr + 4095) & ~4095;
+    char *mem = sbrk(0);
+    uint32_t pad = (8 - ((uint32_t) mem & 7)) & 7; // 块头要8字节对齐
+    mem = sbrk(incr + pad);
+    if (mem == (void *) -1 || mem == NULL) return NULL;
+    mem += pad;
+    block_t *b;
+    uint32_t size;
+    if (heap_fence && (char *) heap_fence + HDR_SIZE == mem && !pad) { // 紧接着上一段，旧哨兵变成新块的块头
+        b = heap_fence;
+        size = incr;
+    } else { // 中间隔着别的东西（比如mmap），另起一段
+        b = (block_t *) mem;
+        b->size = PREV_IN_USE; // 一段的开头，不会往前合并
+        size = incr - HDR_SIZE;
     }
-    // 否则，申请内存
-    total_size = sizeof(header_t) + size; // 需要一处放header的空间
-    block = sbrk(total_size); // sbrk，申请total_size大小内存
-    if (block == (void *) -1) return NULL; // 没有足够的内存，返回NULL
-    // 申请成功！
-    header = block; // 初始化header
-    header->s.size = size;
-    header->s.is_free = 0;
-    header->s.next = NULL;
-    if (!head) head = header; // 第一个还是空的，直接设为header
-    if (tail) tail->s.next = header; // 有最后一个，把最后一个的next指向header
-    tail = header; // header荣登最后一个
-    return (void *) (header + 1); // 同上
+    block_t *fence = (block_t *) ((char *) b + size);
+    fence->size = IN_USE; // 哨兵永远在用，合并到这里就停
+    heap_fence = fence;
+    set_free(b, size);
+    if (!(b->size & PREV_IN_USE)) { // 旧哨兵前面是空闲块，合起来
+        block_t *prev = (block_t *) ((char *) b - b->prev_size);
+        bin_remove(prev);
+        set_free(prev, BLOCK_SIZE(prev) + size);
+        b = prev;
+    }
+    bin_insert(b);
+    return b;
+}
+
+static uint32_t request_size(uint32_t size)
+{
+    uint32_t need = (size + HDR_SIZE + 7) & ~7;
+    return need < MIN_BLOCK ? MIN_BLOCK : need;
+}
+
+void *malloc(uint32_t size)
+{
+    if (!size || size > 0x7fffffff) return NULL; // size == 0，自然不用返回
+    uint32_t need = request_size(size);
+    block_t *b = find_block(need);
+    if (!b) b = grow_heap(need); // 桶里没有，向系统要
+    if (!b) return NULL; // 没有足够的内存，返回NULL
+    bin_remove(b);
+    b->size |= IN_USE;
+    NEXT_BLOCK(b)->size |= PREV_IN_USE;
+    split(b, need);
+    return (char *) b + HDR_SIZE;
+}
+
+// 堆顶的空闲块太大时还给系统
+static void trim(block_t *b)
+{
+    if (NEXT_BLOCK(b) != heap_fence) return; // 不在堆顶
+    if ((char *) heap_fence + HDR_SIZE != sbrk(0)) return; // 后面还有别人sbrk出去的东西
+    uint32_t size = BLOCK_SIZE(b);
+    if (size < TRIM_THRESHOLD) return;
+    uint32_t release = (size - SBRK_CHUNK) & ~4095; // 留一点，马上又要用时不必再sbrk
+    if (!release) return;
+    bin_remove(b);
+    set_free(b, size - release);
+    block_t *fence = NEXT_BLOCK(b);
+    fence->size = IN_USE;
+    heap_fence = fence;
+    bin_insert(b);
+    sbrk(-(int) release);
 }
 
 void free(void *block)
 {
-    header_t *header, *tmp;
     if (!block) return; // free(NULL)，有什么用捏
-    header = (header_t *) block - 1; // 减去一个header_t的大小，刚好指向header_t
-
-    if ((char *) block + header->s.size == sbrk(0)) { // 正好在堆末尾
-        if (head == tail) head = tail = NULL; // 只有一个内存块，全部清空
-        else {
-            // 遍历整个内存块链表，找到对应的内存块，并把它从链表中删除
-            tmp = head;
-            while (tmp) {
-                // 如果内存在堆末尾，那这个块肯定也在链表末尾
-                if (tmp->s.next == tail) { // 下一个就是原本末尾
-                    tmp->s.next = NULL; // 踢掉
-                    tail = tmp; // 末尾位置顶替
-                }
-                tmp = tmp->s.next; // 下一个
-            }
-        }
-        // 释放这一块内存
-        sbrk(0 - sizeof(header_t) - header->s.size);
-        return;
+    block_t *b = (block_t *) ((char *) block - HDR_SIZE);
+    uint32_t size = BLOCK_SIZE(b);
+    b->size &= ~IN_USE;
+    block_t *next = NEXT_BLOCK(b);
+    if (!(next->size & IN_USE)) { // 后一块空闲，合并
+        bin_remove(next);
+        size += BLOCK_SIZE(next);
     }
-    // 否则，设置为free
-    header->s.is_free = 1;
-}
\ No newline at end of file
+    if (!(b->size & PREV_IN_USE)) { // 前一块空闲，合并，边界标记告诉我们它从哪开始
+        block_t *prev = (block_t *) ((char *) b - b->prev_size);
+        bin_remove(prev);
+        size += BLOCK_SIZE(prev);
+        b = prev;
+    }
+    set_free(b, size);
+    bin_insert(b);
+    trim(b);
+}
+
+void *calloc(uint32_t nmemb, uint32_t size)
+{
+    if (size && nmemb > 0xffffffff / size) return NULL; // 乘法溢出
+    void *p = malloc(nmemb * size);
+    if (p) memset(p, 0, nmemb * size);
+    return p;
+}
+
+void *realloc(void *block, uint32_t size)
+{
+    if (!block) return malloc(size);
+    if (!size) {
+        free(block);
+        return NULL;
+    }
+    if (size > 0x7fffffff) return NULL;
+    block_t *b = (block_t *) ((char *) block - HDR_SIZE);
+    uint32_t need = request_size(size), cur = BLOCK_SIZE(b);
+    if (cur >= need) { // 原地缩小
+        split(b, need);
+        return block;
+    }
+    block_t *next = NEXT_BLOCK(b);
+    if (!(next->size & IN_USE) && cur + BLOCK_SIZE(next) >= need) { // 后面的空闲块够用，原地扩大
+        bin_remove(next);
+        b->size += BLOCK_SIZE(next);
+        NEXT_BLOCK(b)->size |= PREV_IN_USE;
+        split(b, need);
+        return block;
+    }
+    void *p = malloc(size); // 只能搬家了
+    if (!p) return NULL;
+    memcpy(p, block, cur - HDR_SIZE);
+    free(block);
+    return p;
+}
@@ -8,29 +8,86 @@
 const ACPIFadt *acpiFadt = NULL;
 const ACPIHeader *acpiDsdt = NULL;
 const ACPIHeader *acpiSsdt = NULL;
+ACPIMadtInfo acpiMadt;
 
-void *pa2va(unsigned long physAddr);
+// 开机时只记下表在哪里，不切ACPI模式：关机要用时再acpiEnable
+static const ACPIHeader *rsdtTable = NULL;
+static const void *fadtTable = NULL;
+static const void *ssdtTable = NULL;
 
 static int parseDT(ACPIHeader *dt)
 {
    u32 signature = dt->signature;
-   char signatureString[5];
-   memcpy((void *)signatureString, (const void *)&signature, 4);
-   signatureString[4] = '\0';
-   printk("Found device %s from ACPI.\n", signatureString);
- 
    if (signature == *(u32 *)"APIC") {
       parseApic((ACPIHeaderApic *)dt);
-   } else if (signature == *(u32 *)"HPET") {
-      parseHpet((ACPIHeaderHpet *)dt);
    } else if (signature == *(u32 *)"FACP") {
-      acpiEnable(dt, 0); // FADT
+      if (!fadtTable) fadtTable = dt; // FADT
    } else if (signature == *(u32 *)"SSDT") {
-      acpiEnable(0, dt); // SSDT
+      if (!ssdtTable) ssdtTable = dt; // SSDT
    }
    return 0;
 }
 
+static void dumpApic(const ACPIHeaderApic *apic);
+
+static int checksumOk(const void *p, u32 len)
+{
+   u8 sum = 0;
+   for (u32 i = 0; i < len; i++) sum += ((const u8 *)p)[i];
+   return sum == 0;
+}
+
+// RSDP按16字节对齐放在EBDA的前1KB或者BIOS区0xE0000~0xFFFFF里
+static const ACPIRsdp *findRsdp(u32 start, u32 len)
+{
+   for (u32 addr = start; addr < start + len; addr += 16) {
+      const ACPIRsdp *rsdp = (const ACPIRsdp *)pa2va(addr);
+      if (memcmp(rsdp->signature, "RSD PTR ", 8) == 0 && checksumOk(rsdp, 20)) return rsdp;
+   }
+   return NULL;
+}
+
+int acpiInit(void)
+{
+   static int found = -1;
+   if (found != -1) return found ? 0 : -1; // 只扫一遍
+   found = 0;
+   const ACPIRsdp *rsdp = NULL;
+   u32 ebda = *(u16 *)pa2va(0x40E) << 4; // BDA里记着EBDA的段地址
+   if (ebda) rsdp = findRsdp(ebda, 1024);
+   if (!rsdp) rsdp = findRsdp(0xE0000, 0x20000);
+   if (!rsdp) return -1;
+
+   ACPIHeader *rsdt = (ACPIHeader *)pa2va(rsdp->rsdt);
+   if (rsdt->signature != *(u32 *)"RSDT" || !checksumOk(rsdt, rsdt->length)) return -1;
+   u32 *entries = (u32 *)(rsdt + 1);
+   int count = (rsdt->length - sizeof(ACPIHeader)) / sizeof(u32);
+   for (int i = 0; i < count; i++) parseDT((ACPIHeader *)pa2va(entries[i]));
+   rsdtTable = rsdt;
+   found = 1;
+   return 0;
+}
+
+// acpi命令：把RSDT里的表和MADT、HPET的内容打出来
+void acpiDump(void)
+{
+   if (acpiInit() == -1) {
+      printk("No ACPI tables found.\n");
+      return;
+   }
+   const u32 *entries = (const u32 *)(rsdtTable + 1);
+   int count = (rsdtTable->length - sizeof(ACPIHeader)) / sizeof(u32);
+   for (int i = 0; i < count; i++) {
+      ACPIHeader *dt = (ACPIHeader *)pa2va(entries[i]);
+      char signatureString[5];
+      memcpy((void *)signatureString, (const void *)&dt->signature, 4);
+      signatureString[4] = '\0';
+      printk("Found device %s from ACPI.\n", signatureString);
+      if (dt->signature == *(u32 *)"APIC") dumpApic((ACPIHeaderApic *)dt);
+      else if (dt->signature == *(u32 *)"HPET") parseHpet((ACPIHeaderHpet *)dt);
+   }
+}
+
 int acpiEnable(const void *fadt, const void *ssdt)
 {
    // 设置SSDT（如果提供且尚未设置）
@@ -58,13 +115,15 @@ int acpiEnable(const void *fadt, const void *ssdt)
       outb(acpiFadt->smiCommandPort, acpiFadt->acpiEnable);
       
       // 等待主控制寄存器启用
-      while (!(inw(acpiFadt->pm1aCntBlk) & SCI_ENABLED)) {
+      int timeout = 1000000; // 只在关机时才会走到这里，固件不理睬也不能让关机卡死
+      while (!(inw(acpiFadt->pm1aCntBlk) & SCI_ENABLED) && --timeout) {
           asm volatile("pause");
       }
       
       // 如果存在辅控制寄存器，等待其启用
       if (acpiFadt->pm1bCntBlk) {
-          while (!(inw(acpiFadt->pm1bCntBlk) & SCI_ENABLED)) {
+          timeout = 1000000;
+          while (!(inw(acpiFadt->pm1bCntBlk) & SCI_ENABLED) && --timeout) {
               asm volatile("pause");
           }
       }
@@ -160,6 +219,7 @@ static void tryKbcPowerOff(void) {
 int doPowerOff(void)
 {
    closeInterrupt();
+   if (acpiInit() == 0 && fadtTable) acpiEnable(fadtTable, ssdtTable); // 到这时才切到ACPI模式
    const ACPIHeader *dt = acpiDsdt; // 先尝试DSDT
    
    // 优先尝试各种备选关机方法（立即尝试）
@@ -376,8 +436,8 @@ int doReboot(void)
 // ==================== 辅助函数 ====================
 
 void *pa2va(unsigned long physAddr) {
-   // 物理地址到虚拟地址转换
-   return (void *)(physAddr + 0xFFFF800000000000); // 示例偏移
+   // 没开分页，物理地址就是线性地址
+   return (void *)physAddr;
 }
 
 void closeInterrupt(void) {
@@ -395,36 +455,45 @@ void parseApic(ACPIHeaderApic *apic)
     u8 *record_ptr = (u8 *)(apic + 1);
     u8 *table_end = (u8 *)apic + apic->header.length;
 
-    // 解析本地APIC地址
-    printk("Local APIC address: 0x%08X\n", apic->localApicAddress);
+    acpiMadt.lapicAddress = apic->localApicAddress;
+    for (int i = 0; i < 16; i++) {
+        acpiMadt.isaGsi[i] = i;
+        acpiMadt.isaFlags[i] = 0;
+    }
 
     // 遍历APIC表中的所有记录
     while (record_ptr < table_end) {
         ACPIApicRecord *record = (ACPIApicRecord *)record_ptr;
-        
+        // 长度为0的坏记录会让循环原地打转，越过表尾的也不能再信
+        if (record->length < 2 || record_ptr + record->length > table_end) break;
+
         switch (record->type) {
             case 0: // Processor Local APIC
                 {
                     ACPIApicProcessor *proc = (ACPIApicProcessor *)record;
-                    printk("Processor LAPIC: ID=%d, APIC ID=%d, Flags=0x%02X\n",
-                           proc->processorId, proc->apicId, proc->flags);
+                    if ((proc->flags & 1) && acpiMadt.cpuCount < ACPI_MAX_CPUS) { // 第0位是处理器可用
+                        acpiMadt.cpuApicIds[acpiMadt.cpuCount++] = proc->apicId;
+                    }
                 }
                 break;
                 
             case 1: // I/O APIC
                 {
                     ACPIApicIo *io = (ACPIApicIo *)record;
-                    printk("I/O APIC: ID=%d, Base Address=0x%08X, GSI=%d\n",
-                           io->ioApicId, io->ioApicAddress, io->globalSystemInterruptBase);
+                    if (!acpiMadt.ioapicAddress) { // 只用第一个，ISA的中断都在它上面
+                        acpiMadt.ioapicAddress = io->ioApicAddress;
+                        acpiMadt.ioapicGsiBase = io->globalSystemInterruptBase;
+                    }
                 }
                 break;
                 
             case 2: // Interrupt Source Override
                 {
                     ACPIApicIntOverride *override = (ACPIApicIntOverride *)record;
-                    printk("Int Override: Bus=%d, Source=%d, GSI=%d, Flags=0x%02X\n",
-                           override->bus, override->source, override->globalSystemInterrupt, 
-                           override->flags);
+                    if (override->bus == 0 && override->source < 16) { // 总线0是ISA
+                        acpiMadt.isaGsi[override->source] = override->globalSystemInterrupt;
+                        acpiMadt.isaFlags[override->source] = override->flags;
+                    }
                 }
                 break;
         }
@@ -433,6 +502,36 @@ void parseApic(ACPIHeaderApic *apic)
     }
 }
 
+// 只打印，不改acpiMadt
+static void dumpApic(const ACPIHeaderApic *apic)
+{
+    if (!apic || apic->header.length < sizeof(ACPIHeaderApic)) {
+        return;
+    }
+    const u8 *record_ptr = (const u8 *)(apic + 1);
+    const u8 *table_end = (const u8 *)apic + apic->header.length;
+    printk("Local APIC address: 0x%08X\n", apic->localApicAddress);
+    while (record_ptr < table_end) {
+        const ACPIApicRecord *record = (const ACPIApicRecord *)record_ptr;
+        if (record->length < 2 || record_ptr + record->length > table_end) break; // 同parseApic
+        if (record->type == 0) {
+            const ACPIApicProcessor *proc = (const ACPIApicProcessor *)record;
+            printk("Processor LAPIC: ID=%d, APIC ID=%d, Flags=0x%02X\n",
+                   proc->processorId, proc->apicId, proc->flags);
+        } else if (record->type == 1) {
+            const ACPIApicIo *io = (const ACPIApicIo *)record;
+            printk("I/O APIC: ID=%d, Base Address=0x%08X, GSI=%d\n",
+                   io->ioApicId, io->ioApicAddress, io->globalSystemInterruptBase);
+        } else if (record->type == 2) {
+            const ACPIApicIntOverride *override = (const ACPIApicIntOverride *)record;
+            printk("Int Override: Bus=%d, Source=%d, GSI=%d, Flags=0x%02X\n",
+                   override->bus, override->source, override->globalSystemInterrupt,
+                   override->flags);
+        }
+        record_ptr += record->length;
+    }
+}
+
 void parseHpet(ACPIHeaderHpet *hpet)
 {
     // 验证HPET表头
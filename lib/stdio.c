@@ -1,7 +1,16 @@
 #include "monios/common.h"
 #include "stdarg.h" // 在开头添加，因为用到了va_list以及操纵va_list的这些东西
+#include "stdio.h"
+#include "unistd.h"
+#include "format.h"
 
-typedef unsigned int size_t;
+static char stdout_buf[BUFSIZ];
+
+// 标准输出默认行缓冲，遇到\n才真正write；标准错误不缓冲，出错信息要马上看到
+static FILE stdout_file = {1, _IOLBF, stdout_buf, BUFSIZ, 0, 0};
+static FILE stderr_file = {2, _IONBF, NULL, 0, 0, 0};
+FILE *stdout = &stdout_file;
+FILE *stderr = &stderr_file;
 
 // 字符串连接函数
 char *strcat(char *dest, const char *src) {
@@ -25,142 +34,140 @@ char *strrchr(const char *s, int c) {
 }
 
 
-int snprintf(char *buf, size_t size, const char *fmt, ...) {
-    va_list args;
-    va_start(args, fmt);
-    int count = 0;
-    char *ptr = buf;
-    
-    while (*fmt && count < size - 1) {
-        if (*fmt == '%') {
-            fmt++;
-            switch (*fmt) {
-                case 'd': {
-                    int num = va_arg(args, int);
-                    char num_buf[32];
-                    int i = 0;
-                    
-                    if (num < 0) {
-                        *ptr++ = '-';
-                        count++;
-                        num = -num;
-                    }
-                    
-                    do {
-                        num_buf[i++] = '0' + (num % 10);
-                        num /= 10;
-                    } while (num > 0);
-                    
-                    while (--i >= 0 && count < size - 1) {
-                        *ptr++ = num_buf[i];
-                        count++;
-                    }
-                    break;
-                }
-                case 's': {
-                    char *str = va_arg(args, char*);
-                    while (*str && count < size - 1) {
-                        *ptr++ = *str++;
-                        count++;
-                    }
-                    break;
-                }
-                case 'c': {
-                    char c = (char)va_arg(args, int);
-                    if (count < size - 1) {
-                        *ptr++ = c;
-                        count++;
-                    }
-                    break;
-                }
-                default:
-                    if (count < size - 1) {
-                        *ptr++ = *fmt;
-                        count++;
-                    }
-            }
-        } else {
-            *ptr++ = *fmt;
-            count++;
+int vsnprintf(char *buf, size_t size, const char *fmt, va_list ap)
+{
+    format_sink_t sink = {buf, size, 0, 0, NULL, NULL}; // 写满就截断
+    return format(&sink, fmt, ap); // 返回完整输出应有的长度
+}
+
+int snprintf(char *buf, size_t size, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    int ret = vsnprintf(buf, size, fmt, ap);
+    va_end(ap);
+    return ret;
+}
+
+int vsprintf(char *buf, const char *fmt, va_list ap)
+{
+    return vsnprintf(buf, 0x7fffffff, fmt, ap); // 不知道buf多大，只好当它无限大
+}
+
+int sprintf(char *buf, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    int ret = vsprintf(buf, fmt, ap);
+    va_end(ap);
+    return ret;
+}
+
+// 把缓冲区里攒着的东西一次write出去
+int fflush(FILE *stream)
+{
+    int done = 0;
+    while (done < stream->len) {
+        int ret = write(stream->fd, stream->buf + done, stream->len - done);
+        if (ret <= 0) { // 写不进去了，剩下的丢掉
+            stream->error = 1;
+            stream->len = 0;
+            return EOF;
         }
-        fmt++;
+        done += ret;
     }
-    
-    *ptr = '\0';
-    va_end(args);
-    return count;
+    stream->len = 0;
+    return 0;
 }
 
-static void itoa(uint32_t num, char **buf_ptr_addr, int radix)
+int setvbuf(FILE *stream, char *buf, int mode, size_t size)
 {
-    uint32_t m = num % radix; // 最低位
-    uint32_t i = num / radix; // 最高位
-    if (i) itoa(i, buf_ptr_addr, radix); // 先把高位化为字符串
-    if (m < 10) { // 处理最低位
-        *((*buf_ptr_addr)++) = m + '0'; // 0~9，直接加0
-    } else {
-        *((*buf_ptr_addr)++) = m - 10 + 'A'; // 10~15，10~15->0~5->A~F
+    if (mode != _IOFBF && mode != _IOLBF && mode != _IONBF) return -1;
+    fflush(stream); // 换缓冲区之前先把旧的清空
+    stream->mode = mode;
+    if (mode == _IONBF) {
+        stream->buf = NULL;
+        stream->size = 0;
+    } else if (buf) {
+        stream->buf = buf;
+        stream->size = size;
+    } else if (!stream->buf) { // 没给缓冲区，原来也没有，就用不了缓冲
+        return -1;
     }
+    return 0;
 }
 
-int vsprintf(char *buf, const char *fmt, va_list ap)
+size_t fwrite(const void *ptr, size_t size, size_t nmemb, FILE *stream)
 {
-    char *buf_ptr = buf; // 不动原来的buf，原来的buf可能还用得着
-    const char *index_ptr = fmt; // 不动原来的fmt，但这个好像真用不着
-    char index_char = *index_ptr; // fmt串中的当前字符
-    int32_t arg_int; // 可能会出现的int参数
-    char *arg_str; // 可能会出现的char *参数
-    while (index_char) { // 没到fmt的结尾
-        if (index_char != '%') { // 不是%
-            *(buf_ptr++) = index_char; // 直接复制到buf
-            index_char = *(++index_ptr); // 自动更新到下一个字符
-            continue; // 跳过后续对于%的判断
+    const char *data = (const char *) ptr;
+    int total = size * nmemb;
+    if (!total) return 0;
+    if (stream->mode == _IONBF || !stream->size) { // 不缓冲，直接写
+        return write(stream->fd, data, total) == total ? nmemb : 0;
+    }
+    if (stream->len + total > stream->size) { // 放不下了，先把已有的写出去
+        if (fflush(stream) == EOF) return 0;
+        if (total >= stream->size) { // 一次比整个缓冲区还大，不必再拷一遍
+            return write(stream->fd, data, total) == total ? nmemb : 0;
         }
-        index_char = *(++index_ptr); // 先把%跳过去
-        switch (index_char) { // 对现在的index_char进行判断
-            case 's':
-                arg_str = va_arg(ap, char*); // 获取char *参数
-                strcpy(buf_ptr, arg_str); // 直接strcpy进buf_ptr
-                buf_ptr += strlen(arg_str); // buf_ptr直接跳到arg_str结尾，正好在arg_str结尾的\0处
-                break;
-            case 'c':
-                *(buf_ptr++) = va_arg(ap, int); // 把获取到的char参数直接写进buf_ptr
-                break;
-            case 'x':
-                arg_int = va_arg(ap, int); // 获取int参数
-                itoa(arg_int, &buf_ptr, 16); // itoa早在设计时就可以修改buf_ptr，这样就直接写到buf_ptr里了，还自动跳到数末尾
-                break;
-            case 'd':
-                arg_int = va_arg(ap, int); // 获取int参数
-                if (arg_int < 0) { // 给负数前面加个符号
-                    arg_int = -arg_int; // 先转负为正
-                    *(buf_ptr++) = '-'; // 然后加负号
-                }
-                itoa(arg_int, &buf_ptr, 10); // itoa早在设计时就可以修改buf_ptr，这样就直接写到buf_ptr里了，还自动跳到数末尾
-                break;
-            default:
+    }
+    memcpy(stream->buf + stream->len, data, total);
+    stream->len += total;
+    if (stream->mode == _IOLBF) {
+        for (int i = total - 1; i >= 0; i--) { // 行缓冲：这次写的内容里有换行就刷出去
+            if (data[i] == '\n') {
+                if (fflush(stream) == EOF) return 0;
                 break;
+            }
         }
-        index_char = *(++index_ptr); // 再把%后面的s c x d跳过去
     }
-    return strlen(buf); // 返回做完后buf的长度
+    return nmemb;
 }
 
-int sprintf(char *buf, const char *fmt, ...)
+int fputs(const char *str, FILE *stream)
+{
+    int len = strlen(str);
+    return fwrite(str, 1, len, stream) == len ? len : EOF;
+}
+
+int fputc(int ch, FILE *stream)
+{
+    char c = ch;
+    if (stream->mode != _IONBF && stream->len < stream->size) { // 最常见的情况，直接放进缓冲区
+        stream->buf[stream->len++] = c;
+        if (stream->len == stream->size || (c == '\n' && stream->mode == _IOLBF)) {
+            if (fflush(stream) == EOF) return EOF;
+        }
+        return (uint8_t) c;
+    }
+    return fwrite(&c, 1, 1, stream) == 1 ? (uint8_t) c : EOF;
+}
+
+static void file_sink_flush(format_sink_t *sink, int final)
+{
+    fwrite(sink->buf, 1, sink->len, (FILE *) sink->data);
+    sink->len = 0;
+}
+
+int vfprintf(FILE *stream, const char *fmt, va_list ap)
+{
+    char buf[128]; // 攒一小段就交给fwrite，多长的输出都不会溢出
+    format_sink_t sink = {buf, sizeof(buf), 0, 0, file_sink_flush, stream};
+    return format(&sink, fmt, ap);
+}
+
+int fprintf(FILE *stream, const char *fmt, ...)
 {
     va_list ap;
     va_start(ap, fmt);
-    int ret = vsprintf(buf, fmt, ap);
+    int ret = vfprintf(stream, fmt, ap);
     va_end(ap);
     return ret;
 }
 
 int vprintf(const char *fmt, va_list ap)
 {
-    char buf[1024] = {0}; // 理论上够了
-    int ret = vsprintf(buf, fmt, ap);
-    write(1, buf, ret);
-    return ret;
+    return vfprintf(stdout, fmt, ap);
 }
 
 int printf(const char *fmt, ...)
@@ -174,12 +181,19 @@ int printf(const char *fmt, ...)
 
 void puts(const char *buf)
 {
-    write(1, buf, strlen(buf));
-    write(1, "\n", 1);
+    fputs(buf, stdout);
+    fputc('\n', stdout); // 行缓冲下两段合成一次write
 }
 
 int putchar(char ch)
 {
-    printf("%c", ch);
-    return ch;
+    return fputc(ch, stdout);
+}
+
+// 退出前把没写出去的东西都写出去，_start里main返回后也走这里
+int exit(int ret)
+{
+    fflush(stdout);
+    fflush(stderr);
+    return _exit(ret);
 }
\ No newline at end of file
@@ -1,24 +1,65 @@
 #include "monios/common.h"
 
+// 先按4字节rep stosl，剩下不足4字节的再rep stosb
 void *memset(void *dst_, uint8_t value, uint32_t size)
 {
-    uint8_t *dst = (uint8_t *) dst_;
-    while (size-- > 0) *dst++ = value;
+    uint32_t fill = value * 0x01010101; // 把一个字节铺满4个字节
+    uint32_t d0, d1;
+    asm volatile(
+        "rep stosl\n\t"
+        "movl %4, %%ecx\n\t"
+        "andl $3, %%ecx\n\t"
+        "jz 1f\n\t"
+        "rep stosb\n"
+        "1:"
+        : "=&c"(d0), "=&D"(d1)
+        : "0"(size >> 2), "a"(fill), "g"(size), "1"(dst_)
+        : "memory");
     return dst_;
 }
 
+// 同memset，先rep movsl再rep movsb，比逐字节拷贝少了四分之三的循环
 void *memcpy(void *dst_, const void *src_, uint32_t size)
 {
-    uint8_t *dst = dst_;
-    const uint8_t *src = src_;
-    while (size-- > 0) *dst++ = *src++;
-    return (void *) src_;
+    uint32_t d0, d1, d2;
+    asm volatile(
+        "rep movsl\n\t"
+        "movl %4, %%ecx\n\t"
+        "andl $3, %%ecx\n\t"
+        "jz 1f\n\t"
+        "rep movsb\n"
+        "1:"
+        : "=&c"(d0), "=&D"(d1), "=&S"(d2)
+        : "0"(size >> 2), "g"(size), "1"(dst_), "2"(src_)
+        : "memory");
+    return dst_; // 以前返回的是src_，与标准不符
 }
 
+// 目标在源前面（或不重叠）时正着拷就是memcpy；目标在后面就倒着拷，先拷末尾不足4字节的零头
+// 倒着拷不用std：应用程序也链接这份代码，DF=1期间被打断的话，中断处理里的rep会走反方向
+void *memmove(void *dst_, const void *src_, uint32_t size)
+{
+    if (dst_ <= src_ || (const char *) dst_ >= (const char *) src_ + size) return memcpy(dst_, src_, size);
+    char *d = (char *) dst_ + size;
+    const char *s = (const char *) src_ + size;
+    uint32_t n = size & 3;
+    while (n--) *--d = *--s;
+    uint32_t *dw = (uint32_t *) d;
+    const uint32_t *sw = (const uint32_t *) s;
+    n = size >> 2;
+    while (n--) *--dw = *--sw; // dst在src后面，先写的高地址不会盖住还没读的源
+    return dst_;
+}
+
+// 4个字节一起比，发现不同再逐字节找出是哪一个
 int memcmp(const void *a_, const void *b_, uint32_t size)
 {
-    const char *a = a_;
-    const char *b = b_;
+    const uint8_t *a = a_;
+    const uint8_t *b = b_;
+    while (size >= 4 && *(const uint32_t *) a == *(const uint32_t *) b) {
+        a += 4, b += 4;
+        size -= 4;
+    }
     while (size-- > 0) {
         if (*a != *b) return *a > *b ? 1 : -1;
         a++, b++;
@@ -49,8 +90,15 @@ char *strncpy(char *dst_, const char *src_, uint32_t n)  // 添加这个函数
 uint32_t strlen(const char *str)
 {
     const char *p = str;
-    while (*p++);
-    return p - str - 1;
+    while ((uint32_t) p & 3) { // 先逐字节走到4字节对齐
+        if (!*p) return p - str;
+        p++;
+    }
+    const uint32_t *w = (const uint32_t *) p;
+    while (!((*w - 0x01010101) & ~*w & 0x80808080)) w++; // 4个字节里有0时这个式子才不为0，对齐的读不会越过字所在的内存
+    p = (const char *) w;
+    while (*p) p++; // 在这个字里找出0具体在哪
+    return p - str;
 }
 
 int8_t strcmp(const char *a, const char *b)
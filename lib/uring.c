@@ -0,0 +1,44 @@
+#include "uring.h"
+#include "stddef.h"
+
+// 取一个空闲的sqe，提交队列满了返回NULL
+io_uring_sqe_t *io_uring_get_sqe(io_uring_t *ring)
+{
+    if (ring->sqe_tail - ring->sq_head == ring->entries) return NULL; // 满了，需要先submit
+    io_uring_sqe_t *sqe = &ring->sqes[ring->sqe_tail & (ring->entries - 1)];
+    sqe->flags = 0;
+    sqe->off = -1; // 默认跟着读写指针走
+    sqe->user_data = 0;
+    ring->sqe_tail++; // 先只记在私有的位置上，submit时才让内核看到
+    return sqe;
+}
+
+// 通知内核处理提交队列里的全部请求，不等待完成
+int io_uring_submit(io_uring_t *ring)
+{
+    ring->sq_tail = ring->sqe_tail; // sqe都填好了，发布给内核
+    return io_uring_enter(0);
+}
+
+// 看一眼完成队列，没有完成的请求返回NULL
+io_uring_cqe_t *io_uring_peek_cqe(io_uring_t *ring)
+{
+    if (ring->cq_head == ring->cq_tail) return NULL;
+    return &ring->cqes[ring->cq_head & (ring->entries - 1)];
+}
+
+// 等到至少有一个完成的请求
+int io_uring_wait_cqe(io_uring_t *ring, io_uring_cqe_t **cqe)
+{
+    *cqe = io_uring_peek_cqe(ring);
+    if (*cqe) return 0; // 已经有了就不用进内核
+    if (io_uring_enter(1) < 0) return -1;
+    *cqe = io_uring_peek_cqe(ring);
+    return *cqe ? 0 : -1;
+}
+
+// 处理完一个cqe之后归还给内核
+void io_uring_cqe_seen(io_uring_t *ring)
+{
+    ring->cq_head++;
+}
@@ -0,0 +1,36 @@
+#!/bin/bash
+
+# 比较两次 bench 的结果（每行 BENCH <名字> <数值> <单位>）
+# 用法：tools/benchcmp.sh 基线 本次 [允许退步的百分比，默认10]
+# 有任何一项退步超过阈值就返回1
+
+BASELINE=$1
+CURRENT=$2
+THRESHOLD=${3:-10}
+
+if [ ! -f "$BASELINE" ] || [ ! -f "$CURRENT" ]; then
+    echo "用法：$0 基线 本次 [阈值%]"
+    echo "还没有基线的话先 make baseline"
+    exit 1
+fi
+
+awk -v threshold="$THRESHOLD" '
+FNR == NR { base[$2] = $3; next }
+{
+    name = $2; cur = $3; unit = $4
+    if (!(name in base)) { printf "%-18s %10s %10d %-10s new\n", name, "-", cur, unit; next }
+    if (unit == "MHz") { printf "%-18s %10d %10d %-10s info\n", name, base[name], cur, unit; next }
+    # 带/s的是吞吐，越大越好；其余的是耗时，越小越好
+    higher_better = unit ~ /\/s$/
+    if (base[name] == 0) change = 0
+    else change = (cur - base[name]) * 100 / base[name]
+    worse = higher_better ? -change : change
+    status = worse > threshold ? "REGRESSION" : (worse < -threshold ? "better" : "ok")
+    if (status == "REGRESSION") failed++
+    printf "%-18s %10d %10d %-10s %+7.1f%% %s\n", name, base[name], cur, unit, change, status
+}
+END {
+    if (failed) { printf "%d regression(s) over %d%%\n", failed, threshold; exit 1 }
+    print "no regressions"
+}
+' "$BASELINE" "$CURRENT"
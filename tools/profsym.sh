@@ -0,0 +1,66 @@
+#!/bin/bash
+
+# 把 prof dump 导出的采样文件换成按函数汇总的热点表
+# 用法：tools/profsym.sh prof.txt [out/kernel.sym]
+# prof.txt 要先从 hd.img 里拷出来，比如 mcopy -i hd.img ::PROF.TXT prof.txt
+# 需要 i686-elf-nm（或者用 NM=nm 指定别的 nm）
+
+PROFILE=$1
+SYMFILE=${2:-out/kernel.sym}
+NM=${NM:-i686-elf-nm}
+
+if [ -z "$PROFILE" ] || [ ! -f "$PROFILE" ]; then
+    echo "用法：$0 prof.txt [out/kernel.sym]"
+    exit 1
+fi
+if [ ! -f "$SYMFILE" ]; then
+    echo "找不到符号文件 $SYMFILE，先 make out/kernel.bin"
+    exit 1
+fi
+
+# 第一个输入是按地址排好序的代码符号，第二个输入是采样文件
+"$NM" -n "$SYMFILE" | awk '$2 ~ /^[tTwW]$/' | awk '
+# 不是每个awk都有strtonum，自己转十六进制
+function hex(s,    i, v) {
+    sub(/^0[xX]/, "", s)
+    s = tolower(s)
+    v = 0
+    for (i = 1; i <= length(s); i++) v = v * 16 + index("0123456789abcdef", substr(s, i, 1)) - 1
+    return v
+}
+FNR == NR {
+    addr[nsym] = hex($1)
+    name[nsym] = $3
+    nsym++
+    next
+}
+$1 == "task" {
+    tname[$2] = $3
+    next
+}
+$1 == "k" {
+    a = hex($3)
+    # 二分查找最后一个地址不大于a的符号
+    lo = 0; hi = nsym - 1; found = -1
+    while (lo <= hi) {
+        mid = int((lo + hi) / 2)
+        if (addr[mid] <= a) { found = mid; lo = mid + 1 } else hi = mid - 1
+    }
+    fn = found < 0 ? sprintf("0x%08x", a) : name[found]
+    hits[fn] += $2
+    total += $2
+    next
+}
+$1 == "u" {
+    fn = sprintf("[user pid %d %s]", $3, ($3 in tname) ? tname[$3] : "?")
+    hits[fn] += $2
+    total += $2
+    next
+}
+/^#/ { print; next }
+END {
+    if (!total) { print "没有样本"; exit }
+    printf "%8s %7s  %s\n", "samples", "percent", "function"
+    for (fn in hits) printf "%8d %6.2f%%  %s\n", hits[fn], hits[fn] * 100 / total, fn | "sort -k1,1nr"
+}
+' - "$PROFILE"
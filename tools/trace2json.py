@@ -0,0 +1,106 @@
+#!/usr/bin/env python3
+# 把 trace dump 导出的二进制跟踪文件转成 Chrome/Perfetto 的 JSON（chrome://tracing 或 ui.perfetto.dev 打开）
+# 用法：tools/trace2json.py trace.bin [trace.json]
+# trace.bin 要先从 hd.img 里拷出来，比如 mcopy -i hd.img ::TRACE.BIN trace.bin
+# 格式见 include/monios/trace.h
+
+import json
+import struct
+import sys
+
+TRACE_MAGIC = 0x52544e4d
+MAX_CPUS = 8 # 与 TRACE_MAX_CPUS 一致
+
+IRQ_ENTER, IRQ_EXIT, SWITCH, SYSCALL_ENTER, SYSCALL_EXIT, \
+    HD_READ, HD_READ_DONE, HD_WRITE, HD_WRITE_DONE, NET_RX, NET_TX = range(1, 12)
+
+SYSCALL_NAMES = ['getpid', 'write', 'read', 'open', 'close', 'lseek', 'unlink', 'create_process',
+                 'waitpid', 'exit', 'sbrk', 'mmap', 'munmap', 'readv', 'writev', 'pread',
+                 'pwrite', 'io_uring_setup', 'io_uring_enter', 'fsck', 'taskstat']
+IRQ_NAMES = {0: 'timer', 1: 'keyboard', 14: 'ide'}
+
+
+def main():
+    if len(sys.argv) < 2:
+        print('用法：%s trace.bin [trace.json]' % sys.argv[0])
+        return 1
+    data = open(sys.argv[1], 'rb').read()
+    head_fmt = '<IIIIIIIQQI%dI%dI' % (MAX_CPUS, MAX_CPUS)
+    fields = struct.unpack_from(head_fmt, data, 0)
+    magic, version, ncpus, event_size, hz, tick_start, tick_end, tsc_start, tsc_end, nnames = fields[:10]
+    nevents = fields[10:10 + MAX_CPUS]
+    lost = fields[10 + MAX_CPUS:]
+    if magic != TRACE_MAGIC or ncpus != MAX_CPUS or event_size != 16:
+        print('不是跟踪文件，或者版本对不上')
+        return 1
+    off = struct.calcsize(head_fmt)
+
+    # 用开始和结束时的tick数换算TSC频率，tick是100Hz，误差在1%左右
+    ticks = tick_end - tick_start
+    if ticks > 0 and hz:
+        tsc_per_us = (tsc_end - tsc_start) / (ticks * 1e6 / hz)
+    else:
+        tsc_per_us = 1000.0 # 记录太短，只能瞎猜1GHz
+        print('警告：记录时间不足一个tick，按1GHz换算', file=sys.stderr)
+
+    names = {}
+    for _ in range(nnames):
+        pid, name = struct.unpack_from('<I32s', data, off)
+        names[pid] = name.split(b'\0')[0].decode('ascii', 'replace')
+        off += 36
+
+    events = []
+    for cpu in range(ncpus):
+        for _ in range(nevents[cpu]):
+            tsc, typ, pid, arg = struct.unpack_from('<QHHI', data, off)
+            off += 16
+            events.append((tsc, cpu, typ, pid, arg))
+    events.sort()
+    if not events:
+        print('没有事件')
+        return 1
+    base = events[0][0]
+
+    out = []
+    seen = set()
+    for tsc, cpu, typ, pid, arg in events:
+        ts = (tsc - base) / tsc_per_us
+        ev = {'ts': ts, 'pid': cpu, 'tid': pid}
+        seen.add((cpu, pid))
+        if typ == IRQ_ENTER:
+            ev.update(ph='B', name='irq %s' % IRQ_NAMES.get(arg, arg), cat='irq')
+        elif typ == IRQ_EXIT:
+            ev.update(ph='E', cat='irq')
+        elif typ == SWITCH:
+            ev.update(ph='i', s='p', name='switch -> %d' % arg, cat='sched', args={'next': arg})
+        elif typ == SYSCALL_ENTER:
+            name = SYSCALL_NAMES[arg] if arg < len(SYSCALL_NAMES) else str(arg)
+            ev.update(ph='B', name='sys_' + name, cat='syscall')
+        elif typ == SYSCALL_EXIT:
+            ev.update(ph='E', cat='syscall', args={'ret': struct.unpack('<i', struct.pack('<I', arg))[0]})
+        elif typ in (HD_READ, HD_WRITE):
+            ev.update(ph='B', name='hd_read' if typ == HD_READ else 'hd_write', cat='disk', args={'lba': arg})
+        elif typ in (HD_READ_DONE, HD_WRITE_DONE):
+            ev.update(ph='E', cat='disk', args={'sectors': arg})
+        elif typ in (NET_RX, NET_TX):
+            ev.update(ph='i', s='t', name='net_rx' if typ == NET_RX else 'net_tx', cat='net', args={'len': arg})
+        else:
+            continue
+        out.append(ev)
+
+    for cpu, pid in sorted(seen): # 让每条线程显示任务名
+        out.append({'ph': 'M', 'name': 'thread_name', 'pid': cpu, 'tid': pid,
+                    'args': {'name': '%d %s' % (pid, names.get(pid, '?'))}})
+    for cpu in sorted(set(cpu for cpu, _ in seen)): # 每个CPU算一个进程
+        out.append({'ph': 'M', 'name': 'process_name', 'pid': cpu, 'args': {'name': 'cpu%d' % cpu}})
+
+    dst = sys.argv[2] if len(sys.argv) > 2 else sys.argv[1].rsplit('.', 1)[0] + '.json'
+    with open(dst, 'w') as f:
+        json.dump({'traceEvents': out, 'displayTimeUnit': 'ns',
+                   'otherData': {'lost_events': list(lost), 'tsc_mhz': round(tsc_per_us, 1)}}, f)
+    print('%d events -> %s (TSC %.1f MHz, %d overwritten)' % (len(out), dst, tsc_per_us, sum(lost)))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())